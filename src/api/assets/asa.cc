@@ -1,9 +1,11 @@
 #include "asa.hh"
+#include "../../hash.hh"
 
 #include <commons/fileio.hh>
 #include <commons/stringtools.hh>
 #include <commons/buffer.hh>
 #include <functional>
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <queue>
@@ -122,6 +124,100 @@ std::vector<uint8_t> compress(std::vector<uint8_t> &data)
 }
 // -=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-//
 
+// ToC Helpers -=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-//
+ASAEntry readToCEntry(FILE *in)
+{
+	ASAEntry entry;
+	readFile(in, &entry.format, sizeof(entry.format));
+	entry.hasHash = entry.format & tocFlagHashed;
+	entry.format &= ~tocFlagHashed;
+	readFile(in, &entry.filenameLen, sizeof(entry.filenameLen));
+	entry.filename.resize(entry.filenameLen);
+	readFile(in, entry.filename.data(), entry.filenameLen);
+	readFile(in, &entry.compressedSize, sizeof(entry.compressedSize));
+	readFile(in, &entry.decompressedSize, sizeof(entry.decompressedSize));
+	readFile(in, &entry.offset, sizeof(entry.offset));
+	if(entry.hasHash) readFile(in, &entry.hash, sizeof(entry.hash));
+	return entry;
+}
+
+void writeToCEntry(FILE *out, ASAEntry const &entry)
+{
+	uint8_t format = entry.hasHash ? (entry.format | tocFlagHashed) : entry.format;
+	writeFile(out, &format, sizeof(format));
+	writeFile(out, &entry.filenameLen, sizeof(entry.filenameLen));
+	writeFile(out, entry.filename.data(), entry.filename.length());
+	writeFile(out, &entry.compressedSize, sizeof(entry.compressedSize));
+	writeFile(out, &entry.decompressedSize, sizeof(entry.decompressedSize));
+	writeFile(out, &entry.offset, sizeof(entry.offset));
+	if(entry.hasHash) writeFile(out, &entry.hash, sizeof(entry.hash));
+}
+
+/// Compress and write the given files' data at the current position of 'out', appending their ToC entries to 'toc'
+/// Files whose content hash matches an entry already in 'toc' aren't written again, their entries reuse the existing blob
+void writeEntries(FILE *out, std::vector<std::string> const &filePathes, std::vector<ASAEntry> &toc, size_t &totalOffset)
+{
+	std::unordered_map<uint64_t, size_t> blobs; //Content hash -> index of the first ToC entry storing that content
+	for(size_t i = 0; i < toc.size(); i++) if(toc[i].hasHash) blobs.emplace(toc[i].hash, i);
+	FILE *in = nullptr;
+	ASAEntry tmp{};
+	for(auto const &path : filePathes)
+	{
+		in = openFile(path, "rb");
+		if(!in) throw std::runtime_error("ASA Writing: Failed to open asset " + path);
+		fseek(in, 0, SEEK_END);
+		size_t len = (size_t)ftell(in);
+		rewind(in);
+		std::vector<uint8_t> uncompressed(len);
+		readFile(in, uncompressed.data(), uncompressed.size());
+		bool shouldCompress = true;
+		for(auto const &dnc : doNotCompress)
+		{
+			if(endsWith(path, dnc))
+			{
+				shouldCompress = false;
+				break;
+			}
+		}
+		
+		tmp.format = shouldCompress ? cmpFmtZSTD : cmpFmtNone;
+		tmp.filename = path.substr(path.find_last_of('/') + 1);
+		tmp.filenameLen = (uint16_t)tmp.filename.length();
+		tmp.decompressedSize = len;
+		tmp.hasHash = true;
+		tmp.hash = xxHash64(uncompressed);
+		
+		auto dup = blobs.find(tmp.hash);
+		if(dup != blobs.end() && toc[dup->second].decompressedSize == len && toc[dup->second].format == tmp.format)
+		{
+			tmp.compressedSize = toc[dup->second].compressedSize;
+			tmp.offset = toc[dup->second].offset;
+		}
+		else
+		{
+			if(shouldCompress)
+			{
+				std::vector<uint8_t> compressed = compress(uncompressed);
+				writeFile(out, compressed.data(), compressed.size());
+				tmp.compressedSize = compressed.size();
+			}
+			else
+			{
+				writeFile(out, uncompressed.data(), uncompressed.size());
+				tmp.compressedSize = uncompressed.size();
+			}
+			tmp.offset = totalOffset;
+			totalOffset += tmp.compressedSize;
+			blobs.emplace(tmp.hash, toc.size());
+		}
+		toc.push_back(tmp);
+		tmp = {};
+		closeFile(in);
+		in = nullptr;
+	}
+}
+// -=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=--=-=-=-=-=-=-=-=-=-=-=-//
+
 ASA::~ASA()
 {
 	closeFile(this->in);
@@ -142,6 +238,7 @@ std::vector<uint8_t> ASA::read(std::shared_ptr<ASAEntry> const &entry)
 	if(entry->format == cmpFmtNone)
 	{
 		out.resize(entry->decompressedSize);
+		std::lock_guard<std::mutex> lck {this->readMtx};
 		fseek(this->in, (long)(magicSize + headerSize + entry->offset), SEEK_SET);
 		readFile(this->in, out.data(), out.size());
 	}
@@ -151,10 +248,14 @@ std::vector<uint8_t> ASA::read(std::shared_ptr<ASAEntry> const &entry)
 		#if 1 //Whole file decompression, tested ok
 		std::vector<uint8_t> inter{};
 		inter.resize(entry->compressedSize);
-		fseek(this->in, (long)(magicSize + headerSize + entry->offset), SEEK_SET);
-		readFile(this->in, inter.data(), inter.size());
+		{
+			std::lock_guard<std::mutex> lck {this->readMtx}; //Only the file access needs to be serialized, decompression can run in parallel
+			fseek(this->in, (long)(magicSize + headerSize + entry->offset), SEEK_SET);
+			readFile(this->in, inter.data(), inter.size());
+		}
 		out = decompress(inter);
-		#else //Block decompression, tested failing, data offset is wrong, file is mostly 0s
+		#else
+		std::lock_guard<std::mutex> lck {this->readMtx}; //Block decompression, tested failing, data offset is wrong, file is mostly 0s
 		this->decompressor = new Decompressor{[&out](std::vector<uint8_t> decompData){ out.insert(out.end(), decompData.begin(), decompData.end()); }};
 		std::vector<uint8_t> readBuffer;
 		readBuffer.resize(reinterpret_cast<Decompressor *>(this->decompressor)->recommendedInputSize());
@@ -187,16 +288,11 @@ std::unique_ptr<ASA> ASA::open(std::string const &filepath)
 	fseek(out->in, (long)out->header.tocBeginOffset, SEEK_SET);
 	for(size_t i = 0; i < out->header.numToCEntries; i++)
 	{
-		ASAEntry entry;
-		readFile(out->in, &entry.format, sizeof(entry.format));
-		readFile(out->in, &entry.filenameLen, sizeof(entry.filenameLen));
-		entry.filename.resize(entry.filenameLen);
-		readFile(out->in, entry.filename.data(), entry.filenameLen);
-		readFile(out->in, &entry.compressedSize, sizeof(entry.compressedSize));
-		readFile(out->in, &entry.decompressedSize, sizeof(entry.decompressedSize));
-		readFile(out->in, &entry.offset, sizeof(entry.offset));
-		out->toc.push_back(std::make_shared<ASAEntry>(entry));
+		out->toc.push_back(std::make_shared<ASAEntry>(readToCEntry(out->in)));
 	}
+	size_t tocBytes = out->toc.capacity() * sizeof(std::shared_ptr<ASAEntry>);
+	for(auto const &entry : out->toc) tocBytes += sizeof(ASAEntry) + entry->filename.capacity();
+	out->memory = MB::Allocation(MB::Category::Archives, tocBytes);
 	fseek(out->in, magicSize + headerSize, SEEK_SET); //seek to start of data
 	return out;
 }
@@ -207,66 +303,16 @@ void ASA::write(std::string const &asaFilePath, std::vector<std::string> const &
 	if(!out) throw std::runtime_error("ASA Writing: Failed to open" + asaFilePath + "for writing");
 	std::vector<ASAEntry> toc;
 	size_t tocEntries = filePathes.size(), totalOffset = 0;
-	FILE *in = nullptr;
-	ASAEntry tmp{};
 	writeFile(out, &magic, magicSize);
 	writeFile(out, &tocEntries, sizeof(tocEntries));
 	writeFile(out, &totalOffset, sizeof(totalOffset));
-	for(auto const &path : filePathes)
-	{
-		in = openFile(path, "rb");
-		if(!in) throw std::runtime_error("ASA Writing: Failed to open asset " + path);
-		fseek(in, 0, SEEK_END);
-		size_t len = (size_t)ftell(in);
-		rewind(in);
-		std::vector<uint8_t> uncompressed(len);
-		readFile(in, uncompressed.data(), uncompressed.size());
-		bool shouldCompress = true;
-		for(auto const &dnc : doNotCompress)
-		{
-			if(endsWith(path, dnc))
-			{
-				shouldCompress = false;
-				break;
-			}
-		}
-		if(shouldCompress)
-		{
-			std::vector<uint8_t> compressed = compress(uncompressed);
-			writeFile(out, compressed.data(), compressed.size());
-			tmp.compressedSize = compressed.size();
-		}
-		else
-		{
-			writeFile(out, uncompressed.data(), uncompressed.size());
-			tmp.compressedSize = uncompressed.size();
-		}
-		
-		tmp.format = shouldCompress ? cmpFmtZSTD : cmpFmtNone;
-		tmp.filename = path.substr(path.find_last_of('/') + 1);
-		tmp.filenameLen = (uint16_t)tmp.filename.length();
-		tmp.decompressedSize = len;
-		tmp.offset = totalOffset;
-		totalOffset += tmp.compressedSize;
-		toc.push_back(tmp);
-		tmp = {};
-		closeFile(in);
-		in = nullptr;
-	}
+	writeEntries(out, filePathes, toc, totalOffset);
 	size_t eofData = (size_t)ftell(out);
 	if((eofData - magicSize - headerSize) != totalOffset) throw std::runtime_error("Sanity check failure, data blob length mismatch");
 	fseek(out, magicSize + sizeof(tocEntries), SEEK_SET);
 	writeFile(out, &eofData, sizeof(eofData));
 	fseek(out, (long)eofData, SEEK_SET);
-	for(auto const &entry : toc) //Write the ToC
-	{
-		writeFile(out, &entry.format, sizeof(entry.format));
-		writeFile(out, &entry.filenameLen, sizeof(entry.filenameLen));
-		writeFile(out, entry.filename.data(), entry.filename.length());
-		writeFile(out, &entry.compressedSize, sizeof(entry.compressedSize));
-		writeFile(out, &entry.decompressedSize, sizeof(entry.decompressedSize));
-		writeFile(out, &entry.offset, sizeof(entry.offset));
-	}
+	for(auto const &entry : toc) writeToCEntry(out, entry); //Write the ToC
 	closeFile(out);
 }
 
@@ -286,63 +332,13 @@ void ASA::append(std::string const &inputASAFilePath, std::vector<std::string> c
 	std::vector<ASAEntry> toc;
 	for(uint64_t i = 0; i < numToCEntries; i++) //capture a copy of the ToC
 	{
-		ASAEntry entry;
-		readFile(out, &entry.format, sizeof(entry.format));
-		readFile(out, &entry.filenameLen, sizeof(entry.filenameLen));
-		entry.filename.resize(entry.filenameLen);
-		readFile(out, entry.filename.data(), entry.filenameLen);
-		readFile(out, &entry.compressedSize, sizeof(entry.compressedSize));
-		readFile(out, &entry.decompressedSize, sizeof(entry.decompressedSize));
-		readFile(out, &entry.offset, sizeof(entry.offset));
-		totalOffset += entry.compressedSize;
+		ASAEntry entry = readToCEntry(out);
+		totalOffset = std::max<size_t>(totalOffset, entry.offset + entry.compressedSize); //Deduplicated entries share blobs, so the blob's end is the furthest entry's end
 		toc.push_back(entry);
 	}
 	if((totalOffset + offsetToData) != tocBeginOffset) throw std::runtime_error("Sanity failed, stored offset to ToC doesn't match calculated offset");
 	fseek(out, tocBeginOffset, SEEK_SET);
-	FILE *in = nullptr;
-	ASAEntry tmp{};
-	for(auto const &path : filePathes)
-	{
-		in = fopen(path.data(), "rb");
-		if(!in) throw std::runtime_error("ASA Appending: Failed to open asset " + path);
-		fseek(in, 0, SEEK_END);
-		size_t len = (size_t)ftell(in);
-		rewind(in);
-		std::vector<uint8_t> uncompressed(len);
-		readFile(in, uncompressed.data(), uncompressed.size());
-		bool shouldCompress = true;
-		for(auto const &dnc : doNotCompress)
-		{
-			if(endsWith(path, dnc))
-			{
-				shouldCompress = false;
-				break;
-			}
-		}
-		if(shouldCompress)
-		{
-			std::vector<uint8_t> compressed = compress(uncompressed);
-			writeFile(out, compressed.data(), compressed.size());
-			tmp.compressedSize = compressed.size();
-		}
-		else
-		{
-			writeFile(out, uncompressed.data(), uncompressed.size());
-			tmp.compressedSize = uncompressed.size();
-		}
-		
-		tmp.format = shouldCompress ? cmpFmtZSTD : cmpFmtNone;
-		tmp.filename = path.substr(path.find_last_of('/') + 1);
-		tmp.filenameLen = (uint16_t)tmp.filename.length();
-		tmp.decompressedSize = len;
-		tmp.offset = totalOffset;
-		totalOffset += tmp.compressedSize;
-		printf("%zu %zu\n", (size_t)ftell(out), totalOffset + offsetToData);
-		toc.push_back(tmp);
-		tmp = {};
-		closeFile(in);
-		in = nullptr;
-	}
+	writeEntries(out, filePathes, toc, totalOffset);
 	size_t eofData = (size_t)ftell(out);
 	if((totalOffset + offsetToData) != eofData) throw std::runtime_error("Sanity failed, calculated offset to ToC doesn't match actual offset to ToC");
 	fseek(out, magicSize, SEEK_SET);
@@ -352,18 +348,17 @@ void ASA::append(std::string const &inputASAFilePath, std::vector<std::string> c
 	
 	fseek(out, eofData, SEEK_SET);
 	
-	for(auto const &entry : toc) //Write the new ToC
-	{
-		writeFile(out, &entry.format, sizeof(entry.format));
-		writeFile(out, &entry.filenameLen, sizeof(entry.filenameLen));
-		writeFile(out, entry.filename.data(), entry.filename.length());
-		writeFile(out, &entry.compressedSize, sizeof(entry.compressedSize));
-		writeFile(out, &entry.decompressedSize, sizeof(entry.decompressedSize));
-		writeFile(out, &entry.offset, sizeof(entry.offset));
-	}
+	for(auto const &entry : toc) writeToCEntry(out, entry); //Write the new ToC
 	closeFile(out);
 }
 
+bool ASA::verify(std::shared_ptr<ASAEntry> const &entry)
+{
+	if(!entry) return false;
+	if(!entry->hasHash) return true;
+	return xxHash64(this->read(entry)) == entry->hash;
+}
+
 std::shared_ptr<ASAEntry> ASA::find(std::string const &filename)
 {
 	for(auto const &tocEntry : this->toc) if(tocEntry->filename == filename) return tocEntry;
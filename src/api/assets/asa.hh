@@ -3,14 +3,22 @@
 //.ASA | Asset Streaming Archive
 //A ZSTD backed archival format for streaming game assets
 
+#include "../../memoryBudget.hh"
+
 #include <cstdint>
 #include <memory>
 #include <vector>
 #include <array>
+#include <string>
+#include <mutex>
 
 constexpr uint8_t const cmpFmtNone = 0;
 constexpr uint8_t const cmpFmtZSTD = 1;
 
+/// Set on a ToC entry's on-disk format byte when the entry is followed by a 64 bit content hash
+/// Archives written before content hashing was added don't set it and remain readable
+constexpr uint8_t const tocFlagHashed = 0x80;
+
 struct Header
 {
 	uint64_t numToCEntries;
@@ -25,6 +33,8 @@ struct ASAEntry
 	uint64_t compressedSize;
 	uint64_t decompressedSize;
 	uint64_t offset;
+	bool hasHash = false;
+	uint64_t hash = 0; //xxHash64 of the decompressed file, entries with identical content share the same data blob
 };
 
 struct ASA
@@ -38,6 +48,7 @@ struct ASA
 	[[nodiscard]] static std::unique_ptr<ASA> open(std::string const &filepath);
 	
 	/// Compress and archive a collection of files
+	/// Files with identical content are only stored once, their ToC entries point at the same data blob
 	/// \param asaFilePath Fully qualified/absolute path to the output .ASA file
 	/// \param filePathes List of file pathes to be read, compressed, and archived
 	static void write(std::string const &asaFilePath, std::vector<std::string> const &filePathes);
@@ -47,7 +58,7 @@ struct ASA
 	/// \param filePathes List of file pathes to read, compress, and append to the archive
 	static void append(std::string const &inputASAFilePath, std::vector<std::string> const &filePathes);
 	
-	/// Read and decompress the given file
+	/// Read and decompress the given file, safe to call from multiple threads
 	/// \param entry The desired file's ToC entry
 	/// \return The decompressed file
 	[[nodiscard]] std::vector<uint8_t> read(std::shared_ptr<ASAEntry> const &entry);
@@ -57,6 +68,11 @@ struct ASA
 	/// \return The decompressed file
 	[[nodiscard]] std::vector<uint8_t> read(std::string const &fileName);
 	
+	/// Check the given file's contents against the content hash stored in its ToC entry
+	/// \param entry The desired file's ToC entry
+	/// \return True if the file's contents match its hash, or if the entry predates content hashing
+	[[nodiscard]] bool verify(std::shared_ptr<ASAEntry> const &entry);
+	
 	/// Find the ToC entry for the given filename
 	/// \param filename The filename to search the ToC for, including extension
 	/// \return A pointer to the ToC entry, or nullptr if it couldn't be found
@@ -72,4 +88,6 @@ private:
 	ASA() = default;
 	FILE *in = nullptr;
 	void *decompressor = nullptr;
+	std::mutex readMtx; //Guards the file position of 'in' while reading
+	MB::Allocation memory{}; //The parsed ToC
 };
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../../memoryBudget.hh"
+
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -20,12 +23,13 @@ struct AudioInfo
 {
 	AudioInfo() = default;
 	AudioInfo(std::vector<int16_t> const &samples, int16_t numChannels, int16_t bitsPerSample, int32_t sampleRate, AudioFormat format) :
-			samples(samples), numChannels(numChannels), bitsPerSample(bitsPerSample), sampleRate(sampleRate), format(format) {}
+			samples(samples), numChannels(numChannels), bitsPerSample(bitsPerSample), sampleRate(sampleRate), format(format), memory(MB::Category::Audio, samples.size() * sizeof(int16_t)) {}
 	
 	std::vector<int16_t> samples{};
 	int16_t numChannels = 0, bitsPerSample = 0;
 	int32_t sampleRate = 0;
 	AudioFormat format = AudioFormat::NONE;
+	MB::Allocation memory{};
 };
 
 [[nodiscard]] AudioInfo decodeAudio(FILE *input, std::string const &filePath);
@@ -2,48 +2,153 @@
 
 #include <commons/fileio.hh>
 #include <cstring>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
 
 char constexpr const magic[] = {'M', 'S', 'H'};
+char constexpr const magicV2[] = {'M', 'S', '2'};
 size_t constexpr const magicSize = 3;
+size_t constexpr const headerSize = magicSize + sizeof(uint64_t) * 2;
+size_t constexpr const vertexAlignment = 16;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+/// Whether count elements of size bytes starting at offset end at or before limit, without overflowing on corrupt counts
+bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t limit)
+{
+	return offset <= limit && (size == 0 || count <= (limit - offset) / size);
+}
 
 std::unique_ptr<MeshFile> MeshFile::open(std::vector<uint8_t> const &data)
 {
+	return open(std::vector<uint8_t>(data));
+}
+
+std::unique_ptr<MeshFile> MeshFile::open(std::vector<uint8_t> &&data)
+{
+	if(data.size() < headerSize)
+	{
+		printf("Error parsing model, model file is truncated\n");
+		return nullptr;
+	}
 	std::unique_ptr<MeshFile> out = std::make_unique<MeshFile>();
 	size_t offset = 0;
-	char magicIn[3];
 	uint64_t numToCEntries = 0, offsetToToC = 0;
-	memcpy(&magicIn, data.data() + offset, sizeof(magic));
-	if(magicIn[0] != magic[0] && magicIn[1] != magic[1] && magicIn[2] != magic[2]) printf("Error parsing model, model file is corrupted or isn't a valid model file\n");
+	if(memcmp(data.data(), magicV2, magicSize) == 0) out->version = 2;
+	else if(memcmp(data.data(), magic, magicSize) == 0) out->version = 1;
+	else
+	{
+		printf("Error parsing model, model file is corrupted or isn't a valid model file\n");
+		return nullptr;
+	}
 	offset += magicSize;
 	memcpy(&numToCEntries, data.data() + offset, sizeof(numToCEntries));
 	offset += sizeof(numToCEntries);
 	memcpy(&offsetToToC, data.data() + offset, sizeof(offsetToToC));
 	offset += sizeof(offsetToToC);
-	size_t datasize = offsetToToC - (magicSize + sizeof(numToCEntries) - sizeof(offsetToToC));
-	out->data.resize(datasize);
-	memcpy(out->data.data(), data.data() + offset, datasize);
+	if(offsetToToC < headerSize || offsetToToC > data.size())
+	{
+		printf("Error parsing model, model file is corrupted\n");
+		return nullptr;
+	}
+	auto truncated = []()
+	{
+		printf("Error parsing model, model file is truncated\n");
+		return std::unique_ptr<MeshFile>{};
+	};
 	offset = offsetToToC;
+	
+	//Every field is checked against the end of the file, as numToCEntries and the name lengths come from the file itself
+	auto read = [&data, &offset](void *dst, size_t size)
+	{
+		if(!fits(offset, 1, size, data.size())) return false;
+		memcpy(dst, data.data() + offset, size);
+		offset += size;
+		return true;
+	};
 	for(size_t i = 0; i < numToCEntries; i++)
 	{
 		std::shared_ptr<MeshEntry> entry = std::make_shared<MeshEntry>();
-		memcpy(&entry->offsetIntoData, data.data() + offset, sizeof(entry->offsetIntoData));
-		offset += sizeof(entry->offsetIntoData);
-		memcpy(&entry->modelNameLen, data.data() + offset, sizeof(entry->modelNameLen));
-		offset += sizeof(entry->modelNameLen);
+		if(!read(&entry->offsetIntoData, sizeof(entry->offsetIntoData))) return truncated();
+		if(!read(&entry->modelNameLen, sizeof(entry->modelNameLen))) return truncated();
 		entry->modelName.resize(entry->modelNameLen);
-		memcpy(entry->modelName.data(), data.data() + offset, entry->modelNameLen);
-		offset += entry->modelNameLen;
-		memcpy(&entry->numVertElements, data.data() + offset, sizeof(entry->numVertElements));
-		offset += sizeof(entry->numVertElements);
-		memcpy(&entry->numUVElements, data.data() + offset, sizeof(entry->numUVElements));
-		offset += sizeof(entry->numUVElements);
-		memcpy(&entry->numNormalElements, data.data() + offset, sizeof(entry->numNormalElements));
-		offset += sizeof(entry->numNormalElements);
+		if(!read(entry->modelName.data(), entry->modelNameLen)) return truncated();
+		if(out->version == 1)
+		{
+			if(!read(&entry->numVertElements, sizeof(entry->numVertElements))) return truncated();
+			if(!read(&entry->numUVElements, sizeof(entry->numUVElements))) return truncated();
+			if(!read(&entry->numNormalElements, sizeof(entry->numNormalElements))) return truncated();
+			
+			//Version 1 offsets are relative to the data blob, which ends where the ToC starts
+			uint64_t end = entry->offsetIntoData;
+			bool fit = true;
+			for(uint64_t count : {entry->numVertElements, entry->numUVElements, entry->numNormalElements})
+			{
+				fit = fit && fits(end, count, sizeof(float), offsetToToC - headerSize);
+				if(fit) end += count * sizeof(float);
+			}
+			if(!fit)
+			{
+				printf("Error parsing model, %s's data is out of bounds\n", entry->modelName.data());
+				continue;
+			}
+		}
+		else
+		{
+			VertexFormat formats[3];
+			if(!read(&entry->numVerts, sizeof(entry->numVerts))) return truncated();
+			if(!read(formats, sizeof(formats))) return truncated();
+			if(!read(&entry->numIndices, sizeof(entry->numIndices))) return truncated();
+			if(!read(&entry->indexSize, sizeof(entry->indexSize))) return truncated();
+			if(!read(&entry->indexOffset, sizeof(entry->indexOffset))) return truncated();
+			entry->layout = VertexLayout::make(formats[0], formats[1], formats[2]);
+			entry->numVertElements = entry->numVerts * 3; //Positions are always read back as 3 components, whatever they're stored as
+			entry->numUVElements = formats[1] != VertexFormat::None ? entry->numVerts * 2 : 0;
+			entry->numNormalElements = formats[2] != VertexFormat::None ? entry->numVerts * 3 : 0;
+			bool formatsKnown = formats[0] != VertexFormat::None;
+			for(auto format : formats) if(static_cast<uint8_t>(format) > static_cast<uint8_t>(VertexFormat::SNorm1010102)) formatsKnown = false;
+			bool vertsFit = fits(entry->offsetIntoData, entry->numVerts, entry->layout.stride, offsetToToC);
+			bool indicesFit = entry->numIndices == 0 || ((entry->indexSize == 2 || entry->indexSize == 4) && fits(entry->indexOffset, entry->numIndices, entry->indexSize, offsetToToC));
+			if(!formatsKnown)
+			{
+				printf("Error parsing model, %s has an unknown vertex format\n", entry->modelName.data());
+				continue;
+			}
+			if(!vertsFit || !indicesFit)
+			{
+				printf("Error parsing model, %s's data is out of bounds\n", entry->modelName.data());
+				continue;
+			}
+		}
 		out->toc.push_back(entry);
 	}
+	if(out->version == 1) out->data.assign(data.begin() + headerSize, data.begin() + offsetToToC); //Version 1 offsets are relative to the data blob
+	else out->data = std::move(data); //Version 2 offsets are relative to the start of the file, so the models are viewed in place
+	out->memory = MB::Allocation(MB::Category::Meshes, out->data.size());
 	return out;
 }
 
+std::unique_ptr<MeshFile> MeshFile::open(std::string const &filePath)
+{
+	FILE *in = openFile(filePath, "rb");
+	if(!in)
+	{
+		printf("Unable to open %s for reading\n", filePath.data());
+		return nullptr;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	std::vector<uint8_t> data(size > 0 ? static_cast<size_t>(size) : 0);
+	data.resize(readFile(in, data.data(), data.size()));
+	closeFile(in);
+	return open(std::move(data));
+}
+
 std::shared_ptr<MeshEntry> MeshFile::find(std::string const &modelName)
 {
 	for(auto const &entry : this->toc) if(entry->modelName == modelName) return entry;
@@ -58,6 +163,7 @@ MeshData MeshFile::read(std::string const &modelName)
 MeshData MeshFile::read(std::shared_ptr<MeshEntry> const &tocEntry)
 {
 	MeshData out{};
+	if(!tocEntry) return out;
 	out.modelName = tocEntry->modelName;
 	out.numVertElements = tocEntry->numVertElements;
 	out.numUVElements = tocEntry->numUVElements;
@@ -68,6 +174,37 @@ MeshData MeshFile::read(std::shared_ptr<MeshEntry> const &tocEntry)
 	
 	uint8_t const *dataStart = this->data.data() + tocEntry->offsetIntoData;
 	
+	if(this->version == 2) //De-interleave
+	{
+		VertexLayout const &layout = tocEntry->layout;
+		auto unpack = [&](std::vector<float> &dst, size_t dstComponents, VertexFormat format, uint32_t attribOffset)
+		{
+			if(format == VertexFormat::None) return;
+			for(size_t v = 0; v < tocEntry->numVerts; v++)
+			{
+				float decoded[4] = {}; //Attributes stored with fewer components than dst, ie Short2 positions, are zero filled
+				VertexLayout::decode(format, dataStart + v * layout.stride + attribOffset, decoded);
+				memcpy(dst.data() + v * dstComponents, decoded, dstComponents * sizeof(float));
+			}
+		};
+		unpack(out.vertElements, 3, layout.position, 0);
+		unpack(out.uvElements, 2, layout.uv, layout.uvOffset);
+		unpack(out.normalElements, 3, layout.normal, layout.normalOffset);
+		out.indices.resize(tocEntry->numIndices);
+		uint8_t const *indexStart = this->data.data() + tocEntry->indexOffset;
+		for(size_t i = 0; i < tocEntry->numIndices; i++)
+		{
+			if(tocEntry->indexSize == 2)
+			{
+				uint16_t index = 0;
+				memcpy(&index, indexStart + i * 2, 2);
+				out.indices[i] = index;
+			}
+			else memcpy(&out.indices[i], indexStart + i * 4, 4);
+		}
+		return out;
+	}
+	
 	size_t offset = 0;
 	memcpy(out.vertElements.data(), dataStart, out.vertElements.size() * sizeof(float));
 	offset += out.numVertElements * sizeof(float);
@@ -77,44 +214,247 @@ MeshData MeshFile::read(std::shared_ptr<MeshEntry> const &tocEntry)
 	return out;
 }
 
+MeshView MeshFile::view(std::string const &modelName)
+{
+	return this->view(this->find(modelName));
+}
+
+MeshView MeshFile::view(std::shared_ptr<MeshEntry> const &tocEntry)
+{
+	MeshView out{};
+	if(!tocEntry || this->version != 2) return out;
+	out.layout = tocEntry->layout;
+	out.numVerts = tocEntry->numVerts;
+	out.vertices = {this->data.data() + tocEntry->offsetIntoData, tocEntry->numVerts * tocEntry->layout.stride};
+	if(tocEntry->numIndices != 0)
+	{
+		out.numIndices = tocEntry->numIndices;
+		out.indexSize = tocEntry->indexSize;
+		out.indices = {this->data.data() + tocEntry->indexOffset, tocEntry->numIndices * tocEntry->indexSize};
+	}
+	return out;
+}
+
+std::vector<uint8_t> MeshData::interleave(VertexLayout &layout) const
+{
+	size_t const numVerts = this->vertElements.size() / 3;
+	bool hasUVs = !this->uvElements.empty(), hasNormals = !this->normalElements.empty();
+	if(hasUVs && this->uvElements.size() != numVerts * 2)
+	{
+		printf("Model %s has a mismatched number of UVs, they'll be dropped\n", this->modelName.data());
+		hasUVs = false;
+	}
+	if(hasNormals && this->normalElements.size() != numVerts * 3)
+	{
+		printf("Model %s has a mismatched number of normals, they'll be dropped\n", this->modelName.data());
+		hasNormals = false;
+	}
+	layout = VertexLayout::make(this->positionFormat, hasUVs ? this->uvFormat : VertexFormat::None, hasNormals ? this->normalFormat : VertexFormat::None);
+	std::vector<uint8_t> out(numVerts * layout.stride);
+	for(size_t v = 0; v < numVerts; v++)
+	{
+		uint8_t *record = out.data() + v * layout.stride;
+		VertexLayout::encode(layout.position, this->vertElements.data() + v * 3, record);
+		if(hasUVs) VertexLayout::encode(layout.uv, this->uvElements.data() + v * 2, record + layout.uvOffset);
+		if(hasNormals) VertexLayout::encode(layout.normal, this->normalElements.data() + v * 3, record + layout.normalOffset);
+	}
+	return out;
+}
+
+/// Merge byte identical vertex records, rewriting the indices to match
+void deduplicate(std::vector<uint8_t> &records, uint32_t stride, std::vector<uint32_t> &indices)
+{
+	size_t const numRecords = records.size() / stride;
+	std::unordered_map<std::string_view, uint32_t> unique;
+	std::vector<uint32_t> remap(numRecords);
+	std::vector<uint8_t> out;
+	out.reserve(records.size());
+	for(size_t r = 0; r < numRecords; r++)
+	{
+		std::string_view record{reinterpret_cast<char const*>(records.data() + r * stride), stride};
+		auto [it, inserted] = unique.try_emplace(record, static_cast<uint32_t>(unique.size()));
+		if(inserted) out.insert(out.end(), records.begin() + r * stride, records.begin() + (r + 1) * stride);
+		remap[r] = it->second;
+	}
+	for(auto &index : indices) index = remap[index];
+	records = std::move(out);
+}
+
+/// Reorder a triangle list's triangles so vertices are reused while they're still in the post-transform cache
+/// Tipsify, from Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007)
+std::vector<uint32_t> tipsify(std::vector<uint32_t> const &indices, size_t numVerts, int64_t cacheSize)
+{
+	size_t const numTris = indices.size() / 3;
+	std::vector<uint32_t> adjacencyStart(numVerts + 1, 0), adjacency(numTris * 3);
+	for(size_t i = 0; i < numTris * 3; i++) adjacencyStart[indices[i] + 1]++; //Only whole triangles, MeshFile::write rejects lists with leftover indices
+	std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin());
+	std::vector<uint32_t> live(numVerts, 0), fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for(size_t t = 0; t < numTris; t++)
+	{
+		for(size_t c = 0; c < 3; c++)
+		{
+			uint32_t v = indices[t * 3 + c];
+			adjacency[fill[v]++] = static_cast<uint32_t>(t);
+			live[v]++;
+		}
+	}
+	
+	std::vector<int64_t> cacheTime(numVerts, 0);
+	std::vector<bool> emitted(numTris, false);
+	std::vector<uint32_t> deadEnd, candidates, out;
+	out.reserve(indices.size());
+	int64_t time = cacheSize + 1;
+	size_t cursor = 0;
+	int64_t fanning = numVerts != 0 ? 0 : -1;
+	while(fanning >= 0)
+	{
+		candidates.clear();
+		for(size_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++)
+		{
+			uint32_t t = adjacency[a];
+			if(emitted[t]) continue;
+			for(size_t c = 0; c < 3; c++)
+			{
+				uint32_t v = indices[t * 3 + c];
+				out.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if(time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+		
+		//Next fanning vertex is the candidate that will still be in the cache once its remaining triangles are emitted, preferring the oldest
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for(auto v : candidates)
+		{
+			if(live[v] == 0) continue;
+			int64_t priority = time - cacheTime[v] + 2 * live[v] <= cacheSize ? time - cacheTime[v] : 0;
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+		if(fanning >= 0) continue;
+		
+		//Dead end, fall back to recently used vertices, then to any vertex with triangles left
+		while(!deadEnd.empty() && fanning < 0)
+		{
+			uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if(live[v] > 0) fanning = v;
+		}
+		while(cursor < numVerts && fanning < 0)
+		{
+			if(live[cursor] > 0) fanning = static_cast<int64_t>(cursor);
+			cursor++;
+		}
+	}
+	return out;
+}
+
+/// Renumber vertices in the order they're first referenced so fetches walk the vertex buffer linearly, unreferenced vertices are dropped
+void reorderVertices(std::vector<uint8_t> &records, uint32_t stride, std::vector<uint32_t> &indices)
+{
+	uint32_t constexpr unassigned = ~0u;
+	std::vector<uint32_t> remap(records.size() / stride, unassigned);
+	std::vector<uint8_t> out;
+	out.reserve(records.size());
+	uint32_t next = 0;
+	for(auto &index : indices)
+	{
+		if(remap[index] == unassigned)
+		{
+			remap[index] = next++;
+			out.insert(out.end(), records.begin() + index * stride, records.begin() + (index + 1) * stride);
+		}
+		index = remap[index];
+	}
+	records = std::move(out);
+}
+
 void MeshFile::write(std::string const &outPath, std::vector<MeshData> const &modelData)
 {
 	FILE *out = fopen(outPath.data(), "wb");
 	if(!out) throw std::runtime_error("Unable to open " + outPath + " for writing");
 	uint64_t numToCEntries = (uint64_t)modelData.size(), offsetToToC = 0;
-	writeFile(out, &magic, magicSize);
+	writeFile(out, &magicV2, magicSize);
 	writeFile(out, &numToCEntries, sizeof(numToCEntries));
 	writeFile(out, &offsetToToC, sizeof(offsetToToC));
 	std::vector<MeshEntry> entries;
-	size_t curOffset = 0;
+	size_t curOffset = headerSize;
+	uint8_t const padding[vertexAlignment] = {};
 	for(auto const &data : modelData)
 	{
 		MeshEntry entry{};
-		entry.offsetIntoData = curOffset;
 		entry.modelName = data.modelName;
 		entry.modelNameLen = (uint16_t)entry.modelName.length();
-		entry.numVertElements = data.vertElements.size();
-		entry.numUVElements = data.uvElements.size();
-		entry.numNormalElements = data.normalElements.size();
+		std::vector<uint8_t> records = data.interleave(entry.layout);
+		uint32_t const stride = entry.layout.stride;
+		size_t const numRecords = records.size() / stride;
+		
+		std::vector<uint32_t> indices = data.indices;
+		if(indices.empty())
+		{
+			indices.resize(numRecords);
+			std::iota(indices.begin(), indices.end(), 0);
+		}
+		for(auto index : indices) if(index >= numRecords) throw std::runtime_error("Model " + data.modelName + " has indices past the end of its vertices");
+		if(data.triangleList && indices.size() % 3 != 0) throw std::runtime_error("Model " + data.modelName + " is a triangle list but its index count isn't a multiple of 3");
+		deduplicate(records, stride, indices);
+		if(data.triangleList) indices = tipsify(indices, records.size() / stride, 16);
+		reorderVertices(records, stride, indices);
+		
+		//Only index if it's smaller than repeating the vertices, or the model was indexed to begin with
+		entry.numVerts = records.size() / stride;
+		entry.indexSize = entry.numVerts <= UINT16_MAX ? 2 : 4;
+		bool const indexed = !data.indices.empty() || entry.numVerts * stride + indices.size() * entry.indexSize < indices.size() * stride;
+		if(!indexed)
+		{
+			std::vector<uint8_t> expanded(indices.size() * stride);
+			for(size_t i = 0; i < indices.size(); i++) memcpy(expanded.data() + i * stride, records.data() + indices[i] * stride, stride);
+			records = std::move(expanded);
+			entry.numVerts = indices.size();
+			entry.indexSize = 0;
+		}
+		
+		size_t aligned = alignUp(curOffset, vertexAlignment);
+		curOffset += writeFile(out, padding, aligned - curOffset);
+		entry.offsetIntoData = curOffset;
+		curOffset += writeFile(out, records.data(), records.size());
+		if(indexed)
+		{
+			aligned = alignUp(curOffset, 4);
+			curOffset += writeFile(out, padding, aligned - curOffset);
+			entry.indexOffset = curOffset;
+			entry.numIndices = indices.size();
+			if(entry.indexSize == 2)
+			{
+				std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+				curOffset += writeFile(out, shortIndices.data(), shortIndices.size() * sizeof(uint16_t));
+			}
+			else curOffset += writeFile(out, indices.data(), indices.size() * sizeof(uint32_t));
+		}
 		entries.push_back(entry);
-		size_t bytesWritten = 0;
-		bytesWritten += writeFile(out, data.vertElements.data(), data.vertElements.size() * sizeof(float));
-		bytesWritten += writeFile(out, data.uvElements.data(), data.uvElements.size() * sizeof(float));
-		bytesWritten += writeFile(out, data.normalElements.data(), data.normalElements.size() * sizeof(float));
-		curOffset += bytesWritten;
 	}
-	offsetToToC = curOffset + magicSize + sizeof(numToCEntries) + sizeof(offsetToToC);
+	offsetToToC = curOffset;
 	fseek(out, magicSize + sizeof(numToCEntries), SEEK_SET);
 	writeFile(out, &offsetToToC, sizeof(offsetToToC));
 	fseek(out, (long)offsetToToC, SEEK_SET);
 	for(auto const &entry : entries)
 	{
+		VertexFormat const formats[3] = {entry.layout.position, entry.layout.uv, entry.layout.normal};
 		writeFile(out, &entry.offsetIntoData, sizeof(entry.offsetIntoData));
 		writeFile(out, &entry.modelNameLen, sizeof(entry.modelNameLen));
 		writeFile(out, entry.modelName.data(), entry.modelNameLen);
-		writeFile(out, &entry.numVertElements, sizeof(entry.numVertElements));
-		writeFile(out, &entry.numUVElements, sizeof(entry.numUVElements));
-		writeFile(out, &entry.numNormalElements, sizeof(entry.numNormalElements));
+		writeFile(out, &entry.numVerts, sizeof(entry.numVerts));
+		writeFile(out, formats, sizeof(formats));
+		writeFile(out, &entry.numIndices, sizeof(entry.numIndices));
+		writeFile(out, &entry.indexSize, sizeof(entry.indexSize));
+		writeFile(out, &entry.indexOffset, sizeof(entry.indexOffset));
 	}
 	fclose(out);
 }
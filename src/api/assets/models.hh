@@ -2,11 +2,12 @@
 
 // Simple model storage format
 //
-// Magic char[3]
+// Version 1, read only:
+// Magic char[3] "MSH"
 // Num ToC Entries uint64_t
 // Offset to ToC from beginning of file uint64_t
 //
-// Data blob
+// Data blob, each model's positions, then UVs, then normals as separate float arrays
 //
 // ToC Entry:
 // Offset to entry from start of blob uint64_t
@@ -15,16 +16,48 @@
 // Num Verticies uint64_t
 // Num UVs uint64_t
 // Num Normals uint64_t
+//
+// Version 2:
+// Magic char[3] "MS2"
+// Num ToC Entries uint64_t
+// Offset to ToC from beginning of file uint64_t
+//
+// Data blob, each model's interleaved vertex records starting on a 16 byte boundary from the start of the file,
+// followed by its indices (if any) on the next 4 byte boundary, so a model can be uploaded to the GPU as-is
+//
+// ToC Entry:
+// Offset to vertex records from start of file uint64_t
+// Model name length uint16_t
+// Model name char const*
+// Num vertices uint64_t
+// Position, UV, normal VertexFormat uint8_t x3
+// Num indices uint64_t
+// Index size uint8_t (0 if not indexed, 2 or 4)
+// Offset to indices from start of file uint64_t
+
+#include "../../memoryBudget.hh"
+#include "../render/mesh.hh"
 
 #include <memory>
 #include <vector>
 #include <functional>
+#include <span>
+#include <string>
 
 struct MeshData
 {
+	/// Pack the attributes into one record per vertex
+	/// \param layout Set to the layout of the returned records
+	[[nodiscard]] std::vector<uint8_t> interleave(VertexLayout &layout) const;
+	
 	std::vector<float> vertElements, uvElements, normalElements;
+	std::vector<uint32_t> indices; //Empty if the model isn't indexed
 	uint64_t numVertElements = 0, numUVElements = 0, numNormalElements = 0;
 	std::string modelName = "";
+	bool triangleList = false; //Lets the writer reorder triangles for the vertex cache, strips and fans depend on their order so are left as is
+	
+	//What interleave() stores each attribute as, the compact formats cut vertex bandwidth, ie Short2 positions and Half2 UVs for tile geometry
+	VertexFormat positionFormat = VertexFormat::Float3, uvFormat = VertexFormat::Float2, normalFormat = VertexFormat::Float3;
 };
 
 struct MeshEntry
@@ -33,6 +66,25 @@ struct MeshEntry
 	uint16_t modelNameLen = 0;
 	std::string modelName = "";
 	uint64_t numVertElements = 0, numUVElements = 0, numNormalElements = 0; //How many float values each contains
+	
+	//Version 2 only
+	uint64_t numVerts = 0, numIndices = 0, indexOffset = 0;
+	VertexLayout layout{};
+	uint8_t indexSize = 0;
+};
+
+/// A model's data in place in its MeshFile's buffer, only valid for as long as the MeshFile is
+struct MeshView
+{
+	[[nodiscard]] inline bool empty() const
+	{
+		return this->vertices.empty();
+	}
+	
+	std::span<uint8_t const> vertices, indices;
+	VertexLayout layout{};
+	uint64_t numVerts = 0, numIndices = 0;
+	uint8_t indexSize = 0;
 };
 
 struct MeshFile
@@ -41,9 +93,13 @@ struct MeshFile
 	/// \param data
 	[[nodiscard]] static std::unique_ptr<MeshFile> open(std::vector<uint8_t> const &data);
 	
+	/// Parse a mesh from raw data, taking ownership of it so that version 2 models can be viewed in place without copying
+	/// \param data
+	[[nodiscard]] static std::unique_ptr<MeshFile> open(std::vector<uint8_t> &&data);
+	
 	/// Parse a mesh from a file on disk
 	/// \param filePath
-	[[nodiscard]] static std::unique_ptr<MeshFile> open(std::string const &filePath); //TODO implement
+	[[nodiscard]] static std::unique_ptr<MeshFile> open(std::string const &filePath);
 	
 	/// 
 	/// \param modelName
@@ -57,7 +113,14 @@ struct MeshFile
 	/// \param tocEntry
 	[[nodiscard]] MeshData read(std::shared_ptr<MeshEntry> const &tocEntry);
 	
-	/// 
+	/// Get a version 2 model's interleaved data without copying it
+	/// \return An empty view if the model doesn't exist or this is a version 1 file
+	[[nodiscard]] MeshView view(std::string const &modelName);
+	[[nodiscard]] MeshView view(std::shared_ptr<MeshEntry> const &tocEntry);
+	
+	/// Write models out as a version 2 file
+	/// Identical vertices are merged and the model is indexed if that makes it smaller,
+	/// triangle lists are also reordered so that vertices are reused while still in the post-transform cache
 	/// \param outPath 
 	/// \param modelData 
 	static void write(std::string const &outPath, std::vector<MeshData> const &modelData);
@@ -67,6 +130,8 @@ struct MeshFile
 	/// \param conversionFunc A function that reads a model file from disk and converts it to a ModelData struct
 	void convert(std::string const &outPath, std::function<void(std::vector<MeshData>&)> const &conversionFunc);
 	
-	std::vector<uint8_t> data;
+	std::vector<uint8_t> data; //Version 1 holds only the data blob, version 2 holds the entire file
 	std::vector<std::shared_ptr<MeshEntry>> toc;
+	uint8_t version = 0;
+	MB::Allocation memory{};
 };
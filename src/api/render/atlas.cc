@@ -8,6 +8,11 @@
 #include <glad/glad.h>
 #include <algorithm>
 
+Atlas::~Atlas()
+{
+	if(this->finalized) AR::deleteTexture(this->texID);
+}
+
 void Atlas::addTile(std::string const &name, std::vector<uint8_t> const &tileData)
 {
 	if(this->contains(name))
@@ -39,6 +44,7 @@ void Atlas::addTile(std::string const &name, std::vector<uint8_t> const &tileDat
 			f = ColorFormat::RGBA;
 			break;
 	}
+	this->tileMemory.resize(this->tileMemory.bytes + decoded.imageData.size());
 	this->atlas.push_back(AtlasImg{name, std::move(decoded.imageData), f, vec2<uint32_t>{0, 0}, decoded.width, decoded.height});
 }
 
@@ -59,9 +65,29 @@ void Atlas::addTile(std::string const &name, ColorFormat fmt, std::vector<uint8_
 		logger << Sev::ERR << "Tile data is empty" << logger.endl();
 		return;
 	}
+	this->tileMemory.resize(this->tileMemory.bytes + tileData.size());
 	this->atlas.push_back(AtlasImg{name, std::move(tileData), fmt, vec2<uint32_t>{0, 0}, width, height});
 }
 
+bool Atlas::replaceTile(std::string const &name, ColorFormat fmt, std::vector<uint8_t> &&tileData, uint32_t width, uint32_t height)
+{
+	for(auto &tile : this->atlas)
+	{
+		if(tile.name != name) continue;
+		if(tile.width != width || tile.height != height)
+		{
+			logger << Sev::ERR << "Can't replace atlas tile \"" << name << "\" with an image of different dimensions" << logger.endl();
+			return false;
+		}
+		this->tileMemory.resize(this->tileMemory.bytes - tile.data.size() + tileData.size());
+		tile.data = std::move(tileData);
+		tile.fmt = fmt;
+		if(this->finalized) AR::getTexture(this->texID)->subImage(tile.data.data(), tile.width, tile.height, tile.location.x(), tile.location.y(), tile.fmt);
+		return true;
+	}
+	return false;
+}
+
 QuadUVs Atlas::getUVsForTile(std::string const &name)
 {
 	if(!this->finalized || !this->contains(name))
@@ -150,6 +176,7 @@ void Atlas::finalize(ColorFormat fmt)
 		return;
 	}
 	this->texID = AR::newTexture(layout.width(), layout.height(), fmt, InterpMode::Nearest);
+	AR::getTexture(this->texID)->memory = MB::Allocation(MB::Category::Atlases, AR::getTexture(this->texID)->memory.bytes); //Report atlas pages separately from loose textures
 	AR::getTexture(this->texID)->clear();
 	for(auto &tile : this->atlas)
 	{
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "texture.hh"
+#include "../../memoryBudget.hh"
 
 #include <commons/math/vec2.hh>
 #include <vector>
@@ -14,6 +15,11 @@ struct QuadUVs
 /// A texture atlas for sprites, atlasDims x AtlasDims large, RGBA8, uses 64 MiB of VRAM per atlas
 struct Atlas
 {
+	Atlas() = default;
+	Atlas(Atlas const &other) = delete; //The atlas owns its texture
+	Atlas& operator=(Atlas const &other) = delete;
+	~Atlas();
+	
 	/// Add a new tile into this atlas
 	/// \param name The name of the tile
 	/// \param tileData Flat array of pixel data
@@ -24,6 +30,11 @@ struct Atlas
 	/// Add a new tile into this atlas from raw pixel data
 	void addTile(std::string const &name, ColorFormat fmt, std::vector<uint8_t> &&tileData, uint32_t width, uint32_t height);
 	
+	/// Replace a tile's pixels in place, ie when its source file has changed
+	/// The atlas isn't re-laid out, so the new image must be the same size as the old one
+	/// \return False if there's no tile with that name or its dimensions changed
+	bool replaceTile(std::string const &name, ColorFormat fmt, std::vector<uint8_t> &&tileData, uint32_t width, uint32_t height);
+	
 	/// Get the UV coordinates in the atlas for the given tile
 	/// \param id The ID of the tile
 	/// \return UV coordinates
@@ -36,6 +47,11 @@ struct Atlas
 	
 	[[nodiscard]] uint32_t getHandle();
 	
+	[[nodiscard]] bool isFinalized() const
+	{
+		return this->finalized;
+	}
+	
 	/// Check if this atlas contains a tile of the given name
 	[[nodiscard]] bool contains(std::string const &tileName);
 	
@@ -65,6 +81,7 @@ private:
 	
 	vec2<float> atlasDims{};
 	std::vector<AtlasImg> atlas;
-	uint64_t texID;
+	uint64_t texID = 0;
 	bool finalized = false;
+	MB::Allocation tileMemory{MB::Category::Atlases, 0}; //CPU-side copies of the tiles, kept for dump() and re-layout
 };
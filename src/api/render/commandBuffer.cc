@@ -0,0 +1,140 @@
+#include "commandBuffer.hh"
+#include "mesh.hh"
+
+size_t CommandBuffer::uniformSize(UniformType type)
+{
+	switch(type)
+	{
+		case UniformType::Float:
+		case UniformType::Int:
+		case UniformType::UInt: return 4;
+		case UniformType::Vec2f: return 8;
+		case UniformType::Vec3f: return 12;
+		case UniformType::Vec4f: return 16;
+		case UniformType::Mat3f: return 36;
+		case UniformType::Mat4f: return 64;
+	}
+	return 0;
+}
+
+void CommandBuffer::bindPipeline(Shader *shader)
+{
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::BindPipeline;
+	command.bindPipeline = {shader};
+}
+
+void CommandBuffer::bindTexture(uint32_t unit, uint32_t handle)
+{
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::BindTexture;
+	command.bindTexture = {unit, handle};
+}
+
+void CommandBuffer::bindImage(uint32_t unit, uint32_t handle, IO access, CF format)
+{
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::BindImage;
+	command.bindImage = {unit, handle, access, format};
+}
+
+void CommandBuffer::bindMesh(Mesh const *mesh)
+{
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::BindMesh;
+	command.bindMesh = {mesh};
+}
+
+void CommandBuffer::setUniform(UniformID uniform, UniformType type, void const *value)
+{
+	size_t const offset = this->uniformData.size();
+	size_t const size = uniformSize(type);
+	this->uniformData.resize(offset + size);
+	std::memcpy(this->uniformData.data() + offset, value, size);
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::SetUniform;
+	command.setUniform = {uniform.hash, type, static_cast<uint32_t>(offset)};
+}
+
+void CommandBuffer::setFloat(UniformID uniform, float value)
+{
+	this->setUniform(uniform, UniformType::Float, &value);
+}
+
+void CommandBuffer::setInt(UniformID uniform, int32_t value)
+{
+	this->setUniform(uniform, UniformType::Int, &value);
+}
+
+void CommandBuffer::setUInt(UniformID uniform, uint32_t value)
+{
+	this->setUniform(uniform, UniformType::UInt, &value);
+}
+
+void CommandBuffer::setMat4f(UniformID uniform, float const *value)
+{
+	this->setUniform(uniform, UniformType::Mat4f, value);
+}
+
+void CommandBuffer::draw(DrawMode mode, uint32_t count, uint32_t instances, uint32_t first)
+{
+	if(count == 0 || instances == 0) return;
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::Draw;
+	command.draw = {mode, first, count, instances};
+}
+
+void CommandBuffer::drawIndexed(DrawMode mode, uint32_t count, uint32_t indexSize, uint64_t indexOffset, uint32_t instances)
+{
+	if(count == 0 || instances == 0) return;
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::DrawIndexed;
+	command.drawIndexed = {mode, count, instances, indexSize, indexOffset};
+}
+
+void CommandBuffer::drawMesh(DrawMode mode, Mesh const &mesh, uint32_t instances)
+{
+	this->bindMesh(&mesh);
+	if(mesh.indexed()) this->drawIndexed(mode, static_cast<uint32_t>(mesh.numIndices), mesh.indexSize, mesh.indexOffset, instances);
+	else this->draw(mode, static_cast<uint32_t>(mesh.numVerts), instances);
+}
+
+void CommandBuffer::dispatch(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ)
+{
+	if(groupsX == 0 || groupsY == 0 || groupsZ == 0) return;
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::Dispatch;
+	command.dispatch = {groupsX, groupsY, groupsZ};
+}
+
+void CommandBuffer::barrier(uint32_t bits)
+{
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::Barrier;
+	command.barrier = {bits};
+}
+
+void CommandBuffer::timestamp(uint32_t query)
+{
+	if(query == 0) return;
+	Command &command = this->commands.emplace_back();
+	command.type = CommandType::Timestamp;
+	command.timestamp = {query};
+}
+
+void CommandBuffer::append(CommandBuffer const &other)
+{
+	size_t const first = this->commands.size();
+	uint32_t const dataBase = static_cast<uint32_t>(this->uniformData.size());
+	this->commands.insert(this->commands.end(), other.commands.begin(), other.commands.end());
+	this->uniformData.insert(this->uniformData.end(), other.uniformData.begin(), other.uniformData.end());
+	
+	//The other buffer's data offsets are relative to its own data
+	for(size_t i = first; i < this->commands.size(); i++) if(this->commands[i].type == CommandType::SetUniform) this->commands[i].setUniform.dataOffset += dataBase;
+}
+
+void CommandBuffer::clear()
+{
+	this->commands.clear();
+	this->uniformData.clear();
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "shader.hh"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+struct Mesh;
+
+/// Access types for compute shader imnage binding
+enum struct IO
+{
+	READ = 0x88B8, WRITE = 0x88B9, READWRITE = 0x88BA
+};
+
+/// Color format for compute shader image binding
+enum struct CF
+{
+	R32F = 0x822E, RGB8 = 0x8051, RGBA8 = 0x8058, RGB16 = 0x8054, RGBA16 = 0x805B, RGB32I = 0x8D83, RGBA32I = 0x8D82,
+	RGB32UI = 0x8D71, RGBA32UI = 0x8D70, RGB16F = 0x881B, RGBA16F = 0x881A, RGB32F = 0x8815, RGBA32F = 0x8814,
+	DEPTH32F = 0x8CAC,
+};
+
+/// Mode to draw a VAO in
+enum struct DrawMode
+{
+	TRIS = 0x0004, TRISTRIPS = 0x0005, TRIFANS = 0x0006,
+	LINES = 0x0001, LINESTRIPS = 0x0003, LINELOOPS = 0x0002,
+	POINTS = 0x0000,
+};
+
+enum struct CommandType : uint8_t
+{
+	BindPipeline, BindTexture, BindImage, BindMesh, SetUniform, Draw, DrawIndexed, Dispatch, Barrier, Timestamp,
+};
+
+enum struct UniformType : uint8_t
+{
+	Float, Int, UInt, Vec2f, Vec3f, Vec4f, Mat3f, Mat4f,
+};
+
+/// A single recorded command, every kind is plain data so a buffer is one flat array that can be copied, inspected and replayed
+struct Command
+{
+	struct BindPipeline
+	{
+		Shader *shader;
+	};
+	
+	struct BindTexture
+	{
+		uint32_t unit, handle;
+	};
+	
+	struct BindImage
+	{
+		uint32_t unit, handle;
+		IO access;
+		CF format;
+	};
+	
+	struct BindMesh
+	{
+		Mesh const *mesh;
+	};
+	
+	struct SetUniform
+	{
+		uint64_t uniform; //UniformID hash
+		UniformType type;
+		uint32_t dataOffset; //Byte offset of the value in the buffer's uniform data
+	};
+	
+	struct Draw
+	{
+		DrawMode mode;
+		uint32_t first, count, instances;
+	};
+	
+	struct DrawIndexed
+	{
+		DrawMode mode;
+		uint32_t count, instances, indexSize;
+		uint64_t indexOffset; //Byte offset of the first index in the bound mesh's element buffer
+	};
+	
+	struct Dispatch
+	{
+		uint32_t groupsX, groupsY, groupsZ;
+	};
+	
+	struct Barrier
+	{
+		uint32_t bits; //GL memory barrier bits
+	};
+	
+	struct Timestamp
+	{
+		uint32_t query;
+	};
+	
+	CommandType type;
+	union
+	{
+		BindPipeline bindPipeline;
+		BindTexture bindTexture;
+		BindImage bindImage;
+		BindMesh bindMesh;
+		SetUniform setUniform;
+		Draw draw;
+		DrawIndexed drawIndexed;
+		Dispatch dispatch;
+		Barrier barrier;
+		Timestamp timestamp;
+	};
+};
+static_assert(std::is_trivially_copyable_v<Command>, "Commands must stay plain data");
+
+/// Records draw and compute work without touching the graphics API, so it can be filled on any thread and checked without a context
+/// A buffer is owned by one thread while it's recorded, and is replayed by Renderer::submit on the thread that owns the GL context
+struct CommandBuffer
+{
+	[[nodiscard]] static size_t uniformSize(UniformType type);
+	
+	void bindPipeline(Shader *shader);
+	void bindTexture(uint32_t unit, uint32_t handle);
+	void bindImage(uint32_t unit, uint32_t handle, IO access, CF format);
+	void bindMesh(Mesh const *mesh);
+	
+	/// Set a uniform on the bound pipeline, the value is copied into the buffer
+	/// \param value uniformSize(type) bytes
+	void setUniform(UniformID uniform, UniformType type, void const *value);
+	void setFloat(UniformID uniform, float value);
+	void setInt(UniformID uniform, int32_t value);
+	void setUInt(UniformID uniform, uint32_t value);
+	void setMat4f(UniformID uniform, float const *value);
+	
+	/// Draw vertices of the bound mesh
+	void draw(DrawMode mode, uint32_t count, uint32_t instances = 1, uint32_t first = 0);
+	
+	/// Draw indices from the bound mesh's element buffer
+	void drawIndexed(DrawMode mode, uint32_t count, uint32_t indexSize, uint64_t indexOffset, uint32_t instances = 1);
+	
+	/// Bind a mesh and draw all of it, through its element buffer if it's indexed
+	void drawMesh(DrawMode mode, Mesh const &mesh, uint32_t instances = 1);
+	
+	/// Run the bound compute pipeline
+	void dispatch(uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ = 1);
+	
+	/// Make writes from earlier commands visible to later ones
+	/// \param bits GL memory barrier bits, ie GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+	void barrier(uint32_t bits);
+	
+	/// Record the GPU time once every earlier command has finished, into a query from GPUProfiler::scope
+	void timestamp(uint32_t query);
+	
+	/// Append another buffer's commands, eg to merge buffers recorded on several threads in order
+	void append(CommandBuffer const &other);
+	
+	/// Empty the buffer, keeping its memory for the next recording
+	void clear();
+	
+	[[nodiscard]] std::vector<Command> const& getCommands() const
+	{
+		return this->commands;
+	}
+	
+	/// Read back a recorded uniform's value
+	template <typename T> [[nodiscard]] T getUniform(Command::SetUniform const &uniform) const
+	{
+		T value;
+		std::memcpy(&value, this->uniformData.data() + uniform.dataOffset, sizeof(T));
+		return value;
+	}
+	
+	[[nodiscard]] uint8_t const* getUniformData(Command::SetUniform const &uniform) const
+	{
+		return this->uniformData.data() + uniform.dataOffset;
+	}
+	
+	[[nodiscard]] bool empty() const
+	{
+		return this->commands.empty();
+	}
+	
+	[[nodiscard]] size_t size() const
+	{
+		return this->commands.size();
+	}
+
+private:
+	std::vector<Command> commands;
+	std::vector<uint8_t> uniformData;
+};
@@ -0,0 +1,111 @@
+#include "font.hh"
+#include "../../global.hh"
+
+#include <algorithm>
+#include <cmath>
+
+BitmapFont::BitmapFont(PNG const &sheet, uint32_t cellWidth, uint32_t cellHeight, char32_t firstCodepoint) : cellWidth(cellWidth), cellHeight(cellHeight), firstCodepoint(firstCodepoint)
+{
+	uint32_t channels = 0;
+	switch(sheet.colorFormat)
+	{
+		case PNG::COLOR_FMT_GREY: channels = 1; break;
+		case PNG::COLOR_FMT_GREY_ALPHA: channels = 2; break;
+		case PNG::COLOR_FMT_RGB: channels = 3; break;
+		case PNG::COLOR_FMT_RGBA: channels = 4; break;
+		default: break;
+	}
+	if(channels == 0 || sheet.bitDepth != 8 || cellWidth == 0 || cellHeight == 0 || sheet.imageData.size() < static_cast<size_t>(sheet.width) * sheet.height * channels)
+	{
+		logger << Sev::ERR << "Font sheets must be 8 bit grey, grey alpha, RGB or RGBA images with a non-zero cell size, this font will have no glyphs" << logger.endl();
+		return;
+	}
+	this->sheetWidth = sheet.width;
+	this->sheetHeight = sheet.height;
+	this->numCells = (sheet.width / cellWidth) * (sheet.height / cellHeight);
+	
+	//Sheets with alpha are usually white on transparent, ones without are light on dark, so brightness stands in for alpha
+	this->coverage.resize(static_cast<size_t>(sheet.width) * sheet.height);
+	for(size_t i = 0; i < this->coverage.size(); i++)
+	{
+		uint8_t const *pixel = sheet.imageData.data() + i * channels;
+		if(channels == 2 || channels == 4) this->coverage[i] = pixel[channels - 1];
+		else if(channels == 3) this->coverage[i] = std::max({pixel[0], pixel[1], pixel[2]});
+		else this->coverage[i] = pixel[0];
+	}
+}
+
+bool BitmapFont::rasterize(char32_t codepoint, uint32_t pixelSize, GlyphBitmap &out) const
+{
+	if(codepoint < this->firstCodepoint || codepoint - this->firstCodepoint >= this->numCells || pixelSize == 0) return false;
+	uint32_t const cell = codepoint - this->firstCodepoint, columns = this->sheetWidth / this->cellWidth;
+	uint32_t const cellX = (cell % columns) * this->cellWidth, cellY = (cell / columns) * this->cellHeight;
+	auto sheetAt = [&](uint32_t x, uint32_t y)
+	{
+		return this->coverage[static_cast<size_t>(cellY + y) * this->sheetWidth + cellX + x];
+	};
+	
+	//Trimmed to what's drawn, so the atlas only holds the glyph itself
+	uint32_t left = this->cellWidth, right = 0, top = this->cellHeight, bottom = 0;
+	for(uint32_t y = 0; y < this->cellHeight; y++)
+	{
+		for(uint32_t x = 0; x < this->cellWidth; x++)
+		{
+			if(sheetAt(x, y) == 0) continue;
+			left = std::min(left, x);
+			right = std::max(right, x + 1);
+			top = std::min(top, y);
+			bottom = std::max(bottom, y + 1);
+		}
+	}
+	float const scale = static_cast<float>(pixelSize) / static_cast<float>(this->cellHeight);
+	out.advance = std::round(static_cast<float>(this->cellWidth) * scale);
+	if(right <= left || bottom <= top)
+	{
+		out.width = out.height = 0;
+		out.bearingX = out.bearingY = 0;
+		out.coverage.clear();
+		return true;
+	}
+	uint32_t const trimmedWidth = right - left, trimmedHeight = bottom - top;
+	out.width = std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(trimmedWidth) * scale)));
+	out.height = std::max(1u, static_cast<uint32_t>(std::lround(static_cast<float>(trimmedHeight) * scale)));
+	out.bearingX = static_cast<int32_t>(std::lround(static_cast<float>(left) * scale));
+	out.bearingY = static_cast<int32_t>(std::lround(static_cast<float>(this->cellHeight - top) * scale));
+	out.coverage.resize(static_cast<size_t>(out.width) * out.height);
+	
+	//Whole multiples of the sheet's size keep their hard pixel edges, anything else is filtered
+	bool const nearest = scale >= 1.0f && std::floor(scale) == scale;
+	float const stepX = static_cast<float>(trimmedWidth) / static_cast<float>(out.width), stepY = static_cast<float>(trimmedHeight) / static_cast<float>(out.height);
+	for(uint32_t y = 0; y < out.height; y++)
+	{
+		for(uint32_t x = 0; x < out.width; x++)
+		{
+			uint8_t &dst = out.coverage[static_cast<size_t>(y) * out.width + x];
+			if(nearest)
+			{
+				dst = sheetAt(left + static_cast<uint32_t>(static_cast<float>(x) * stepX), top + static_cast<uint32_t>(static_cast<float>(y) * stepY));
+				continue;
+			}
+			float const srcX = std::clamp((static_cast<float>(x) + 0.5f) * stepX - 0.5f, 0.0f, static_cast<float>(trimmedWidth - 1));
+			float const srcY = std::clamp((static_cast<float>(y) + 0.5f) * stepY - 0.5f, 0.0f, static_cast<float>(trimmedHeight - 1));
+			uint32_t const x0 = static_cast<uint32_t>(srcX), y0 = static_cast<uint32_t>(srcY);
+			uint32_t const x1 = std::min(x0 + 1, trimmedWidth - 1), y1 = std::min(y0 + 1, trimmedHeight - 1);
+			float const fx = srcX - static_cast<float>(x0), fy = srcY - static_cast<float>(y0);
+			float const upper = sheetAt(left + x0, top + y0) * (1.0f - fx) + sheetAt(left + x1, top + y0) * fx;
+			float const lower = sheetAt(left + x0, top + y1) * (1.0f - fx) + sheetAt(left + x1, top + y1) * fx;
+			dst = static_cast<uint8_t>(std::lround(upper * (1.0f - fy) + lower * fy));
+		}
+	}
+	return true;
+}
+
+float BitmapFont::lineHeight(uint32_t pixelSize) const
+{
+	return static_cast<float>(pixelSize);
+}
+
+float BitmapFont::ascent(uint32_t pixelSize) const
+{
+	return static_cast<float>(pixelSize);
+}
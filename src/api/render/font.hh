@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../assets/pngw.hh"
+
+#include <cstdint>
+#include <vector>
+
+/// One rasterized glyph, coverage only, its color comes from whatever draws it
+struct GlyphBitmap
+{
+	uint32_t width = 0, height = 0; //0 for glyphs with nothing to draw, ie space
+	int32_t bearingX = 0, bearingY = 0; //From the pen to the bitmap's left edge, and from the baseline up to its top row
+	float advance = 0; //How far the pen moves past this glyph
+	std::vector<uint8_t> coverage; //width * height, top row first
+};
+
+/// A source of glyphs, rasterized on demand into a GlyphCache so only the characters and sizes that are drawn take up atlas space
+struct Font
+{
+	virtual ~Font() = default;
+	
+	/// Rasterize a codepoint, out's coverage is reused so this allocates nothing once it's grown
+	/// \param pixelSize Height of a line in pixels
+	/// \return False if the font has no glyph for the codepoint
+	virtual bool rasterize(char32_t codepoint, uint32_t pixelSize, GlyphBitmap &out) const = 0;
+	
+	/// Distance between the baselines of two lines
+	[[nodiscard]] virtual float lineHeight(uint32_t pixelSize) const = 0;
+	
+	/// Distance from the top of a line down to its baseline
+	[[nodiscard]] virtual float ascent(uint32_t pixelSize) const = 0;
+};
+
+/// A monospaced font cut from a sheet of equally sized cells, one glyph per cell in codepoint order, left to right then top to bottom
+/// Coverage is taken from the sheet's alpha, or from its brightness if it has no alpha, and the baseline is the bottom of a cell
+struct BitmapFont : Font
+{
+	/// \param sheet The decoded sheet, 8 bits per channel
+	/// \param cellWidth, cellHeight Size of a cell in the sheet's pixels, which is also the font's native pixel size
+	/// \param firstCodepoint The codepoint in the sheet's first cell, 32 for sheets that start at space
+	BitmapFont(PNG const &sheet, uint32_t cellWidth, uint32_t cellHeight, char32_t firstCodepoint = 32);
+	
+	bool rasterize(char32_t codepoint, uint32_t pixelSize, GlyphBitmap &out) const override;
+	[[nodiscard]] float lineHeight(uint32_t pixelSize) const override;
+	[[nodiscard]] float ascent(uint32_t pixelSize) const override;
+
+private:
+	std::vector<uint8_t> coverage; //The whole sheet reduced to one channel
+	uint32_t sheetWidth = 0, sheetHeight = 0, cellWidth = 0, cellHeight = 0, numCells = 0;
+	char32_t firstCodepoint = 32;
+};
@@ -1,9 +1,26 @@
 #include "framebuffer.hh"
+#include "glState.hh"
+#include "renderGraph.hh"
 
 #include "../../global.hh"
 #include <glad/glad.h>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
 
-Framebuffer::Framebuffer(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &options, std::string const &name)
+namespace
+{
+	/// Bytes a framebuffer's attachments take
+	size_t footprint(uint32_t width, uint32_t height, CF format, bool depth)
+	{
+		return static_cast<size_t>(width) * height * (RenderGraph::bytesPerPixel(format) + (depth ? 4 : 0));
+	}
+}
+
+Framebuffer::Framebuffer(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &options, std::string const &name) :
+		Framebuffer(width, height, options, name, std::find(options.begin(), options.end(), Attachment::Alpha) != options.end() ? CF::RGBA32F : CF::RGB32F) {}
+
+Framebuffer::Framebuffer(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &options, std::string const &name, CF format)
 {
 	this->width = width;
 	this->height = height;
@@ -19,6 +36,7 @@ Framebuffer::Framebuffer(uint32_t width, uint32_t height, std::initializer_list<
 		}
 	}
 	this->name = name;
+	this->format = format;
 	createFBO(*this);
 }
 
@@ -40,6 +58,8 @@ Framebuffer::Framebuffer(Framebuffer &other)
 	
 	this->stencilHandle = other.stencilHandle;
 	other.stencilHandle = 0;
+	
+	this->memory = std::move(other.memory);
 }
 
 Framebuffer& Framebuffer::operator=(Framebuffer other)
@@ -55,6 +75,8 @@ Framebuffer& Framebuffer::operator=(Framebuffer other)
 	
 	this->stencilHandle = other.stencilHandle;
 	other.stencilHandle = 0;
+	
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
@@ -71,6 +93,8 @@ Framebuffer::Framebuffer(Framebuffer &&other)
 	
 	this->stencilHandle = other.stencilHandle;
 	other.stencilHandle = 0;
+	
+	this->memory = std::move(other.memory);
 }
 
 Framebuffer& Framebuffer::operator=(Framebuffer &&other)
@@ -86,21 +110,23 @@ Framebuffer& Framebuffer::operator=(Framebuffer &&other)
 	
 	this->stencilHandle = other.stencilHandle;
 	other.stencilHandle = 0;
+	
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
 void Framebuffer::use()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, this->handle);
+	GS::bindFramebuffer(this->handle);
 }
 
 void Framebuffer::bind(Attachment type, uint32_t target)
 {
 	switch(type)
 	{
-		case Attachment::Color: glBindTextureUnit(target, this->colorHandle); break;
-		case Attachment::Depth: glBindTextureUnit(target, this->depthHandle); break;
-		case Attachment::Stencil: glBindTextureUnit(target, this->stencilHandle); break;
+		case Attachment::Color: GS::bindTextureUnit(target, this->colorHandle); break;
+		case Attachment::Depth: GS::bindTextureUnit(target, this->depthHandle); break;
+		case Attachment::Stencil: GS::bindTextureUnit(target, this->stencilHandle); break;
 		default: break;
 	}
 }
@@ -115,13 +141,17 @@ void Framebuffer::regenerate(uint32_t width, uint32_t height)
 
 void Framebuffer::createFBO(Framebuffer &fbo)
 {
+	//Created through DSA, so making one mid-frame, ie from the pool, leaves the bound framebuffer, viewport and scissor alone
 	glCreateFramebuffers(1, &fbo.handle);
-	fbo.use();
-	glViewport(0, 0, fbo.width, fbo.height);
-	glScissor(0, 0, fbo.width, fbo.height);
 	if(fbo.hasColor) glCreateTextures(GL_TEXTURE_2D, 1, &fbo.colorHandle);
 	if(fbo.hasDepth) glCreateTextures(GL_TEXTURE_2D, 1, &fbo.depthHandle);
-	glTextureStorage2D(fbo.colorHandle, 1, fbo.hasAlpha ? GL_RGBA32F : GL_RGB32F, fbo.width, fbo.height);
+	glTextureStorage2D(fbo.colorHandle, 1, (GLenum)fbo.format, fbo.width, fbo.height);
+	
+	//One level and no mipmaps, so the default mipmapped minification would leave the texture incomplete when it's sampled
+	glTextureParameteri(fbo.colorHandle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(fbo.colorHandle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(fbo.colorHandle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	fbo.memory = MB::Allocation(MB::Category::Framebuffers, footprint(fbo.width, fbo.height, fbo.format, fbo.hasDepth));
 	glNamedFramebufferTexture(fbo.handle, GL_COLOR_ATTACHMENT0, fbo.colorHandle, 0);
 	if(fbo.hasDepth)
 	{
@@ -146,51 +176,205 @@ void Framebuffer::createFBO(Framebuffer &fbo)
 		}
 		logger << Sev::ERR << er << logger.endl();
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Framebuffer::clearFBO(Framebuffer &fbo)
 {
+	GS::forgetFramebuffer(fbo.handle);
+	GS::forgetTexture(fbo.colorHandle);
+	GS::forgetTexture(fbo.depthHandle);
 	glDeleteFramebuffers(1, &fbo.handle);
 	glDeleteTextures(1, &fbo.colorHandle);
 	glDeleteTextures(1, &fbo.depthHandle);
+	fbo.memory = {};
+}
+
+uint64_t FramebufferPool::Desc::key() const
+{
+	return static_cast<uint64_t>(this->width & 0xFFFF) | static_cast<uint64_t>(this->height & 0xFFFF) << 16 | static_cast<uint64_t>(this->attachments & 0xF) << 32 | static_cast<uint64_t>(this->format) << 36;
+}
+
+FramebufferPool::FramebufferPool(size_t memoryCap, uint32_t framesToKeep)
+{
+	this->cap = memoryCap;
+	this->keepFrames = framesToKeep;
 }
 
 FramebufferPool::FramebufferPool(size_t alloc, uint32_t width, uint32_t height)
 {
-	this->pool.resize(alloc);
-	for(size_t i = 0; i < alloc; i++)
+	for(size_t i = 0; i < alloc; i++) static_cast<void>(this->acquire(width, height, {Attachment::Color, Attachment::Alpha, Attachment::Depth}));
+}
+
+std::shared_ptr<Framebuffer> FramebufferPool::acquire(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &attachments, CF format)
+{
+	Desc desc{width, height, 0, format};
+	for(Attachment attachment : attachments) desc.attachments |= static_cast<uint8_t>(1u << static_cast<uint8_t>(attachment));
+	uint64_t const key = desc.key();
+	for(Entry &entry : this->buckets[key])
 	{
-		this->pool[i] = std::make_shared<Framebuffer>(width, height, std::initializer_list<Attachment>{Attachment::Color, Attachment::Alpha, Attachment::Depth}, "Pool " + std::to_string(i));
+		if(entry.fbo.use_count() != 1) continue;
+		entry.lastUsed = this->frame;
+		this->current.reused++;
+		return entry.fbo;
 	}
+	
+	bool const depth = std::find(attachments.begin(), attachments.end(), Attachment::Depth) != attachments.end();
+	this->makeRoom(footprint(width, height, format, depth));
+	char name[64];
+	snprintf(name, sizeof(name), "Pool %ux%u #%llu", width, height, static_cast<unsigned long long>(++this->created));
+	Entry &entry = this->buckets[key].emplace_back();
+	entry.fbo = std::make_shared<Framebuffer>(width, height, attachments, name, format);
+	entry.lastUsed = this->frame;
+	this->held += entry.fbo->memory.bytes;
+	this->current.created++;
+	return entry.fbo;
 }
 
 std::shared_ptr<Framebuffer> FramebufferPool::getNextAvailableFBO(uint32_t width, uint32_t height)
 {
-	std::shared_ptr<Framebuffer> out;
-	for(auto &fbo : this->pool)
+	std::shared_ptr<Framebuffer> fbo = this->acquire(width, height, {Attachment::Color, Attachment::Alpha, Attachment::Depth});
+	fbo->use();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	return fbo;
+}
+
+void FramebufferPool::endFrame()
+{
+	for(auto it = this->buckets.begin(); it != this->buckets.end();)
 	{
-		if(fbo.use_count() == 1)
+		std::vector<Entry> &bucket = it->second;
+		for(size_t i = bucket.size(); i-- > 0;)
 		{
-			if(fbo->width != width || fbo->height != height)
-			{
-				fbo = std::make_shared<Framebuffer>(width, height, std::initializer_list<Attachment>{Attachment::Color, Attachment::Alpha, Attachment::Depth}, "Pool " + std::to_string(this->pool.size() + 1));
-			}
-			fbo->use();
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			return fbo;
+			if(bucket[i].fbo.use_count() == 1 && this->frame - bucket[i].lastUsed >= this->keepFrames) this->destroy(bucket, i);
 		}
+		it = bucket.empty() ? this->buckets.erase(it) : std::next(it);
 	}
-	this->pool.push_back(std::make_shared<Framebuffer>(width, height, std::initializer_list<Attachment>{Attachment::Color, Attachment::Alpha, Attachment::Depth}, "Pool " + std::to_string(this->pool.size() + 1)));
-	this->pool.back()->use();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	return this->pool.back();
+	this->totals.created += this->current.created;
+	this->totals.reused += this->current.reused;
+	this->totals.destroyed += this->current.destroyed;
+	this->totals.overCap += this->current.overCap;
+	this->previous = this->current;
+	this->current = {};
+	this->frame++;
 }
 
 void FramebufferPool::onResize(uint32_t width, uint32_t height)
 {
-	for(auto const &fbo : this->pool)
+	for(auto &[key, bucket] : this->buckets)
+	{
+		for(size_t i = bucket.size(); i-- > 0;)
+		{
+			if(bucket[i].fbo.use_count() == 1 && (bucket[i].fbo->width != width || bucket[i].fbo->height != height)) this->destroy(bucket, i);
+		}
+	}
+}
+
+void FramebufferPool::clear()
+{
+	for(auto &[key, bucket] : this->buckets)
+	{
+		for(size_t i = bucket.size(); i-- > 0;) if(bucket[i].fbo.use_count() == 1) this->destroy(bucket, i);
+	}
+}
+
+void FramebufferPool::setMemoryCap(size_t bytes)
+{
+	this->cap = bytes;
+	this->makeRoom(0);
+}
+
+size_t FramebufferPool::memoryCap() const
+{
+	return this->cap;
+}
+
+size_t FramebufferPool::bytes() const
+{
+	return this->held;
+}
+
+size_t FramebufferPool::size() const
+{
+	size_t count = 0;
+	for(auto const &[key, bucket] : this->buckets) count += bucket.size();
+	return count;
+}
+
+FramebufferPool::Stats FramebufferPool::lastFrame() const
+{
+	return this->previous;
+}
+
+FramebufferPool::Stats FramebufferPool::total() const
+{
+	return this->totals;
+}
+
+std::string FramebufferPool::report() const
+{
+	char line[160];
+	snprintf(line, sizeof(line), "Framebuffer pool: %zu framebuffers, %.2f MB", this->size(), static_cast<double>(this->held) / (1024.0 * 1024.0));
+	std::string out = line;
+	if(this->cap != 0)
+	{
+		snprintf(line, sizeof(line), " of %.2f MB", static_cast<double>(this->cap) / (1024.0 * 1024.0));
+		out += line;
+	}
+	out += "\n";
+	for(auto const &[key, bucket] : this->buckets)
 	{
-		fbo->regenerate(width, height);
+		if(bucket.empty()) continue;
+		size_t free = 0;
+		for(Entry const &entry : bucket) if(entry.fbo.use_count() == 1) free++;
+		Framebuffer const &fbo = *bucket.front().fbo;
+		snprintf(line, sizeof(line), "  %5ux%-5u format 0x%04x%s  %zu held, %zu free\n", fbo.width, fbo.height, static_cast<uint32_t>(fbo.format), fbo.hasDepth ? " + depth" : "", bucket.size(), free);
+		out += line;
 	}
+	snprintf(line, sizeof(line), "  Last frame: %llu created, %llu reused, %llu destroyed\n", static_cast<unsigned long long>(this->previous.created), static_cast<unsigned long long>(this->previous.reused), static_cast<unsigned long long>(this->previous.destroyed));
+	out += line;
+	snprintf(line, sizeof(line), "  Total:      %llu created, %llu reused, %llu destroyed, %llu over the cap\n", static_cast<unsigned long long>(this->totals.created), static_cast<unsigned long long>(this->totals.reused), static_cast<unsigned long long>(this->totals.destroyed), static_cast<unsigned long long>(this->totals.overCap));
+	out += line;
+	return out;
+}
+
+void FramebufferPool::makeRoom(size_t needed)
+{
+	if(this->cap == 0) return;
+	while(this->held + needed > this->cap)
+	{
+		std::vector<Entry> *oldestBucket = nullptr;
+		size_t oldest = 0;
+		for(auto &[key, bucket] : this->buckets)
+		{
+			for(size_t i = 0; i < bucket.size(); i++)
+			{
+				if(bucket[i].fbo.use_count() != 1) continue;
+				if(!oldestBucket || bucket[i].lastUsed < (*oldestBucket)[oldest].lastUsed)
+				{
+					oldestBucket = &bucket;
+					oldest = i;
+				}
+			}
+		}
+		if(!oldestBucket)
+		{
+			//Everything is in use, the allocation goes ahead rather than failing the frame
+			if(needed != 0)
+			{
+				this->current.overCap++;
+				if(!this->warnedOverCap) logger << Sev::ERR << "Framebuffer pool is over its cap of " << this->cap << " bytes with every framebuffer in use" << logger.endl();
+				this->warnedOverCap = true;
+			}
+			return;
+		}
+		this->destroy(*oldestBucket, oldest);
+	}
+	this->warnedOverCap = false;
+}
+
+void FramebufferPool::destroy(std::vector<Entry> &bucket, size_t index)
+{
+	this->held -= bucket[index].fbo->memory.bytes;
+	this->current.destroyed++;
+	bucket.erase(bucket.begin() + static_cast<std::ptrdiff_t>(index));
 }
@@ -1,11 +1,15 @@
 #pragma once
 
+#include "commandBuffer.hh"
+#include "../../memoryBudget.hh"
+
 #include <cstdint>
 #include <initializer_list>
 #include <vector>
 #include <cstdio>
 #include <string>
 #include <memory>
+#include <unordered_map>
 
 enum struct Attachment
 {
@@ -16,6 +20,9 @@ struct Framebuffer
 {
 	Framebuffer() = delete;
 	Framebuffer(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &options, std::string const &name);
+	
+	/// \param format Storage of the color attachment, rather than the RGBA32F or RGB32F picked by whether there's an alpha attachment
+	Framebuffer(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &options, std::string const &name, CF format);
 	~Framebuffer();
 	
 	//copy
@@ -32,25 +39,91 @@ struct Framebuffer
 	
 	uint32_t handle = 0, colorHandle = 0, depthHandle = 0, stencilHandle = 0, width = 0, height = 0;
 	bool hasColor = false, hasDepth = false, hasAlpha = false, hasStencil = false;
+	CF format = CF::RGBA32F; //Of the color attachment
 	std::string name = "";
+	MB::Allocation memory{};
 
 private:
 	void createFBO(Framebuffer &fbo);
 	void clearFBO(Framebuffer &fbo);
 };
 
+/// Framebuffers kept between frames, bucketed by size, attachments and format so targets of different resolutions never take each other's place
+/// A framebuffer is free again once every shared_ptr to it but the pool's is dropped, free ones left unused for a few frames are destroyed
+/// Only usable on the thread that owns the GL context
 struct FramebufferPool
 {
-	FramebufferPool() = delete;
+	/// What makes two framebuffers interchangeable
+	struct Desc
+	{
+		uint32_t width = 0, height = 0;
+		uint8_t attachments = 0; //A bit per Attachment
+		CF format = CF::RGBA32F;
+		
+		[[nodiscard]] uint64_t key() const;
+	};
+	
+	/// Allocations made, churn is created plus destroyed, which should settle at 0 once the frame's targets stop changing
+	struct Stats
+	{
+		uint64_t created = 0, reused = 0, destroyed = 0;
+		uint64_t overCap = 0; //Created while the pool was already at its cap, with nothing free left to destroy
+	};
+	
 	FramebufferPool(FramebufferPool const &other) = delete;
 	FramebufferPool(FramebufferPool const &&other) = delete;
 	
+	/// \param memoryCap Bytes the pool's framebuffers may take before free ones are destroyed early to make room, 0 for no cap
+	/// \param framesToKeep Frames a free framebuffer is kept for before it's destroyed
+	explicit FramebufferPool(size_t memoryCap = 0, uint32_t framesToKeep = 3);
+	
+	/// Start with alloc framebuffers with color, alpha and depth attachments
 	FramebufferPool(size_t alloc, uint32_t width, uint32_t height);
 	
+	/// A free framebuffer matching the description, created if there isn't one, its contents are whatever its last user left
+	[[nodiscard]] std::shared_ptr<Framebuffer> acquire(uint32_t width, uint32_t height, std::initializer_list<Attachment> const &attachments, CF format = CF::RGBA32F);
+	
+	/// A framebuffer with color, alpha and depth attachments, bound and cleared
 	[[nodiscard]] std::shared_ptr<Framebuffer> getNextAvailableFBO(uint32_t width, uint32_t height);
 	
+	/// Destroy free framebuffers left unused for framesToKeep frames, then close the frame's stats, called once per frame
+	void endFrame();
+	
+	/// Destroy free framebuffers of any other size, they won't be asked for again until the size changes back
 	void onResize(uint32_t width, uint32_t height);
+	
+	/// Destroy every free framebuffer
+	void clear();
+	
+	void setMemoryCap(size_t bytes);
+	[[nodiscard]] size_t memoryCap() const;
+	
+	/// Bytes held by the pool's framebuffers, in use or free
+	[[nodiscard]] size_t bytes() const;
+	[[nodiscard]] size_t size() const;
+	
+	/// Stats for the last finished frame, and since the pool was created
+	[[nodiscard]] Stats lastFrame() const;
+	[[nodiscard]] Stats total() const;
+	
+	/// A human readable summary of the pool's buckets and churn
+	[[nodiscard]] std::string report() const;
 
 private:
-	std::vector<std::shared_ptr<Framebuffer>> pool;
+	struct Entry
+	{
+		std::shared_ptr<Framebuffer> fbo;
+		uint64_t lastUsed = 0; //Frame it was last acquired in
+	};
+	
+	/// Destroy free framebuffers, least recently used first, until the pool has room for more bytes under its cap
+	void makeRoom(size_t needed);
+	void destroy(std::vector<Entry> &bucket, size_t index);
+	
+	std::unordered_map<uint64_t, std::vector<Entry>> buckets; //By Desc::key
+	uint64_t frame = 0, created = 0;
+	size_t cap = 0, held = 0;
+	uint32_t keepFrames = 3;
+	Stats current{}, previous{}, totals{};
+	bool warnedOverCap = false;
 };
@@ -0,0 +1,132 @@
+#include "glState.hh"
+
+#include <glad/glad.h>
+#include <array>
+#include <atomic>
+
+namespace GLState
+{
+	constexpr uint32_t unknown = 0xFFFFFFFF; //No GL object has this name, so it never matches a real bind
+	constexpr size_t numTrackedUnits = 32; //Units past this are passed straight through
+	
+	uint32_t program = unknown, vertexArray = unknown, framebuffer = unknown;
+	std::array<uint32_t, numTrackedUnits> textures = [] { std::array<uint32_t, numTrackedUnits> units{}; units.fill(unknown); return units; }();
+	std::array<int8_t, static_cast<size_t>(Capability::Count)> capabilities{-1, -1, -1, -1}; //-1 if unknown
+	BlendFactors blend{};
+	std::array<int32_t, 4> viewportRect{-1, -1, -1, -1}, scissorRect{-1, -1, -1, -1};
+	Stats current{};
+	std::atomic<uint64_t> lastApplied{0}, lastSkipped{0};
+	
+	/// Record the new value and report whether GL needs to be told
+	template <typename T> bool change(T &cached, T const &value)
+	{
+		if(cached == value)
+		{
+			current.skipped++;
+			return false;
+		}
+		cached = value;
+		current.applied++;
+		return true;
+	}
+	
+	void useProgram(uint32_t handle)
+	{
+		if(change(program, handle)) glUseProgram(handle);
+	}
+	
+	void bindVertexArray(uint32_t handle)
+	{
+		if(change(vertexArray, handle)) glBindVertexArray(handle);
+	}
+	
+	void bindTextureUnit(uint32_t unit, uint32_t handle)
+	{
+		if(unit >= numTrackedUnits)
+		{
+			current.applied++;
+			glBindTextureUnit(unit, handle);
+		}
+		else if(change(textures[unit], handle)) glBindTextureUnit(unit, handle);
+	}
+	
+	void bindFramebuffer(uint32_t handle)
+	{
+		if(change(framebuffer, handle)) glBindFramebuffer(GL_FRAMEBUFFER, handle);
+	}
+	
+	void setCapability(Capability capability, bool enabled)
+	{
+		static constexpr GLenum caps[] = {GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST};
+		size_t const index = static_cast<size_t>(capability);
+		if(!change(capabilities[index], static_cast<int8_t>(enabled))) return;
+		enabled ? glEnable(caps[index]) : glDisable(caps[index]);
+	}
+	
+	void blendFunc(uint32_t src, uint32_t dst)
+	{
+		if(change(blend, BlendFactors{src, dst, src, dst})) glBlendFunc(src, dst);
+	}
+	
+	void blendFuncSeparate(uint32_t srcRGB, uint32_t dstRGB, uint32_t srcAlpha, uint32_t dstAlpha)
+	{
+		if(change(blend, BlendFactors{srcRGB, dstRGB, srcAlpha, dstAlpha})) glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+	}
+	
+	BlendFactors currentBlendFunc()
+	{
+		return blend;
+	}
+	
+	void viewport(int32_t x, int32_t y, int32_t width, int32_t height)
+	{
+		if(change(viewportRect, std::array<int32_t, 4>{x, y, width, height})) glViewport(x, y, width, height);
+	}
+	
+	void scissor(int32_t x, int32_t y, int32_t width, int32_t height)
+	{
+		if(change(scissorRect, std::array<int32_t, 4>{x, y, width, height})) glScissor(x, y, width, height);
+	}
+	
+	void forgetProgram(uint32_t handle)
+	{
+		if(program == handle) program = unknown;
+	}
+	
+	void forgetVertexArray(uint32_t handle)
+	{
+		if(vertexArray == handle) vertexArray = unknown;
+	}
+	
+	void forgetTexture(uint32_t handle)
+	{
+		for(auto &unit : textures) if(unit == handle) unit = unknown;
+	}
+	
+	void forgetFramebuffer(uint32_t handle)
+	{
+		if(framebuffer == handle) framebuffer = unknown;
+	}
+	
+	void invalidate()
+	{
+		program = vertexArray = framebuffer = unknown;
+		textures.fill(unknown);
+		capabilities.fill(-1);
+		blend = {};
+		viewportRect.fill(-1);
+		scissorRect.fill(-1);
+	}
+	
+	void endFrame()
+	{
+		lastApplied = current.applied;
+		lastSkipped = current.skipped;
+		current = {};
+	}
+	
+	Stats lastFrame()
+	{
+		return {lastApplied.load(), lastSkipped.load()};
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+/// Shadow copy of the GL state the engine changes, so binds and toggles that wouldn't change anything are never sent to the driver
+/// Only valid on the thread that owns the GL context, and only while every change to the tracked state goes through here
+namespace GLState
+{
+	enum struct Capability : uint8_t
+	{
+		Blend, CullFace, DepthTest, ScissorTest, Count,
+	};
+	
+	/// Blend factors for color and alpha, both 0xFFFFFFFF if they haven't been set through here
+	struct BlendFactors
+	{
+		uint32_t srcRGB = 0xFFFFFFFF, dstRGB = 0xFFFFFFFF, srcAlpha = 0xFFFFFFFF, dstAlpha = 0xFFFFFFFF;
+		
+		[[nodiscard]] inline bool operator==(BlendFactors const &other) const = default;
+	};
+	
+	/// How many calls were sent to GL and how many were dropped because the state already matched
+	struct Stats
+	{
+		uint64_t applied = 0, skipped = 0;
+	};
+	
+	void useProgram(uint32_t handle);
+	void bindVertexArray(uint32_t handle);
+	void bindTextureUnit(uint32_t unit, uint32_t handle);
+	void bindFramebuffer(uint32_t handle);
+	void setCapability(Capability capability, bool enabled);
+	void blendFunc(uint32_t src, uint32_t dst);
+	void blendFuncSeparate(uint32_t srcRGB, uint32_t dstRGB, uint32_t srcAlpha, uint32_t dstAlpha);
+	void viewport(int32_t x, int32_t y, int32_t width, int32_t height);
+	void scissor(int32_t x, int32_t y, int32_t width, int32_t height);
+	
+	/// The blend factors last set, so a pass that changes them can put them back
+	[[nodiscard]] BlendFactors currentBlendFunc();
+	
+	/// Objects must be forgotten when they're deleted, GL unbinds them and a new object could be given the same name
+	void forgetProgram(uint32_t handle);
+	void forgetVertexArray(uint32_t handle);
+	void forgetTexture(uint32_t handle);
+	void forgetFramebuffer(uint32_t handle);
+	
+	/// Forget everything, for after GL state has been changed behind the tracker's back
+	void invalidate();
+	
+	/// Close the current frame's counts, called once per frame by the renderer
+	void endFrame();
+	
+	/// Counts from the last finished frame, safe to read from any thread
+	[[nodiscard]] Stats lastFrame();
+}
+namespace GS = GLState;
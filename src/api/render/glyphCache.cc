@@ -0,0 +1,176 @@
+#include "glyphCache.hh"
+#include "../../assets.hh"
+#include "../../hash.hh"
+#include "../../global.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr char32_t replacement = 0xFFFD;
+	
+	/// Decode the codepoint at the start of text, malformed sequences decode to U+FFFD one byte at a time
+	char32_t decodeUTF8(std::string_view text, size_t &pos)
+	{
+		uint8_t const lead = static_cast<uint8_t>(text[pos++]);
+		if(lead < 0x80) return lead;
+		uint32_t length = 0;
+		char32_t codepoint = 0;
+		if((lead & 0xE0) == 0xC0)
+		{
+			length = 1;
+			codepoint = lead & 0x1F;
+		}
+		else if((lead & 0xF0) == 0xE0)
+		{
+			length = 2;
+			codepoint = lead & 0x0F;
+		}
+		else if((lead & 0xF8) == 0xF0)
+		{
+			length = 3;
+			codepoint = lead & 0x07;
+		}
+		else return replacement;
+		if(pos + length > text.size()) return replacement;
+		for(uint32_t i = 0; i < length; i++)
+		{
+			uint8_t const next = static_cast<uint8_t>(text[pos + i]);
+			if((next & 0xC0) != 0x80) return replacement;
+			codepoint = (codepoint << 6) | (next & 0x3F);
+		}
+		pos += length;
+		return codepoint;
+	}
+}
+
+size_t GlyphCache::GlyphKeyHash::operator()(GlyphKey const &key) const
+{
+	return static_cast<size_t>(key.fontID * 0x9E3779B185EBCA87ULL ^ (static_cast<uint64_t>(key.pixelSize) << 21) ^ key.codepoint);
+}
+
+GlyphCache::GlyphCache()
+{
+	this->texID = AR::newTexture(atlasSize, atlasSize, ColorFormat::RGBA, InterpMode::Linear);
+	UP<Texture> &texture = AR::getTexture(this->texID);
+	texture->memory = MB::Allocation(MB::Category::Atlases, texture->memory.bytes); //Reported with the sprite atlases
+	this->layout = MU<BSPLayout<uint32_t>>(atlasSize, atlasSize);
+}
+
+GlyphCache::~GlyphCache()
+{
+	AR::deleteTexture(this->texID);
+}
+
+uint32_t GlyphCache::getHandle() const
+{
+	UP<Texture> &texture = AR::getTexture(this->texID);
+	return texture ? texture->handle : 0;
+}
+
+void GlyphCache::beginFrame()
+{
+	if(!this->overflowed) return;
+	logger << Sev::INFO << "The glyph atlas is full, it's been emptied and glyphs will be rasterized again as they're drawn" << logger.endl();
+	this->resetAtlas();
+}
+
+void GlyphCache::clear()
+{
+	this->resetAtlas();
+}
+
+void GlyphCache::resetAtlas()
+{
+	this->layout = MU<BSPLayout<uint32_t>>(atlasSize, atlasSize);
+	this->glyphs.clear();
+	UP<Texture> &texture = AR::getTexture(this->texID);
+	if(texture) texture->clear();
+	this->generation++;
+	this->overflowed = false;
+}
+
+GlyphCache::Glyph const& GlyphCache::glyph(uint64_t fontID, uint32_t pixelSize, char32_t codepoint)
+{
+	auto [it, inserted] = this->glyphs.try_emplace(GlyphKey{fontID, pixelSize, codepoint});
+	Glyph &glyph = it->second;
+	if(!inserted) return glyph;
+	UP<Font> &font = AR::getFont(fontID);
+	if(!font || !font->rasterize(codepoint, pixelSize, this->bitmap)) return glyph;
+	glyph.advance = this->bitmap.advance;
+	glyph.found = true;
+	if(this->bitmap.width == 0 || this->bitmap.height == 0) return glyph;
+	
+	//Once a glyph has overflowed the layout has grown past the texture, so nothing more is packed until the atlas is emptied
+	vec2<uint32_t> const pos = this->overflowed ? vec2<uint32_t>{} : this->layout->pack(this->bitmap.width + padding, this->bitmap.height + padding);
+	if(this->overflowed || pos.x() + this->bitmap.width + padding > atlasSize || pos.y() + this->bitmap.height + padding > atlasSize)
+	{
+		this->overflowed = true;
+		glyph.found = false;
+		return glyph;
+	}
+	this->upload.resize(this->bitmap.coverage.size() * 4);
+	for(size_t i = 0; i < this->bitmap.coverage.size(); i++)
+	{
+		this->upload[i * 4] = this->upload[i * 4 + 1] = this->upload[i * 4 + 2] = 255;
+		this->upload[i * 4 + 3] = this->bitmap.coverage[i];
+	}
+	AR::getTexture(this->texID)->subImage(this->upload.data(), this->bitmap.width, this->bitmap.height, pos.x(), pos.y(), ColorFormat::RGBA);
+	glyph.width = static_cast<float>(this->bitmap.width);
+	glyph.height = static_cast<float>(this->bitmap.height);
+	glyph.bearingX = static_cast<float>(this->bitmap.bearingX);
+	glyph.bearingY = static_cast<float>(this->bitmap.bearingY);
+	glyph.uvRect[0] = static_cast<float>(pos.x()) / atlasSize;
+	glyph.uvRect[1] = static_cast<float>(pos.y()) / atlasSize;
+	glyph.uvRect[2] = static_cast<float>(pos.x() + this->bitmap.width) / atlasSize;
+	glyph.uvRect[3] = static_cast<float>(pos.y() + this->bitmap.height) / atlasSize;
+	return glyph;
+}
+
+GlyphCache::GlyphRun const* GlyphCache::shape(uint64_t fontID, uint32_t pixelSize, std::string_view text)
+{
+	UP<Font> &font = AR::getFont(fontID);
+	if(!font) return nullptr;
+	uint64_t const hash = xxHash64(text.data(), text.size(), fontID ^ (static_cast<uint64_t>(pixelSize) * 0x9E3779B185EBCA87ULL));
+	CachedRun &cached = this->runs[hash % runSlots];
+	if(cached.generation == this->generation && cached.hash == hash && cached.fontID == fontID && cached.pixelSize == pixelSize && cached.text == text) return &cached.run;
+	
+	//The slot's storage is kept, so a string that changes every frame is laid out again without allocating
+	cached.text.assign(text);
+	cached.hash = hash;
+	cached.fontID = fontID;
+	cached.pixelSize = pixelSize;
+	cached.generation = this->generation;
+	GlyphRun &run = cached.run;
+	run.glyphs.clear();
+	float const lineHeight = font->lineHeight(pixelSize), ascent = font->ascent(pixelSize);
+	float penX = 0, baseline = ascent, width = 0;
+	for(size_t pos = 0; pos < text.size();)
+	{
+		char32_t const codepoint = decodeUTF8(text, pos);
+		if(codepoint == '\n')
+		{
+			width = std::max(width, penX);
+			penX = 0;
+			baseline += lineHeight;
+			continue;
+		}
+		if(codepoint == '\t')
+		{
+			float const tab = this->glyph(fontID, pixelSize, ' ').advance * tabWidth;
+			if(tab > 0) penX = (std::floor(penX / tab) + 1) * tab;
+			continue;
+		}
+		Glyph const &glyph = this->glyph(fontID, pixelSize, codepoint);
+		if(!glyph.found) continue;
+		if(glyph.width > 0) run.glyphs.push_back({penX + glyph.bearingX, baseline - glyph.bearingY, glyph.width, glyph.height, {glyph.uvRect[0], glyph.uvRect[1], glyph.uvRect[2], glyph.uvRect[3]}});
+		penX += glyph.advance;
+	}
+	run.width = std::max(width, penX);
+	run.height = baseline - ascent + lineHeight;
+	
+	//A glyph that overflowed the atlas was dropped, so the run is laid out again once the atlas has been emptied
+	if(this->overflowed) cached.generation = 0;
+	return &run;
+}
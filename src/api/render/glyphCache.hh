@@ -0,0 +1,104 @@
+#pragma once
+
+#include "font.hh"
+#include "../../def.hh"
+#include "../../bsp.hh"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Glyphs of every font and size drawn so far, rasterized once into one shared atlas, and the strings drawn with them laid out into runs
+/// Strings are shaped once and then found by hash, so text that doesn't change costs one lookup a frame, and text that does, ie a score counter,
+/// is shaped into a run whose storage is reused, allocating nothing once its glyphs are in the atlas
+/// Only usable on the thread that owns the GL context
+struct GlyphCache
+{
+	static constexpr uint32_t atlasSize = 1024; //RGBA8, 4 MiB, white with the glyphs' coverage in alpha so they can be drawn as sprites
+	static constexpr uint32_t padding = 1; //Empty texels between glyphs so filtering never picks up a neighbour
+	static constexpr size_t runSlots = 512; //Runs are cached direct mapped by hash, a string that collides with another is shaped again when it's next drawn
+	static constexpr uint32_t tabWidth = 4; //In spaces
+	
+	/// A glyph placed in its run, relative to the run's upper left corner with y growing down the lines
+	struct PlacedGlyph
+	{
+		float x = 0, y = 0, width = 0, height = 0;
+		float uvRect[4]{}; //Left, lower, right, upper as SpriteInstance's are, lower is the smaller v which holds the glyph's top row
+	};
+	
+	/// A string laid out in one font and size, only valid until the next shape() call
+	struct GlyphRun
+	{
+		std::vector<PlacedGlyph> glyphs; //Glyphs with nothing to draw, ie spaces, are left out
+		float width = 0, height = 0; //Of all of its lines, in pixels
+	};
+	
+	GlyphCache();
+	GlyphCache(GlyphCache const &other) = delete; //The cache owns its atlas
+	GlyphCache& operator=(GlyphCache const &other) = delete;
+	~GlyphCache();
+	
+	/// Lay out a UTF-8 string, rasterizing any glyphs it uses that aren't in the atlas yet
+	/// Newlines start a new line and tabs advance to the next multiple of tabWidth spaces, codepoints the font lacks are skipped
+	/// \return The run, or nullptr if the font doesn't exist
+	[[nodiscard]] GlyphRun const* shape(uint64_t fontID, uint32_t pixelSize, std::string_view text);
+	
+	/// Called at the start of each frame, a full atlas is emptied here rather than while the frame's draws may still be using it
+	void beginFrame();
+	
+	/// Forget every glyph and run, ie after a font has been replaced
+	void clear();
+	
+	[[nodiscard]] uint32_t getHandle() const;
+	
+	/// Glyphs that didn't fit in the atlas since the last beginFrame, they're dropped for that frame
+	[[nodiscard]] inline bool full() const
+	{
+		return this->overflowed;
+	}
+
+private:
+	struct GlyphKey
+	{
+		uint64_t fontID = 0;
+		uint32_t pixelSize = 0;
+		char32_t codepoint = 0;
+		
+		[[nodiscard]] inline bool operator==(GlyphKey const &other) const = default;
+	};
+	
+	struct GlyphKeyHash
+	{
+		[[nodiscard]] size_t operator()(GlyphKey const &key) const;
+	};
+	
+	struct Glyph
+	{
+		float width = 0, height = 0, bearingX = 0, bearingY = 0, advance = 0;
+		float uvRect[4]{};
+		bool found = false; //False if the font has no glyph for the codepoint or it didn't fit
+	};
+	
+	struct CachedRun
+	{
+		GlyphRun run;
+		std::string text; //Compared on a hash match, so colliding strings are never mistaken for each other
+		uint64_t hash = 0, fontID = 0;
+		uint32_t pixelSize = 0, generation = 0;
+	};
+	
+	Glyph const& glyph(uint64_t fontID, uint32_t pixelSize, char32_t codepoint);
+	void resetAtlas();
+	
+	uint64_t texID = 0;
+	UP<BSPLayout<uint32_t>> layout = nullptr;
+	std::unordered_map<GlyphKey, Glyph, GlyphKeyHash> glyphs;
+	std::array<CachedRun, runSlots> runs{};
+	GlyphBitmap bitmap; //Reused for every rasterization
+	std::vector<uint8_t> upload; //The bitmap expanded to RGBA8
+	uint32_t generation = 1; //Bumped whenever glyphs move or are forgotten, so runs laid out before then are shaped again
+	bool overflowed = false;
+};
@@ -0,0 +1,170 @@
+#include "gpuProfiler.hh"
+
+#include <glad/glad.h>
+#include <array>
+#include <cstdio>
+#include <unordered_map>
+#include <commons/fileio.hh>
+
+namespace GPUProfiler
+{
+	constexpr double smoothing = 0.05; //Weight of a new sample in the average
+	
+	/// A scope measured in a frame, its queries go back to the free list once they're read
+	struct Measurement
+	{
+		size_t scope = 0;
+		uint32_t begin = 0, end = 0;
+	};
+	
+	bool on = false;
+	uint32_t frame = 0; //Index into inFlight of the frame being recorded
+	std::array<std::vector<Measurement>, framesInFlight> inFlight{};
+	std::vector<uint32_t> freeQueries;
+	std::vector<uint32_t> allQueries;
+	std::vector<Timing> scopes;
+	std::unordered_map<std::string, size_t> scopeIndices;
+	
+	uint32_t acquireQuery()
+	{
+		if(freeQueries.empty())
+		{
+			uint32_t query = 0;
+			glCreateQueries(GL_TIMESTAMP, 1, &query);
+			allQueries.push_back(query);
+			return query;
+		}
+		uint32_t query = freeQueries.back();
+		freeQueries.pop_back();
+		return query;
+	}
+	
+	/// Read back a frame's measurements, results that still aren't available are dropped rather than waited on
+	void collect(std::vector<Measurement> &measurements)
+	{
+		std::vector<double> frameMS(scopes.size(), 0.0);
+		std::vector<bool> measured(scopes.size(), false);
+		for(Measurement const &measurement : measurements)
+		{
+			GLuint available = 0;
+			glGetQueryObjectuiv(measurement.end, GL_QUERY_RESULT_AVAILABLE, &available);
+			if(available)
+			{
+				GLuint64 begin = 0, end = 0;
+				glGetQueryObjectui64v(measurement.begin, GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(measurement.end, GL_QUERY_RESULT, &end);
+				frameMS[measurement.scope] += static_cast<double>(end - begin) / 1000000.0;
+				measured[measurement.scope] = true;
+			}
+			freeQueries.push_back(measurement.begin);
+			freeQueries.push_back(measurement.end);
+		}
+		measurements.clear();
+		for(size_t i = 0; i < scopes.size(); i++)
+		{
+			if(!measured[i]) continue;
+			Timing &timing = scopes[i];
+			timing.lastMS = frameMS[i];
+			timing.averageMS = timing.samples == 0 ? frameMS[i] : timing.averageMS + (frameMS[i] - timing.averageMS) * smoothing;
+			timing.samples++;
+		}
+	}
+	
+	void setEnabled(bool enabled)
+	{
+		if(on == enabled) return;
+		on = enabled;
+		for(auto &measurements : inFlight)
+		{
+			for(Measurement const &measurement : measurements)
+			{
+				freeQueries.push_back(measurement.begin);
+				freeQueries.push_back(measurement.end);
+			}
+			measurements.clear();
+		}
+	}
+	
+	bool enabled()
+	{
+		return on;
+	}
+	
+	void beginFrame()
+	{
+		if(!on) return;
+		frame = (frame + 1) % framesInFlight;
+		collect(inFlight[frame]);
+	}
+	
+	std::pair<uint32_t, uint32_t> scope(std::string const &name)
+	{
+		if(!on) return {0, 0};
+		auto it = scopeIndices.find(name);
+		if(it == scopeIndices.end())
+		{
+			it = scopeIndices.emplace(name, scopes.size()).first;
+			scopes.push_back({name, 0, 0, 0});
+		}
+		Measurement &measurement = inFlight[frame].emplace_back();
+		measurement.scope = it->second;
+		measurement.begin = acquireQuery();
+		measurement.end = acquireQuery();
+		return {measurement.begin, measurement.end};
+	}
+	
+	std::vector<Timing> timings()
+	{
+		return scopes;
+	}
+	
+	double averageMS(std::string const &name)
+	{
+		auto it = scopeIndices.find(name);
+		return it == scopeIndices.end() ? 0.0 : scopes[it->second].averageMS;
+	}
+	
+	void reset()
+	{
+		for(Timing &timing : scopes)
+		{
+			timing.lastMS = timing.averageMS = 0;
+			timing.samples = 0;
+		}
+	}
+	
+	std::string report()
+	{
+		std::string out = "GPU timings:\n";
+		char line[160];
+		double total = 0;
+		for(Timing const &timing : scopes)
+		{
+			if(timing.samples == 0) continue;
+			snprintf(line, sizeof(line), "  %-32s %8.3f ms  avg %8.3f ms\n", timing.name.data(), timing.lastMS, timing.averageMS);
+			out += line;
+			total += timing.averageMS;
+		}
+		snprintf(line, sizeof(line), "  %-32s %8s     avg %8.3f ms\n", "Total", "", total);
+		out += line;
+		return out;
+	}
+	
+	bool dumpReport(std::string const &filePath)
+	{
+		FILE *out = openFile(filePath, "w");
+		if(!out) return false;
+		std::string const text = report();
+		writeFile(out, text.data(), text.size());
+		closeFile(out);
+		return true;
+	}
+	
+	void terminate()
+	{
+		if(!allQueries.empty()) glDeleteQueries(static_cast<GLsizei>(allQueries.size()), allQueries.data());
+		allQueries.clear();
+		freeQueries.clear();
+		for(auto &measurements : inFlight) measurements.clear();
+	}
+}
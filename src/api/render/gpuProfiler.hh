@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// GPU time spent in named scopes of a frame, measured with timestamp queries
+/// Results are read back framesInFlight frames after they're recorded, so measuring never waits on the GPU
+/// Only usable on the thread that owns the GL context
+namespace GPUProfiler
+{
+	constexpr uint32_t framesInFlight = 3;
+	
+	struct Timing
+	{
+		std::string name = "";
+		double lastMS = 0, averageMS = 0; //Average is exponentially weighted, so it follows changes within a second or so
+		uint64_t samples = 0;
+	};
+	
+	/// Disabled by default, toggling it drops any queries still in flight
+	void setEnabled(bool enabled);
+	[[nodiscard]] bool enabled();
+	
+	/// Start a frame, reading back the results of the frame framesInFlight ago, called once per frame by the renderer
+	void beginFrame();
+	
+	/// Get a pair of timestamp queries for a scope in this frame, record them around the scope's work with CommandBuffer::timestamp
+	/// A scope can be measured several times a frame, its time is the sum
+	/// \return The begin and end queries, both 0 if profiling is disabled
+	[[nodiscard]] std::pair<uint32_t, uint32_t> scope(std::string const &name);
+	
+	/// Every scope that has been measured, in the order they were first seen
+	[[nodiscard]] std::vector<Timing> timings();
+	
+	/// A scope's average time, 0 if it's never been measured
+	[[nodiscard]] double averageMS(std::string const &name);
+	
+	/// Forget every scope's history, ie before benchmarking a different configuration
+	void reset();
+	
+	/// A human readable table of every scope's time
+	[[nodiscard]] std::string report();
+	
+	/// Write the report to a file, ie after running a scene for a while to benchmark its passes
+	bool dumpReport(std::string const &filePath);
+	
+	/// Delete the query objects, before the context is destroyed
+	void terminate();
+}
+namespace GP = GPUProfiler;
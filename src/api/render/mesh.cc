@@ -1,89 +1,273 @@
 #include "mesh.hh"
+#include "glState.hh"
 
 #include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+VertexLayout VertexLayout::make(VertexFormat position, VertexFormat uv, VertexFormat normal)
+{
+	VertexLayout out{};
+	out.position = position;
+	out.uv = uv;
+	out.normal = normal;
+	out.stride = size(position);
+	out.uvOffset = out.stride;
+	out.stride += size(uv);
+	out.normalOffset = out.stride;
+	out.stride += size(normal);
+	return out;
+}
+
+uint32_t VertexLayout::size(VertexFormat format)
+{
+	switch(format)
+	{
+		case VertexFormat::Float2: return 2 * sizeof(float);
+		case VertexFormat::Float3: return 3 * sizeof(float);
+		case VertexFormat::Short2:
+		case VertexFormat::Half2:
+		case VertexFormat::UNorm16x2:
+		case VertexFormat::SNorm1010102: return 4;
+		default: return 0;
+	}
+}
+
+uint32_t VertexLayout::components(VertexFormat format)
+{
+	switch(format)
+	{
+		case VertexFormat::Float2:
+		case VertexFormat::Short2:
+		case VertexFormat::Half2:
+		case VertexFormat::UNorm16x2: return 2;
+		case VertexFormat::Float3:
+		case VertexFormat::SNorm1010102: return 3;
+		default: return 0;
+	}
+}
+
+uint16_t floatToHalf(float value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t const sign = (bits >> 16) & 0x8000;
+	uint32_t const exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if(exponent == 0xFF) return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0)); //Inf and NaN
+	int32_t const halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+	if(halfExponent >= 0x1F) return static_cast<uint16_t>(sign | 0x7C00); //Too large, becomes Inf
+	uint32_t half = 0, shift = 13;
+	if(halfExponent <= 0) //Denormal
+	{
+		if(halfExponent < -10) return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		shift = static_cast<uint32_t>(14 - halfExponent);
+		half = mantissa >> shift;
+	}
+	else half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> shift);
+	uint32_t const remainder = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+	if(remainder > halfway || (remainder == halfway && (half & 1))) half++; //Round to nearest even, a carry into the exponent is still correct
+	return static_cast<uint16_t>(sign | half);
+}
+
+float halfToFloat(uint16_t half)
+{
+	uint32_t const sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t const exponent = (half >> 10) & 0x1F;
+	uint32_t const mantissa = half & 0x3FF;
+	if(exponent == 0)
+	{
+		float const out = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign != 0 ? -out : out;
+	}
+	uint32_t const bits = exponent == 0x1F ? sign | 0x7F800000 | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+	float out = 0;
+	memcpy(&out, &bits, sizeof(out));
+	return out;
+}
+
+void VertexLayout::encode(VertexFormat format, float const *in, uint8_t *out)
+{
+	switch(format)
+	{
+		case VertexFormat::Float2:
+		case VertexFormat::Float3:
+			memcpy(out, in, size(format));
+			break;
+		case VertexFormat::Short2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				int16_t const value = static_cast<int16_t>(std::clamp(std::round(in[i]), -32768.0f, 32767.0f));
+				memcpy(out + i * 2, &value, 2);
+			}
+			break;
+		case VertexFormat::Half2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				uint16_t const value = floatToHalf(in[i]);
+				memcpy(out + i * 2, &value, 2);
+			}
+			break;
+		case VertexFormat::UNorm16x2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				uint16_t const value = static_cast<uint16_t>(std::round(std::clamp(in[i], 0.0f, 1.0f) * 65535.0f));
+				memcpy(out + i * 2, &value, 2);
+			}
+			break;
+		case VertexFormat::SNorm1010102:
+		{
+			uint32_t packed = 0;
+			for(size_t i = 0; i < 3; i++)
+			{
+				int32_t const value = static_cast<int32_t>(std::round(std::clamp(in[i], -1.0f, 1.0f) * 511.0f));
+				packed |= (static_cast<uint32_t>(value) & 0x3FF) << (i * 10);
+			}
+			memcpy(out, &packed, 4);
+			break;
+		}
+		default: break;
+	}
+}
+
+void VertexLayout::decode(VertexFormat format, uint8_t const *in, float *out)
+{
+	switch(format)
+	{
+		case VertexFormat::Float2:
+		case VertexFormat::Float3:
+			memcpy(out, in, size(format));
+			break;
+		case VertexFormat::Short2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				int16_t value = 0;
+				memcpy(&value, in + i * 2, 2);
+				out[i] = static_cast<float>(value);
+			}
+			break;
+		case VertexFormat::Half2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				uint16_t value = 0;
+				memcpy(&value, in + i * 2, 2);
+				out[i] = halfToFloat(value);
+			}
+			break;
+		case VertexFormat::UNorm16x2:
+			for(size_t i = 0; i < 2; i++)
+			{
+				uint16_t value = 0;
+				memcpy(&value, in + i * 2, 2);
+				out[i] = static_cast<float>(value) / 65535.0f;
+			}
+			break;
+		case VertexFormat::SNorm1010102:
+		{
+			uint32_t packed = 0;
+			memcpy(&packed, in, 4);
+			for(size_t i = 0; i < 3; i++)
+			{
+				int32_t value = static_cast<int32_t>((packed >> (i * 10)) & 0x3FF);
+				if(value & 0x200) value -= 0x400; //Sign extend
+				out[i] = std::max(static_cast<float>(value) / 511.0f, -1.0f);
+			}
+			break;
+		}
+		default: break;
+	}
+}
+
+void setAttribFormat(uint32_t vao, uint32_t location, VertexFormat format, uint32_t offset)
+{
+	if(format == VertexFormat::None) return;
+	glEnableVertexArrayAttrib(vao, location);
+	glVertexArrayAttribBinding(vao, location, 0);
+	switch(format)
+	{
+		case VertexFormat::Float2: glVertexArrayAttribFormat(vao, location, 2, GL_FLOAT, GL_FALSE, offset); break;
+		case VertexFormat::Float3: glVertexArrayAttribFormat(vao, location, 3, GL_FLOAT, GL_FALSE, offset); break;
+		case VertexFormat::Short2: glVertexArrayAttribFormat(vao, location, 2, GL_SHORT, GL_FALSE, offset); break;
+		case VertexFormat::Half2: glVertexArrayAttribFormat(vao, location, 2, GL_HALF_FLOAT, GL_FALSE, offset); break;
+		case VertexFormat::UNorm16x2: glVertexArrayAttribFormat(vao, location, 2, GL_UNSIGNED_SHORT, GL_TRUE, offset); break;
+		case VertexFormat::SNorm1010102: glVertexArrayAttribFormat(vao, location, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offset); break;
+		default: break;
+	}
+}
 
 Mesh::~Mesh()
 {
 	glDeleteBuffers(1, &this->vboV);
-	glDeleteBuffers(1, &this->vboU);
-	glDeleteBuffers(1, &this->vboN);
 	glDeleteBuffers(1, &this->vboI);
+	GS::forgetVertexArray(this->vao);
 	glDeleteVertexArrays(1, &this->vao);
 }
 
-Mesh::Mesh(float const *verts, size_t vertsSize)
+Mesh::Mesh(float const *verts, size_t vertsSize) : Mesh(interleave(verts, vertsSize, nullptr, 0, nullptr, 0)) {}
+Mesh::Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize) : Mesh(interleave(verts, vertsSize, uvs, uvsSize, nullptr, 0)) {}
+Mesh::Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize, float const *normals, size_t normalsSize) : Mesh(interleave(verts, vertsSize, uvs, uvsSize, normals, normalsSize)) {}
+Mesh::Mesh(Interleaved const &interleaved) : Mesh(interleaved.records.data(), interleaved.numVerts, interleaved.layout) {}
+
+Mesh::Interleaved Mesh::interleave(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize, float const *normals, size_t normalsSize)
 {
-	if(vertsSize != 0)
+	Interleaved out{};
+	out.numVerts = vertsSize / 3;
+	out.layout = VertexLayout::make(VertexFormat::Float3, uvsSize != 0 ? VertexFormat::Float2 : VertexFormat::None, normalsSize != 0 ? VertexFormat::Float3 : VertexFormat::None);
+	out.records.resize(out.numVerts * out.layout.stride);
+	for(size_t v = 0; v < out.numVerts; v++)
 	{
-		this->hasVerts = true;
-		this->numVerts = vertsSize / 3;
+		uint8_t *record = out.records.data() + v * out.layout.stride;
+		memcpy(record, verts + v * 3, 3 * sizeof(float));
+		if(v * 2 + 2 <= uvsSize) memcpy(record + out.layout.uvOffset, uvs + v * 2, 2 * sizeof(float));
+		if(v * 3 + 3 <= normalsSize) memcpy(record + out.layout.normalOffset, normals + v * 3, 3 * sizeof(float));
 	}
-	glCreateVertexArrays(1, &this->vao);
-	glCreateBuffers(1, &this->vboV);
-	
-	glNamedBufferData(this->vboV, vertsSize * sizeof(float), verts, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 0, 0);
-	glVertexArrayVertexBuffer(this->vao, 0, this->vboV, 0, this->vertexStride);
-	glEnableVertexArrayAttrib(this->vao, 0);
-	glVertexArrayAttribFormat(this->vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	return out;
 }
 
-Mesh::Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize)
+Mesh::Mesh(void const *vertices, size_t numVerts, VertexLayout const &layout, void const *indices, size_t numIndices, uint8_t indexSize)
 {
-	if(vertsSize != 0)
+	this->hasVerts = numVerts != 0;
+	this->hasUVs = layout.uv != VertexFormat::None;
+	this->hasNormals = layout.normal != VertexFormat::None;
+	this->numVerts = numVerts;
+	this->layout = layout;
+	size_t const vertexBytes = numVerts * layout.stride;
+	size_t const indexBytes = indices ? numIndices * indexSize : 0;
+	size_t const alignedVertexBytes = (vertexBytes + 3) & ~static_cast<size_t>(3);
+	if(indexBytes != 0)
 	{
-		this->hasVerts = true;
-		this->numVerts = vertsSize / 3;
+		this->numIndices = numIndices;
+		this->indexSize = indexSize;
 	}
-	if(uvsSize != 0) this->hasUVs = true;
+	
 	glCreateVertexArrays(1, &this->vao);
 	glCreateBuffers(1, &this->vboV);
-	glCreateBuffers(1, &this->vboU);
-	
-	glNamedBufferData(this->vboV, vertsSize * sizeof(float), verts, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 0, 0);
-	glVertexArrayVertexBuffer(this->vao, 0, this->vboV, 0, this->vertexStride);
-	glEnableVertexArrayAttrib(this->vao, 0);
-	glVertexArrayAttribFormat(this->vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
-	
-	glNamedBufferData(this->vboU, uvsSize * sizeof(float), uvs, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 1, 1);
-	glVertexArrayVertexBuffer(this->vao, 1, this->vboU, 0, this->uvStride);
-	glEnableVertexArrayAttrib(this->vao, 1);
-	glVertexArrayAttribFormat(this->vao, 1, 2, GL_FLOAT, GL_FALSE, 0);
-}
-
-Mesh::Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize, float const *normals, size_t normalsSize)
-{
-	if(vertsSize != 0)
+	if(indexBytes != 0 && indices == static_cast<uint8_t const*>(vertices) + alignedVertexBytes)
 	{
-		this->hasVerts = true;
-		this->numVerts = vertsSize / 3;
+		//Already laid out exactly as the buffer should be, ie straight from a mesh file, so the buffer doubles as the element buffer
+		this->indexOffset = alignedVertexBytes;
+		glNamedBufferStorage(this->vboV, static_cast<GLsizeiptr>(alignedVertexBytes + indexBytes), vertices, 0);
+		glVertexArrayElementBuffer(this->vao, this->vboV);
+		this->memory = MB::Allocation(MB::Category::Meshes, alignedVertexBytes + indexBytes);
+	}
+	else
+	{
+		if(vertexBytes != 0) glNamedBufferStorage(this->vboV, static_cast<GLsizeiptr>(vertexBytes), vertices, 0); //Empty storage is an error
+		if(indexBytes != 0)
+		{
+			glCreateBuffers(1, &this->vboI);
+			glNamedBufferStorage(this->vboI, static_cast<GLsizeiptr>(indexBytes), indices, 0);
+			glVertexArrayElementBuffer(this->vao, this->vboI);
+		}
+		this->memory = MB::Allocation(MB::Category::Meshes, vertexBytes + indexBytes);
 	}
-	if(uvsSize != 0) this->hasUVs = true;
-	if(normalsSize != 0) this->hasNormals = true;
-	glCreateVertexArrays(1, &this->vao);
-	glCreateBuffers(1, &this->vboV);
-	glCreateBuffers(1, &this->vboU);
-	glCreateBuffers(1, &this->vboN);
-	
-	glNamedBufferData(this->vboV, vertsSize * sizeof(float), verts, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 0, 0);
-	glVertexArrayVertexBuffer(this->vao, 0, this->vboV, 0, this->vertexStride);
-	glEnableVertexArrayAttrib(this->vao, 0);
-	glVertexArrayAttribFormat(this->vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
-	
-	glNamedBufferData(this->vboU, uvsSize * sizeof(float), uvs, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 1, 1);
-	glVertexArrayVertexBuffer(this->vao, 1, this->vboU, 0, this->uvStride);
-	glEnableVertexArrayAttrib(this->vao, 1);
-	glVertexArrayAttribFormat(this->vao, 1, 2, GL_FLOAT, GL_FALSE, 0);
 	
-	glNamedBufferData(this->vboN, normalsSize * sizeof(float), normals, GL_STATIC_DRAW);
-	glVertexArrayAttribBinding(this->vao, 2, 2);
-	glVertexArrayVertexBuffer(this->vao, 2, this->vboN, 0, this->normalStride);
-	glEnableVertexArrayAttrib(this->vao, 2);
-	glVertexArrayAttribFormat(this->vao, 2, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayVertexBuffer(this->vao, 0, this->vboV, 0, static_cast<int32_t>(layout.stride));
+	setAttribFormat(this->vao, 0, layout.position, 0);
+	setAttribFormat(this->vao, 1, layout.uv, layout.uvOffset);
+	setAttribFormat(this->vao, 2, layout.normal, layout.normalOffset);
 }
 
 Mesh::Mesh(std::vector<float> const &verts) : Mesh(verts.data(), verts.size()) {}
@@ -108,18 +292,18 @@ Mesh::Mesh(Mesh &other)
 	this->vboV = other.vboV;
 	other.vboV = 0;
 	
-	this->vboU = other.vboU;
-	other.vboU = 0;
-	
-	this->vboN = other.vboN;
-	other.vboN = 0;
-	
 	this->vboI = other.vboI;
 	other.vboI = 0;
 	
 	this->numVerts = other.numVerts;
 	other.numVerts = 0;
 	
+	this->numIndices = other.numIndices;
+	other.numIndices = 0;
+	this->indexOffset = other.indexOffset;
+	this->indexSize = other.indexSize;
+	this->layout = other.layout;
+	
 	this->hasVerts = other.hasVerts;
 	other.hasVerts = false;
 	
@@ -128,6 +312,8 @@ Mesh::Mesh(Mesh &other)
 	
 	this->hasNormals = other.hasNormals;
 	other.hasNormals = false;
+	
+	this->memory = std::move(other.memory);
 }
 
 Mesh& Mesh::operator=(Mesh other)
@@ -138,18 +324,18 @@ Mesh& Mesh::operator=(Mesh other)
 	this->vboV = other.vboV;
 	other.vboV = 0;
 	
-	this->vboU = other.vboU;
-	other.vboU = 0;
-	
-	this->vboN = other.vboN;
-	other.vboN = 0;
-	
 	this->vboI = other.vboI;
 	other.vboI = 0;
 	
 	this->numVerts = other.numVerts;
 	other.numVerts = 0;
 	
+	this->numIndices = other.numIndices;
+	other.numIndices = 0;
+	this->indexOffset = other.indexOffset;
+	this->indexSize = other.indexSize;
+	this->layout = other.layout;
+	
 	this->hasVerts = other.hasVerts;
 	other.hasVerts = false;
 	
@@ -158,6 +344,8 @@ Mesh& Mesh::operator=(Mesh other)
 	
 	this->hasNormals = other.hasNormals;
 	other.hasNormals = false;
+	
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
@@ -169,18 +357,18 @@ Mesh::Mesh(Mesh &&other)
 	this->vboV = other.vboV;
 	other.vboV = 0;
 	
-	this->vboU = other.vboU;
-	other.vboU = 0;
-	
-	this->vboN = other.vboN;
-	other.vboN = 0;
-	
 	this->vboI = other.vboI;
 	other.vboI = 0;
 	
 	this->numVerts = other.numVerts;
 	other.numVerts = 0;
 	
+	this->numIndices = other.numIndices;
+	other.numIndices = 0;
+	this->indexOffset = other.indexOffset;
+	this->indexSize = other.indexSize;
+	this->layout = other.layout;
+	
 	this->hasVerts = other.hasVerts;
 	other.hasVerts = false;
 	
@@ -189,6 +377,8 @@ Mesh::Mesh(Mesh &&other)
 	
 	this->hasNormals = other.hasNormals;
 	other.hasNormals = false;
+	
+	this->memory = std::move(other.memory);
 }
 
 Mesh& Mesh::operator=(Mesh &&other)
@@ -199,18 +389,18 @@ Mesh& Mesh::operator=(Mesh &&other)
 	this->vboV = other.vboV;
 	other.vboV = 0;
 	
-	this->vboU = other.vboU;
-	other.vboU = 0;
-	
-	this->vboN = other.vboN;
-	other.vboN = 0;
-	
 	this->vboI = other.vboI;
 	other.vboI = 0;
 	
 	this->numVerts = other.numVerts;
 	other.numVerts = 0;
 	
+	this->numIndices = other.numIndices;
+	other.numIndices = 0;
+	this->indexOffset = other.indexOffset;
+	this->indexSize = other.indexSize;
+	this->layout = other.layout;
+	
 	this->hasVerts = other.hasVerts;
 	other.hasVerts = false;
 	
@@ -219,10 +409,12 @@ Mesh& Mesh::operator=(Mesh &&other)
 	
 	this->hasNormals = other.hasNormals;
 	other.hasNormals = false;
+	
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
 void Mesh::use()
 {
-	glBindVertexArray(this->vao);
+	GS::bindVertexArray(this->vao);
 }
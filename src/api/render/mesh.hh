@@ -1,18 +1,53 @@
 #pragma once
 
+#include "../../memoryBudget.hh"
+
 #include <initializer_list>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <array>
 
-//TODO support index buffer
+/// Component formats for vertex attributes, these values are stored in mesh files and must not change
+/// The compact formats are all 4 bytes per attribute:
+/// Short2 is whole number 16 bit positions, ie 2D sprite and tile geometry
+/// Half2 is half float UVs, UNorm16x2 is UVs in [0, 1] at 16 bit precision
+/// SNorm1010102 is normals packed 10 bits per component, the 2 bit W is unused
+enum struct VertexFormat : uint8_t
+{
+	None = 0, Float2 = 1, Float3 = 2, Short2 = 3, Half2 = 4, UNorm16x2 = 5, SNorm1010102 = 6,
+};
+
+/// Describes how a vertex's attributes are interleaved in a single buffer
+/// Attribute locations are fixed, 0 is position, 1 is UV, 2 is normal
+struct VertexLayout
+{
+	/// Compute the offsets and stride for records laid out as position, UV, normal, each attribute 4 byte aligned
+	[[nodiscard]] static VertexLayout make(VertexFormat position, VertexFormat uv = VertexFormat::None, VertexFormat normal = VertexFormat::None);
+	
+	/// The size in bytes of one attribute of the given format
+	[[nodiscard]] static uint32_t size(VertexFormat format);
+	
+	/// How many float components one attribute of the given format encodes
+	[[nodiscard]] static uint32_t components(VertexFormat format);
+	
+	/// Convert one attribute from floats to the given format, reads components(format) floats and writes size(format) bytes
+	static void encode(VertexFormat format, float const *in, uint8_t *out);
+	
+	/// Convert one attribute in the given format back to floats, reads size(format) bytes and writes components(format) floats
+	static void decode(VertexFormat format, uint8_t const *in, float *out);
+	
+	VertexFormat position = VertexFormat::Float3, uv = VertexFormat::None, normal = VertexFormat::None;
+	uint32_t stride = 3 * sizeof(float), uvOffset = 0, normalOffset = 0;
+};
+
 struct Mesh
 {
 	Mesh() = delete;
 	
 	~Mesh();
 	
-	//Base constructors, all others should be able to delegate to these
+	//Float constructors, these are interleaved into a single buffer as Float3 positions, Float2 UVs, and Float3 normals
 	Mesh(float const *verts, size_t vertsSize);
 	Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize);
 	Mesh(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize, float const *normals, size_t normalsSize);
@@ -25,6 +60,12 @@ struct Mesh
 	Mesh(std::initializer_list<float> const &verts, std::initializer_list<float> const &uvs);
 	Mesh(std::initializer_list<float> const &verts, std::initializer_list<float> const &uvs, std::initializer_list<float> const &normals);
 	
+	/// Base constructor, all others should delegate to this
+	/// Upload interleaved vertex records, and optionally indices into an element buffer
+	/// If indices directly follow the vertices in memory (at the next 4 byte boundary), both share one buffer uploaded in one call
+	/// \param indexSize 2 or 4 bytes per index
+	Mesh(void const *vertices, size_t numVerts, VertexLayout const &layout, void const *indices = nullptr, size_t numIndices = 0, uint8_t indexSize = 0);
+	
 	template <size_t N> explicit Mesh(std::array<float, N> const &verts) : Mesh(verts.data(), verts.size()) {}
 	template <size_t N> Mesh(std::array<float, N> const &verts, std::array<float, N> const &uvs) : Mesh(verts.data(), verts.size(), uvs.data(), uvs.size()) {}
 	template <size_t N> Mesh(std::array<float, N> const &verts, std::array<float, N> const &uvs, std::array<float, N> const &normals) : Mesh(verts.data(), verts.size(), uvs.data(), uvs.size(), normals.data(), normals.size()) {}
@@ -51,12 +92,27 @@ struct Mesh
 	
 	void use();
 	
-	uint32_t vao = 0, vboV = 0, vboU = 0, vboN = 0, vboI = 0;
-	size_t numVerts = 0;
+	/// Whether draws should go through the element buffer
+	[[nodiscard]] inline bool indexed() const
+	{
+		return this->numIndices != 0;
+	}
+	
+	uint32_t vao = 0, vboV = 0, vboI = 0;
+	size_t numVerts = 0, numIndices = 0, indexOffset = 0; //indexOffset is the byte offset of the indices in the element buffer
+	uint8_t indexSize = 0;
 	bool hasVerts = false, hasUVs = false, hasNormals = false;
+	VertexLayout layout{};
+	MB::Allocation memory{};
 
 private:
-	int32_t vertexStride = 3 * sizeof(float);
-	int32_t uvStride = 2 * sizeof(float);
-	int32_t normalStride = 3 * sizeof(float);
+	struct Interleaved
+	{
+		std::vector<uint8_t> records;
+		VertexLayout layout{};
+		size_t numVerts = 0;
+	};
+	
+	[[nodiscard]] static Interleaved interleave(float const *verts, size_t vertsSize, float const *uvs, size_t uvsSize, float const *normals, size_t normalsSize);
+	explicit Mesh(Interleaved const &interleaved);
 };
@@ -0,0 +1,366 @@
+#include "postPasses.hh"
+#include "workGroupTuner.hh"
+#include "../../hash.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	constexpr UniformID threshold{"threshold"};
+	constexpr UniformID knee{"knee"};
+	constexpr UniformID radius{"radius"};
+	constexpr UniformID intensity{"intensity"};
+	
+	/// A chain's shape for a radius, each level down doubles how far the upsample filter reaches
+	struct ChainShape
+	{
+		uint32_t levels = 1;
+		float spread = 1.0f; //Upsample tap distance in source texels, covers the part of the radius that isn't a whole level
+	};
+	
+	ChainShape chainShape(float pixels)
+	{
+		ChainShape shape;
+		shape.levels = std::clamp<uint32_t>(static_cast<uint32_t>(std::ceil(std::log2(std::max(pixels, 2.0f)))), 1, BlurPass::maxLevels);
+		shape.spread = std::clamp(pixels / static_cast<float>(1u << (shape.levels - 1)), 1.0f, 2.0f);
+		return shape;
+	}
+	
+	/// Furthest a chain can move content, in full resolution pixels
+	/// Each level's downsample reaches 1.5 texels of the level above, and its upsample reaches spread texels of its own level
+	float chainReach(ChainShape const &shape)
+	{
+		float const top = static_cast<float>(1u << shape.levels);
+		return 1.5f * (top - 1.0f) + shape.spread * (2.0f * top - 2.0f);
+	}
+	
+	/// Cover target with the shader's work groups, whatever local size it was built or tuned with
+	void dispatchOver(RenderGraph::PassContext const &context, Shader const &shader, RenderGraph::ResourceID target)
+	{
+		RenderGraph::Resource const &resource = context.resource(target);
+		auto const [x, y, z] = shader.groupsFor(resource.width, resource.height);
+		context.commands.dispatch(x, y, z);
+	}
+	
+	std::unordered_map<uint64_t, uint64_t> pixelKernels; //Generated source hash to shader ID
+	
+	/// A generated kernel and everything its graph pass needs each frame, so nothing is built from strings after the first frame
+	struct FusedKernel
+	{
+		std::string src;
+		uint64_t srcHash = 0;
+		std::vector<std::vector<UniformID>> uniforms; //Each stage's prefixed uniform IDs
+	};
+	std::unordered_map<uint64_t, FusedKernel> fusedKernels; //Chain key to kernel, node based so graph passes can hold on to entries
+	
+	/// Identify a chain by what its passes would generate, a pass whose source changes gets a new kernel and chains of the same kinds of passes share one
+	uint64_t chainKey(std::vector<PixelPass const*> const &passes)
+	{
+		std::vector<uint64_t> parts;
+		parts.reserve(passes.size() * 2);
+		for(PixelPass const *pass : passes)
+		{
+			parts.push_back(typeid(*pass).hash_code());
+			parts.push_back(pass->variantKey());
+		}
+		return xxHash64(parts.data(), parts.size() * sizeof(uint64_t));
+	}
+	
+	/// The GLSL around a chain of pixel passes, each stage is applied to the texel in turn
+	/// Work groups are sized with LOCAL_SIZE_X and LOCAL_SIZE_Y so the kernel can be tuned like the shader families
+	std::string generateKernel(std::vector<PixelPass const*> const &passes)
+	{
+		std::string src = "#version 450\n\n"
+				"#ifndef LOCAL_SIZE_X\n"
+				"#define LOCAL_SIZE_X 8\n"
+				"#endif\n"
+				"#ifndef LOCAL_SIZE_Y\n"
+				"#define LOCAL_SIZE_Y 8\n"
+				"#endif\n\n"
+				"layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;\n"
+				"layout(binding = 0) uniform sampler2D source;\n"
+				"layout(binding = 0) uniform writeonly image2D imageOut;\n\n";
+		for(size_t i = 0; i < passes.size(); i++) src += passes[i]->source("stage" + std::to_string(i), "s" + std::to_string(i) + "_") + "\n";
+		src += "void main()\n"
+				"{\n"
+				"	ivec2 current = ivec2(gl_GlobalInvocationID.xy);\n"
+				"	ivec2 size = imageSize(imageOut);\n"
+				"	if(current.x >= size.x || current.y >= size.y) return;\n"
+				"	vec4 color = texelFetch(source, current, 0);\n";
+		for(size_t i = 0; i < passes.size(); i++) src += "	color = stage" + std::to_string(i) + "(color, current, vec2(size));\n";
+		src += "	imageStore(imageOut, current, color);\n"
+				"}\n";
+		return src;
+	}
+	
+	/// Halve input once per level
+	/// \param prefilter Whether the first level keeps only what's above the threshold
+	/// \return Each level, largest first
+	std::vector<RenderGraph::ResourceID> addDownsamples(RenderGraph &graph, std::string const &name, RenderGraph::ResourceID input, uint32_t levels, bool highQuality, bool prefilter, float cutoff, float softness)
+	{
+		std::vector<RenderGraph::ResourceID> chain;
+		RenderGraph::ResourceID source = input;
+		for(uint32_t level = 1; level <= levels; level++)
+		{
+			bool const filtered = prefilter && level == 1;
+			RenderGraph::ResourceID const target = graph.createResource(name + " mip " + std::to_string(level), CF::RGBA16F, 1.0f / static_cast<float>(1u << level));
+			graph.addPass(name + " down " + std::to_string(level), RenderGraph::PassKind::Compute, {source}, {target}, [=](RenderGraph::PassContext const &context)
+			{
+				UP<Shader> &shader = AR::getShader(AR::getShaderVariant(AR::shaderFamilyMipDown, AR::mipDownVariant(highQuality, filtered)));
+				if(!shader) return;
+				context.commands.bindPipeline(shader.get());
+				context.commands.bindTexture(0, context.texture(source));
+				context.commands.bindImage(0, context.texture(target), IO::WRITE, context.resource(target).format);
+				if(filtered)
+				{
+					context.commands.setFloat(threshold, cutoff);
+					context.commands.setFloat(knee, softness);
+				}
+				dispatchOver(context, *shader, target);
+			});
+			chain.push_back(target);
+			source = target;
+		}
+		return chain;
+	}
+	
+	/// Double source into target
+	/// \param base Image the upsample is added onto when accumulating, the same size as target
+	void addUpsample(RenderGraph &graph, std::string const &passName, RenderGraph::ResourceID source, RenderGraph::ResourceID base, RenderGraph::ResourceID target, bool highQuality, float spread, float strength)
+	{
+		bool const accumulate = base != RenderGraph::noResource;
+		std::vector<RenderGraph::ResourceID> reads{source};
+		if(accumulate) reads.push_back(base);
+		graph.addPass(passName, RenderGraph::PassKind::Compute, std::move(reads), {target}, [=](RenderGraph::PassContext const &context)
+		{
+			UP<Shader> &shader = AR::getShader(AR::getShaderVariant(AR::shaderFamilyMipUp, AR::mipUpVariant(highQuality, accumulate)));
+			if(!shader) return;
+			context.commands.bindPipeline(shader.get());
+			context.commands.bindTexture(0, context.texture(source));
+			if(accumulate) context.commands.bindTexture(1, context.texture(base));
+			context.commands.bindImage(0, context.texture(target), IO::WRITE, context.resource(target).format);
+			context.commands.setFloat(radius, spread);
+			context.commands.setFloat(intensity, strength);
+			dispatchOver(context, *shader, target);
+		});
+	}
+}
+
+BlurPass::BlurPass()
+{
+	this->name = "Blur";
+}
+
+RenderGraph::ResourceID BlurPass::addTo(RenderGraph &graph, RenderGraph::ResourceID input)
+{
+	ChainShape const shape = chainShape(this->radius);
+	bool const highQuality = this->quality == FilterQuality::High;
+	std::vector<RenderGraph::ResourceID> chain = addDownsamples(graph, this->name, input, shape.levels, highQuality, false, 0, 0);
+	
+	//Upsampled levels replace each other on the way back up, nothing is added so the image's energy is kept
+	RenderGraph::ResourceID current = chain.back();
+	for(uint32_t level = shape.levels - 1; level >= 1; level--)
+	{
+		RenderGraph::ResourceID const target = graph.createResource(this->name + " up " + std::to_string(level), CF::RGBA16F, 1.0f / static_cast<float>(1u << level));
+		addUpsample(graph, this->name + " up " + std::to_string(level), current, RenderGraph::noResource, target, highQuality, shape.spread, 1.0f);
+		current = target;
+	}
+	RenderGraph::ResourceID const output = graph.createResource(this->name, graph.getResource(input).format);
+	addUpsample(graph, this->name + " up 0", current, RenderGraph::noResource, output, highQuality, shape.spread, 1.0f);
+	return output;
+}
+
+float BlurPass::reach() const
+{
+	return chainReach(chainShape(this->radius));
+}
+
+BloomPass::BloomPass()
+{
+	this->name = "Bloom";
+}
+
+RenderGraph::ResourceID BloomPass::addTo(RenderGraph &graph, RenderGraph::ResourceID input)
+{
+	ChainShape const shape = chainShape(this->radius);
+	bool const highQuality = this->quality == FilterQuality::High;
+	std::vector<RenderGraph::ResourceID> chain = addDownsamples(graph, this->name, input, shape.levels, highQuality, true, this->threshold, this->knee);
+	
+	//Each level on the way up is its downsample plus everything below it, so wide and tight glows both survive to the top
+	RenderGraph::ResourceID current = chain.back();
+	for(uint32_t level = shape.levels - 1; level >= 1; level--)
+	{
+		RenderGraph::ResourceID const target = graph.createResource(this->name + " up " + std::to_string(level), CF::RGBA16F, 1.0f / static_cast<float>(1u << level));
+		addUpsample(graph, this->name + " up " + std::to_string(level), current, chain[level - 1], target, highQuality, shape.spread, 1.0f);
+		current = target;
+	}
+	RenderGraph::ResourceID const output = graph.createResource(this->name, graph.getResource(input).format);
+	addUpsample(graph, this->name + " composite", current, input, output, highQuality, shape.spread, this->intensity);
+	return output;
+}
+
+float BloomPass::reach() const
+{
+	return chainReach(chainShape(this->radius));
+}
+
+RenderGraph::ResourceID PixelPass::addTo(RenderGraph &graph, RenderGraph::ResourceID input)
+{
+	return addFused(graph, input, {this});
+}
+
+RenderGraph::ResourceID PixelPass::addFused(RenderGraph &graph, RenderGraph::ResourceID input, std::vector<PixelPass const*> const &passes)
+{
+	if(passes.empty()) return input;
+	std::string passName = passes.size() > 1 ? "Fused " : "";
+	for(size_t i = 0; i < passes.size(); i++) passName += (i == 0 ? "" : " + ") + passes[i]->name;
+	RenderGraph::ResourceID const output = graph.createResource(passName, graph.getResource(input).format);
+	auto [it, generated] = fusedKernels.try_emplace(chainKey(passes));
+	FusedKernel *kernel = &it->second;
+	if(generated)
+	{
+		kernel->src = generateKernel(passes);
+		kernel->srcHash = xxHash64(kernel->src.data(), kernel->src.size());
+		for(size_t i = 0; i < passes.size(); i++)
+		{
+			std::string const prefix = "s" + std::to_string(i) + "_";
+			std::vector<UniformID> &ids = kernel->uniforms.emplace_back();
+			for(std::string const &uniform : passes[i]->uniforms()) ids.push_back(UniformID::fromName(prefix + uniform));
+		}
+	}
+	graph.addPass(passName, RenderGraph::PassKind::Compute, {input}, {output}, [passes, input, output, kernel](RenderGraph::PassContext const &context)
+	{
+		uint64_t &shaderID = pixelKernels[kernel->srcHash];
+		if(!AR::getShader(shaderID))
+		{
+			//Built with the local size tuned for this device, when there is one, the same as a shader family's variants
+			std::vector<ShaderDefine> sized;
+			if(std::optional<WGT::Size> size = WGT::localSize(kernel->src, {}))
+			{
+				sized.push_back({"LOCAL_SIZE_X", size->x});
+				sized.push_back({"LOCAL_SIZE_Y", size->y});
+			}
+			shaderID = AR::newShaderSrc(Shader::applyDefines(kernel->src, sized));
+		}
+		UP<Shader> &shader = AR::getShader(shaderID);
+		if(!shader || !shader->linked) return;
+		context.commands.bindPipeline(shader.get());
+		context.commands.bindTexture(0, context.texture(input));
+		context.commands.bindImage(0, context.texture(output), IO::WRITE, context.resource(output).format);
+		for(size_t i = 0; i < passes.size(); i++) passes[i]->setUniforms(context.commands, kernel->uniforms[i]);
+		dispatchOver(context, *shader, output);
+	});
+	return output;
+}
+
+TonemapPass::TonemapPass()
+{
+	this->name = "Tonemap";
+}
+
+std::string TonemapPass::source(std::string const &function, std::string const &prefix) const
+{
+	std::string src = "uniform float " + prefix + "gamma;\n\n"
+			"vec4 " + function + "(vec4 color, ivec2 pixel, vec2 size)\n"
+			"{\n"
+			"	vec3 c = color.rgb;\n";
+	switch(this->tonemapper)
+	{
+		case AR::Tonemapper::ACES:
+			src += "	c = clamp((c * (2.51f * c + 0.03f)) / (c * (2.43f * c + 0.59f) + 0.14f), 0.0f, 1.0f);\n";
+			break;
+		case AR::Tonemapper::Filmic:
+			src += "	c = max(vec3(0.0f), c - vec3(0.004f));\n"
+					"	c = (c * (6.2f * c + 0.5f)) / (c * (6.2f * c + 1.7f) + 0.06f);\n";
+			break;
+		case AR::Tonemapper::SRGB:
+			src += "	c = pow(c, vec3(1.0f / " + prefix + "gamma));\n";
+			break;
+		case AR::Tonemapper::Uncharted2:
+			src += "	const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f, W = 11.2f;\n"
+					"	c *= 2.0f;\n"
+					"	c = ((c * (A * c + C * B) + D * E) / (c * (A * c + B) + D * F)) - E / F;\n"
+					"	c /= ((W * (A * W + C * B) + D * E) / (W * (A * W + B) + D * F)) - E / F;\n"
+					"	c = pow(c, vec3(1.0f / " + prefix + "gamma));\n";
+			break;
+	}
+	src += "	return vec4(c, color.a);\n"
+			"}\n";
+	return src;
+}
+
+uint64_t TonemapPass::variantKey() const
+{
+	return static_cast<uint64_t>(this->tonemapper);
+}
+
+std::vector<std::string> TonemapPass::uniforms() const
+{
+	return {"gamma"};
+}
+
+void TonemapPass::setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const
+{
+	if(this->tonemapper == AR::Tonemapper::SRGB || this->tonemapper == AR::Tonemapper::Uncharted2) commands.setFloat(ids[0], this->gamma);
+}
+
+VignettePass::VignettePass()
+{
+	this->name = "Vignette";
+}
+
+std::string VignettePass::source(std::string const &function, std::string const &prefix) const
+{
+	return "uniform vec3 " + prefix + "vignette; //Outer radius, inner radius, opacity\n\n"
+			"vec4 " + function + "(vec4 color, ivec2 pixel, vec2 size)\n"
+			"{\n"
+			"	float mask = smoothstep(" + prefix + "vignette.x, " + prefix + "vignette.y, distance(vec2(pixel) / size, vec2(0.5f)));\n"
+			"	return mix(color, color * vec4(mask), " + prefix + "vignette.z);\n"
+			"}\n";
+}
+
+std::vector<std::string> VignettePass::uniforms() const
+{
+	return {"vignette"};
+}
+
+void VignettePass::setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const
+{
+	float const vignette[3] = {this->outerRadius, this->innerRadius, this->opacity};
+	commands.setUniform(ids[0], UniformType::Vec3f, vignette);
+}
+
+DitherPass::DitherPass()
+{
+	this->name = "Dither";
+}
+
+std::string DitherPass::source(std::string const &function, std::string const &prefix) const
+{
+	return "uniform float " + prefix + "strength;\n\n"
+			"float " + prefix + "rand(vec2 co)\n"
+			"{\n"
+			"	return fract(sin(mod(dot(co, vec2(12.9898f, 78.233f)), 3.14f)) * 43758.5453f);\n"
+			"}\n\n"
+			"vec4 " + function + "(vec4 color, ivec2 pixel, vec2 size)\n"
+			"{\n"
+			"	float luma = dot(color.rgb, vec3(0.299f, 0.587f, 0.114f));\n"
+			"	vec3 noise = vec3(" + prefix + "rand(vec2(pixel)) * (0.05f * " + prefix + "strength));\n"
+			"	return vec4(color.rgb + noise * clamp(-8.0f * pow(luma - 0.35f, 2.0f) + 1.0f, 0.0f, 1.0f), color.a);\n"
+			"}\n";
+}
+
+std::vector<std::string> DitherPass::uniforms() const
+{
+	return {"strength"};
+}
+
+void DitherPass::setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const
+{
+	commands.setFloat(ids[0], this->strength);
+}
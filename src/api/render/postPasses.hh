@@ -0,0 +1,112 @@
+#pragma once
+
+#include "renderPass.hh"
+#include "../../def.hh"
+#include "../../assets.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Filters used by the mip chain passes, High costs about twice as many taps and holds up better on small bright details
+enum struct FilterQuality : uint8_t
+{
+	Low, High,
+};
+
+/// A wide gaussian-like blur, built from a chain of half resolution downsamples followed by upsamples back to full resolution
+/// Each level is a quarter the size of the one above it, so the whole chain costs about as much as one full resolution pass whatever the radius
+struct BlurPass : RenderPass
+{
+	static constexpr uint32_t maxLevels = 8;
+	
+	BlurPass();
+	
+	RenderGraph::ResourceID addTo(RenderGraph &graph, RenderGraph::ResourceID input) override;
+	[[nodiscard]] float reach() const override;
+	
+	float radius = 16.0f; //Roughly how far in pixels the blur spreads, the chain goes down one level per doubling
+	FilterQuality quality = FilterQuality::Low;
+};
+
+/// Bloom over the mip chain, bright parts of the image are kept, blurred at every level, and the levels are added back up and onto the image
+struct BloomPass : RenderPass
+{
+	BloomPass();
+	
+	RenderGraph::ResourceID addTo(RenderGraph &graph, RenderGraph::ResourceID input) override;
+	[[nodiscard]] float reach() const override;
+	
+	float threshold = 1.0f; //Brightness, in the image's linear units, above which pixels bloom
+	float knee = 0.5f; //Width of the soft transition around the threshold, 0 for a hard cut off
+	float intensity = 0.1f; //How strongly the bloom is added onto the image
+	float radius = 64.0f; //Roughly how far in pixels the glow spreads
+	FilterQuality quality = FilterQuality::Low;
+};
+
+/// A pass whose output pixel only depends on the same pixel of its input
+/// The post stacks fuse consecutive pixel passes into one generated kernel, so the chain reads and writes the image once rather than once per pass
+struct PixelPass : RenderPass
+{
+	/// GLSL for the pass, which must define vec4 function(vec4 color, ivec2 pixel, vec2 size)
+	/// \param prefix Prepended to the pass's uniforms and helpers, so passes fused into one kernel don't collide
+	[[nodiscard]] virtual std::string source(std::string const &function, std::string const &prefix) const = 0;
+	
+	/// Anything other than the prefix that changes what source returns, so kernels are only generated again when it changes
+	[[nodiscard]] virtual uint64_t variantKey() const
+	{
+		return 0;
+	}
+	
+	/// Names of the uniforms source declares, without the prefix, in the order setUniforms is given their IDs
+	[[nodiscard]] virtual std::vector<std::string> uniforms() const = 0;
+	
+	/// Record the pass's uniforms
+	/// \param ids The prefixed ID of each of uniforms(), worked out once when the kernel is generated
+	virtual void setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const = 0;
+	
+	/// Run the pass on its own, as a kernel with a single stage
+	RenderGraph::ResourceID addTo(RenderGraph &graph, RenderGraph::ResourceID input) override;
+	
+	/// Run passes, in order, as one kernel, the passes must outlive the graph's execution
+	/// Kernels are generated and compiled the first time a combination is used, then cached
+	static RenderGraph::ResourceID addFused(RenderGraph &graph, RenderGraph::ResourceID input, std::vector<PixelPass const*> const &passes);
+};
+
+struct TonemapPass : PixelPass
+{
+	TonemapPass();
+	
+	[[nodiscard]] std::string source(std::string const &function, std::string const &prefix) const override;
+	[[nodiscard]] uint64_t variantKey() const override;
+	[[nodiscard]] std::vector<std::string> uniforms() const override;
+	void setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const override;
+	
+	AR::Tonemapper tonemapper = AR::Tonemapper::ACES;
+	float gamma = 2.2f; //Only used by SRGB and Uncharted2
+};
+
+/// Darkens the image towards its edges
+struct VignettePass : PixelPass
+{
+	VignettePass();
+	
+	[[nodiscard]] std::string source(std::string const &function, std::string const &prefix) const override;
+	[[nodiscard]] std::vector<std::string> uniforms() const override;
+	void setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const override;
+	
+	float outerRadius = 0.75f, innerRadius = 0.25f; //Distances from the center, where the edge of the screen is 0.5
+	float opacity = 0.5f;
+};
+
+/// Adds noise to mid tones to break up banding
+struct DitherPass : PixelPass
+{
+	DitherPass();
+	
+	[[nodiscard]] std::string source(std::string const &function, std::string const &prefix) const override;
+	[[nodiscard]] std::vector<std::string> uniforms() const override;
+	void setUniforms(CommandBuffer &commands, std::vector<UniformID> const &ids) const override;
+	
+	float strength = 1.0f;
+};
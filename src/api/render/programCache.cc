@@ -0,0 +1,174 @@
+#include "programCache.hh"
+#include "../../hash.hh"
+#include "../../global.hh"
+
+#include <glad/glad.h>
+#include <commons/fileio.hh>
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#include <cstdio>
+
+namespace ProgramCache
+{
+	constexpr char const magic[] = {'P', 'B', 'C'};
+	constexpr size_t headerSize = sizeof(magic) + sizeof(uint32_t) + sizeof(uint64_t);
+	
+	std::string dir;
+	std::vector<int32_t> formats; //Binary formats the driver accepts
+	uint64_t driverHash = 0;
+	bool available = false, parallel = false;
+	size_t hitCount = 0, missCount = 0;
+	
+	std::string pathFor(uint64_t key)
+	{
+		char name[24];
+		snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return (std::filesystem::path{dir} / name).string();
+	}
+	
+	void init(std::string const &directory)
+	{
+		dir = directory;
+		hitCount = missCount = 0;
+		
+		//A binary is only valid for the exact driver that produced it
+		std::string driver;
+		for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+		{
+			char const *value = reinterpret_cast<char const*>(glGetString(name));
+			driver += value ? value : "";
+			driver += '\n';
+		}
+		driverHash = xxHash64(driver);
+		
+		int32_t numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		available = numFormats > 0;
+		formats.assign(std::max(numFormats, 0), 0);
+		if(available) glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+		if(available)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(dir, ec);
+			if(ec)
+			{
+				logger << Sev::ERR << "Failed to create the shader cache directory " << dir << ": " << ec.message() << logger.endl();
+				available = false;
+			}
+		}
+		
+		parallel = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+		if(GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if(GLAD_GL_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+	}
+	
+	bool enabled()
+	{
+		return available;
+	}
+	
+	bool parallelCompile()
+	{
+		return parallel;
+	}
+	
+	uint64_t key(std::vector<std::string const*> const &sources)
+	{
+		uint64_t h = driverHash;
+		for(auto const *source : sources) h = xxHash64(*source, h); //Chained so the same text in a different stage gives a different key
+		return h;
+	}
+	
+	bool load(uint32_t program, uint64_t key)
+	{
+		if(!available) return false;
+		std::string path = pathFor(key);
+		std::error_code ec;
+		uintmax_t const fileSize = std::filesystem::file_size(path, ec);
+		if(ec)
+		{
+			missCount++;
+			return false;
+		}
+		FILE *in = openFile(path, "rb");
+		if(!in)
+		{
+			missCount++;
+			return false;
+		}
+		char magicIn[sizeof(magic)]{};
+		uint32_t format = 0;
+		uint64_t length = 0;
+		std::vector<uint8_t> binary;
+		bool valid = readFile(in, magicIn, sizeof(magicIn)) == sizeof(magicIn) && std::equal(magicIn, magicIn + sizeof(magic), magic);
+		valid = valid && readFile(in, &format, sizeof(format)) == sizeof(format) && readFile(in, &length, sizeof(length)) == sizeof(length);
+		
+		//The header is checked before anything is allocated from it, so a corrupt or foreign file is a miss rather than a huge allocation
+		valid = valid && fileSize >= headerSize && length == fileSize - headerSize && length <= INT32_MAX;
+		valid = valid && std::find(formats.begin(), formats.end(), static_cast<int32_t>(format)) != formats.end();
+		if(valid)
+		{
+			binary.resize(length);
+			valid = readFile(in, binary.data(), binary.size()) == binary.size();
+		}
+		closeFile(in);
+		
+		int32_t success = 0;
+		if(valid)
+		{
+			glProgramBinary(program, format, binary.data(), static_cast<int32_t>(binary.size()));
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+		}
+		if(!success)
+		{
+			//Truncated, corrupt, or the driver refused it despite the key, either way it's rebuilt and overwritten
+			std::filesystem::remove(path, ec);
+			missCount++;
+			return false;
+		}
+		hitCount++;
+		return true;
+	}
+	
+	void store(uint32_t program, uint64_t key)
+	{
+		if(!available) return;
+		int32_t length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if(length <= 0) return;
+		std::vector<uint8_t> binary(static_cast<size_t>(length));
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
+		binary.resize(static_cast<size_t>(length));
+		
+		//Written beside the entry then renamed over it, so a crash mid write never leaves a truncated entry
+		std::string path = pathFor(key), tempPath = path + ".tmp";
+		FILE *out = openFile(tempPath, "wb");
+		if(!out)
+		{
+			logger << Sev::ERR << "Failed to write shader cache entry " << tempPath << logger.endl();
+			return;
+		}
+		uint32_t const format32 = format;
+		uint64_t const length64 = binary.size();
+		writeFile(out, magic, sizeof(magic));
+		writeFile(out, &format32, sizeof(format32));
+		writeFile(out, &length64, sizeof(length64));
+		writeFile(out, binary.data(), binary.size());
+		closeFile(out);
+		std::error_code ec;
+		std::filesystem::rename(tempPath, path, ec);
+		if(ec) logger << Sev::ERR << "Failed to write shader cache entry " << path << ": " << ec.message() << logger.endl();
+	}
+	
+	size_t hits()
+	{
+		return hitCount;
+	}
+	
+	size_t misses()
+	{
+		return missCount;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// On-disk cache of linked program binaries, so shaders that were built on a previous run skip compiling and linking
+/// Binaries are keyed by their sources and the driver that produced them, a driver update invalidates every entry
+namespace ProgramCache
+{
+	/// Query the driver and prepare the cache directory, called once the GL context exists
+	/// Also lets the driver compile on as many threads as it likes if it supports parallel shader compilation
+	/// \param directory Where binaries are stored, created if it doesn't exist
+	void init(std::string const &directory);
+	
+	/// False if the driver can't save program binaries, or init hasn't been called
+	[[nodiscard]] bool enabled();
+	
+	/// True if the driver compiles and links in the background, so querying a shader's status is what waits for it
+	[[nodiscard]] bool parallelCompile();
+	
+	/// Key a program by its stages' sources and the current driver
+	[[nodiscard]] uint64_t key(std::vector<std::string const*> const &sources);
+	
+	/// Try to link a program from its cached binary
+	/// \return True if the program is linked and ready, false if there's no entry or the driver rejected it, the program must be built from source
+	bool load(uint32_t program, uint64_t key);
+	
+	/// Save a linked program's binary, it must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	void store(uint32_t program, uint64_t key);
+	
+	/// Counts since init, for judging how much of startup the cache saved
+	[[nodiscard]] size_t hits();
+	[[nodiscard]] size_t misses();
+}
+namespace PC = ProgramCache;
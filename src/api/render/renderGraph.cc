@@ -0,0 +1,269 @@
+#include "renderGraph.hh"
+#include "../../global.hh"
+
+#include <algorithm>
+#include <cmath>
+
+uint32_t RenderGraph::PassContext::texture(ResourceID id) const
+{
+	return this->graph.texture(id);
+}
+
+RenderGraph::Resource const& RenderGraph::PassContext::resource(ResourceID id) const
+{
+	return this->graph.getResource(this->graph.resolve(id));
+}
+
+size_t RenderGraph::bytesPerPixel(CF format)
+{
+	switch(format)
+	{
+		case CF::R32F: return 4;
+		case CF::RGB8: return 3;
+		case CF::RGBA8: return 4;
+		case CF::RGB16: case CF::RGB16F: return 6;
+		case CF::RGBA16: case CF::RGBA16F: return 8;
+		case CF::RGB32I: case CF::RGB32UI: case CF::RGB32F: return 12;
+		case CF::RGBA32I: case CF::RGBA32UI: case CF::RGBA32F: return 16;
+		case CF::DEPTH32F: return 4;
+	}
+	return 16;
+}
+
+RenderGraph::ResourceID RenderGraph::importResource(std::string const &name, CF format, uint32_t width, uint32_t height, uint32_t handle)
+{
+	Resource &resource = this->resources.emplace_back();
+	resource.name = name;
+	resource.format = format;
+	resource.width = width;
+	resource.height = height;
+	resource.handle = handle;
+	resource.imported = true;
+	return static_cast<ResourceID>(this->resources.size() - 1);
+}
+
+RenderGraph::ResourceID RenderGraph::createResource(std::string const &name, CF format, float scale)
+{
+	Resource &resource = this->resources.emplace_back();
+	resource.name = name;
+	resource.format = format;
+	resource.scale = scale;
+	return static_cast<ResourceID>(this->resources.size() - 1);
+}
+
+RenderGraph::PassID RenderGraph::addPass(std::string const &name, PassKind kind, std::vector<ResourceID> reads, std::vector<ResourceID> writes, Execute execute)
+{
+	Pass &pass = this->passes.emplace_back();
+	pass.name = name;
+	pass.kind = kind;
+	pass.reads = std::move(reads);
+	pass.writes = std::move(writes);
+	pass.execute = std::move(execute);
+	return static_cast<PassID>(this->passes.size() - 1);
+}
+
+void RenderGraph::setEnabled(PassID pass, bool enabled)
+{
+	this->passes[pass].enabled = enabled;
+}
+
+void RenderGraph::setSideEffects(PassID pass, bool sideEffects)
+{
+	this->passes[pass].sideEffects = sideEffects;
+}
+
+void RenderGraph::markOutput(ResourceID resource)
+{
+	this->outputs.push_back(resource);
+}
+
+void RenderGraph::compile(uint32_t width, uint32_t height)
+{
+	constexpr PassID noPass = UINT32_MAX;
+	this->groups.clear();
+	this->physical.clear();
+	this->schedule.clear();
+	this->producers.assign(this->resources.size(), noPass);
+	for(auto &resource : this->resources)
+	{
+		resource.forward = noResource;
+		resource.physical = -1;
+		resource.defined = resource.imported;
+		if(resource.imported) continue;
+		resource.width = std::max<uint32_t>(1, static_cast<uint32_t>(std::lround(width * resource.scale)));
+		resource.height = std::max<uint32_t>(1, static_cast<uint32_t>(std::lround(height * resource.scale)));
+	}
+	
+	//Forward pass in declaration order, a resource is defined once an enabled pass that could run has written it
+	std::vector<bool> defined(this->resources.size(), false);
+	for(size_t i = 0; i < this->resources.size(); i++) defined[i] = this->resources[i].imported;
+	for(PassID id = 0; id < this->passes.size(); id++)
+	{
+		Pass &pass = this->passes[id];
+		pass.culled = !pass.enabled;
+		for(ResourceID write : pass.writes)
+		{
+			if(this->producers[write] != noPass)
+			{
+				logger << Sev::ERR << "Render graph pass " << pass.name << " writes " << this->resources[write].name << " which already has a producer" << logger.endl();
+				pass.culled = true;
+			}
+		}
+		for(ResourceID read : pass.reads) if(!defined[this->resolve(read)]) pass.culled = true;
+		
+		if(!pass.enabled)
+		{
+			//A disabled pass hands what it read on to whoever reads what it would have written
+			for(size_t i = 0; i < pass.writes.size() && i < pass.reads.size(); i++) this->resources[pass.writes[i]].forward = this->resolve(pass.reads[i]);
+			for(size_t i = 0; i < pass.writes.size(); i++)
+			{
+				ResourceID const write = pass.writes[i];
+				defined[write] = this->resources[write].forward != noResource && defined[this->resources[write].forward];
+			}
+			continue;
+		}
+		if(pass.culled) continue;
+		for(ResourceID write : pass.writes)
+		{
+			this->producers[write] = id;
+			defined[write] = true;
+		}
+	}
+	
+	//Backward pass, only passes that contribute to an output or have side effects survive
+	std::vector<bool> needed(this->resources.size(), false);
+	for(ResourceID output : this->outputs) needed[this->resolve(output)] = true;
+	for(PassID id = static_cast<PassID>(this->passes.size()); id-- > 0;)
+	{
+		Pass &pass = this->passes[id];
+		if(pass.culled) continue;
+		bool contributes = pass.sideEffects;
+		for(ResourceID write : pass.writes) contributes = contributes || needed[write];
+		if(!contributes)
+		{
+			pass.culled = true;
+			continue;
+		}
+		for(ResourceID read : pass.reads) needed[this->resolve(read)] = true;
+	}
+	for(PassID id = 0; id < this->passes.size(); id++)
+	{
+		if(this->passes[id].culled) continue;
+		this->schedule.push_back(id);
+		for(ResourceID write : this->passes[id].writes) this->resources[write].defined = true;
+	}
+	for(ResourceID output : this->outputs)
+	{
+		if(this->isDefined(output)) continue;
+		logger << Sev::ERR << "Render graph output " << this->resources[output].name << " holds no image, the pass that writes it was culled or there is none" << logger.endl();
+	}
+	
+	//Transients live from the pass that writes them to the last pass that reads them, outputs live to the end of the graph
+	std::vector<ResourceID> transients;
+	for(uint32_t step = 0; step < this->schedule.size(); step++)
+	{
+		Pass const &pass = this->passes[this->schedule[step]];
+		for(ResourceID write : pass.writes)
+		{
+			Resource &resource = this->resources[write];
+			if(resource.imported) continue;
+			resource.firstUse = resource.lastUse = step;
+			transients.push_back(write);
+		}
+		for(ResourceID read : pass.reads)
+		{
+			Resource &resource = this->resources[this->resolve(read)];
+			if(!resource.imported) resource.lastUse = std::max(resource.lastUse, step);
+		}
+	}
+	for(ResourceID output : this->outputs)
+	{
+		Resource &resource = this->resources[this->resolve(output)];
+		if(!resource.imported) resource.lastUse = static_cast<uint32_t>(this->schedule.size());
+	}
+	
+	//Greedily reuse a physical texture of the same size and format that's free by the time the transient is written
+	//Transients are already in the order they're first written, since they're collected from the schedule
+	for(ResourceID id : transients)
+	{
+		Resource &resource = this->resources[id];
+		for(size_t i = 0; i < this->physical.size(); i++)
+		{
+			Physical &candidate = this->physical[i];
+			if(candidate.width != resource.width || candidate.height != resource.height || candidate.format != resource.format || candidate.lastUse >= resource.firstUse) continue;
+			resource.physical = static_cast<int32_t>(i);
+			candidate.lastUse = resource.lastUse;
+			break;
+		}
+		if(resource.physical >= 0) continue;
+		resource.physical = static_cast<int32_t>(this->physical.size());
+		this->physical.push_back({resource.width, resource.height, resource.format, resource.lastUse, 0});
+	}
+	
+	//Consecutive compute passes share a group, and so a barrier, unless one touches an image another in the group writes
+	std::vector<uint64_t> groupReads, groupWrites;
+	bool groupIsCompute = false;
+	auto touches = [](std::vector<uint64_t> const &set, uint64_t storage)
+	{
+		return std::find(set.begin(), set.end(), storage) != set.end();
+	};
+	for(PassID id : this->schedule)
+	{
+		Pass const &pass = this->passes[id];
+		bool merge = !this->groups.empty() && groupIsCompute && pass.kind == PassKind::Compute;
+		for(ResourceID read : pass.reads) merge = merge && !touches(groupWrites, this->storageOf(read));
+		for(ResourceID write : pass.writes) merge = merge && !touches(groupWrites, this->storageOf(write)) && !touches(groupReads, this->storageOf(write));
+		if(!merge)
+		{
+			this->groups.emplace_back();
+			groupReads.clear();
+			groupWrites.clear();
+			groupIsCompute = pass.kind == PassKind::Compute;
+		}
+		this->groups.back().push_back(id);
+		for(ResourceID read : pass.reads) groupReads.push_back(this->storageOf(read));
+		for(ResourceID write : pass.writes) groupWrites.push_back(this->storageOf(write));
+	}
+}
+
+void RenderGraph::clear()
+{
+	this->resources.clear();
+	this->passes.clear();
+	this->outputs.clear();
+	this->groups.clear();
+	this->physical.clear();
+	this->schedule.clear();
+	this->producers.clear();
+}
+
+RenderGraph::ResourceID RenderGraph::resolve(ResourceID id) const
+{
+	while(id != noResource && this->resources[id].forward != noResource) id = this->resources[id].forward;
+	return id;
+}
+
+bool RenderGraph::isDefined(ResourceID id) const
+{
+	return this->resources[this->resolve(id)].defined;
+}
+
+uint32_t RenderGraph::texture(ResourceID id) const
+{
+	Resource const &resource = this->resources[this->resolve(id)];
+	if(!resource.defined) return 0;
+	if(resource.imported) return resource.handle;
+	return resource.physical >= 0 ? this->physical[resource.physical].handle : 0;
+}
+
+void RenderGraph::setPhysicalHandle(size_t physical, uint32_t handle)
+{
+	this->physical[physical].handle = handle;
+}
+
+uint64_t RenderGraph::storageOf(ResourceID id) const
+{
+	Resource const &resource = this->resources[this->resolve(id)];
+	if(resource.imported) return (1ULL << 63) | resource.handle;
+	return static_cast<uint64_t>(resource.physical);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "commandBuffer.hh"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// Post processing declared as passes that read and write images, rebuilt every frame
+/// Compiling the graph orders its passes, culls the ones that are disabled or don't contribute to an output,
+/// places transient images whose lifetimes don't overlap in the same physical texture, and groups compute passes that don't depend on each other so they share one barrier
+/// Compiling never touches GL, Renderer::execute creates the physical textures and runs the passes
+struct RenderGraph
+{
+	using ResourceID = uint32_t;
+	using PassID = uint32_t;
+	static constexpr ResourceID noResource = UINT32_MAX;
+	
+	enum struct PassKind : uint8_t
+	{
+		Compute, Raster,
+	};
+	
+	struct Resource
+	{
+		std::string name = "";
+		CF format = CF::RGBA32F;
+		float scale = 1.0f; //Size relative to the graph's, only used by transients
+		uint32_t width = 0, height = 0; //Resolved by compile for transients
+		uint32_t handle = 0; //Texture, given for imported resources and bound by Renderer::execute for transients
+		bool imported = false;
+		
+		//Compiled
+		ResourceID forward = noResource; //Written by a disabled pass, which leaves the image it read in its place
+		int32_t physical = -1; //The physical texture a live transient is placed in
+		bool defined = false; //Holds an image, false if nothing that runs writes it, ie its producer was culled
+		uint32_t firstUse = 0, lastUse = 0; //Range of scheduled passes the transient must stay intact for
+	};
+	
+	/// What a pass can see while it records its work
+	struct PassContext
+	{
+		/// The texture holding a resource, after following disabled passes
+		[[nodiscard]] uint32_t texture(ResourceID id) const;
+		[[nodiscard]] Resource const& resource(ResourceID id) const;
+		
+		RenderGraph const &graph;
+		CommandBuffer &commands;
+	};
+	
+	using Execute = std::function<void(PassContext const &context)>;
+	
+	struct Pass
+	{
+		std::string name = "";
+		PassKind kind = PassKind::Compute;
+		std::vector<ResourceID> reads, writes;
+		Execute execute;
+		bool enabled = true;
+		bool sideEffects = false; //Kept even if nothing reads what it writes, ie passes that draw straight to the back buffer
+		bool culled = false; //Compiled
+	};
+	
+	/// A texture the graph needs, transients share one when their lifetimes don't overlap
+	struct Physical
+	{
+		uint32_t width = 0, height = 0;
+		CF format = CF::RGBA32F;
+		uint32_t lastUse = 0;
+		uint32_t handle = 0; //Bound by Renderer::execute
+	};
+	
+	/// Bytes a pixel of the format takes, for budgeting physical textures
+	[[nodiscard]] static size_t bytesPerPixel(CF format);
+	
+	/// Use an image the graph doesn't own, ie the scene's color target
+	ResourceID importResource(std::string const &name, CF format, uint32_t width, uint32_t height, uint32_t handle);
+	
+	/// Declare an image that only lives within the frame
+	/// \param scale Size relative to the size the graph is compiled for, ie 0.5 for a half resolution target
+	ResourceID createResource(std::string const &name, CF format = CF::RGBA32F, float scale = 1.0f);
+	
+	/// Declare a pass, passes run in the order they're added so a pass must be added after the passes it reads from
+	/// A resource can only be written by one pass
+	/// If the pass is disabled, each of its writes is replaced by the read at the same index, so a chain of image in, image out passes skips over it
+	PassID addPass(std::string const &name, PassKind kind, std::vector<ResourceID> reads, std::vector<ResourceID> writes, Execute execute);
+	
+	void setEnabled(PassID pass, bool enabled);
+	void setSideEffects(PassID pass, bool sideEffects);
+	
+	/// Passes that neither contribute to an output nor have side effects are culled
+	void markOutput(ResourceID resource);
+	
+	/// Schedule the graph for a target size
+	void compile(uint32_t width, uint32_t height);
+	
+	/// Remove every resource and pass, keeping their memory for the next frame's graph
+	void clear();
+	
+	/// Follow disabled passes to the resource that actually holds an image
+	[[nodiscard]] ResourceID resolve(ResourceID id) const;
+	
+	/// Whether a resource holds an image once the graph runs, after following disabled passes
+	/// An output isn't when its producer was culled, compile logs it and callers should fall back to the graph's input
+	[[nodiscard]] bool isDefined(ResourceID id) const;
+	
+	/// The texture holding a resource, imported or placed by Renderer::execute
+	/// \return 0 if the resource isn't defined
+	[[nodiscard]] uint32_t texture(ResourceID id) const;
+	
+	void setPhysicalHandle(size_t physical, uint32_t handle);
+	
+	[[nodiscard]] Resource const& getResource(ResourceID id) const
+	{
+		return this->resources[id];
+	}
+	
+	[[nodiscard]] Pass const& getPass(PassID id) const
+	{
+		return this->passes[id];
+	}
+	
+	[[nodiscard]] size_t numResources() const
+	{
+		return this->resources.size();
+	}
+	
+	[[nodiscard]] size_t numPasses() const
+	{
+		return this->passes.size();
+	}
+	
+	/// The live passes in the order they run, split into groups that only need a barrier between them
+	[[nodiscard]] std::vector<std::vector<PassID>> const& getGroups() const
+	{
+		return this->groups;
+	}
+	
+	[[nodiscard]] std::vector<Physical> const& getPhysical() const
+	{
+		return this->physical;
+	}
+
+private:
+	/// Which image a resolved resource is stored in, for spotting hazards within a group
+	[[nodiscard]] uint64_t storageOf(ResourceID id) const;
+	
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<ResourceID> outputs;
+	
+	//Compiled
+	std::vector<std::vector<PassID>> groups;
+	std::vector<Physical> physical;
+	std::vector<PassID> schedule;
+	std::vector<PassID> producers; //Indexed by resource, the pass that writes it
+};
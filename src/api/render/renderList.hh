@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <cstdint>
 #include <commons/math/vec2.hh>
@@ -8,6 +9,7 @@
 
 struct Renderable
 {
+	Renderable() = default;
 	Renderable(vec2<double> const &pos, vec2<double> const &scale, double rotation, vec3<double> const &axis, uint64_t atlasID, uint64_t shaderID, size_t layer, size_t sublayer, std::string const &name) :
 			pos(pos), scale(scale), rotation(rotation), axis(axis), atlasID(atlasID), shaderID(shaderID), layer(layer), sublayer(sublayer), name(name) {}
 	vec2<double> pos{}, scale{};
@@ -22,6 +24,19 @@ struct RenderList
 {
 	using Comparator = std::function<bool(Renderable const &a, Renderable const &b)>;
 	
+	static constexpr uint64_t drawKeyIndexMask = (1ull << 28) - 1;
+	
+	/// A key that sorts renderables into draw order when sorted ascending: higher layers first, then higher sublayers,
+	/// then grouped by atlas to save rebinding, then by submission order
+	/// Packs 12 bits each of the layer, sublayer and atlas slot index, and 28 bits of index which can be recovered with drawKeyIndexMask
+	[[nodiscard]] inline static uint64_t drawKey(Renderable const &renderable, size_t index)
+	{
+		uint64_t const layer = 0xFFF - std::min<uint64_t>(renderable.layer, 0xFFF);
+		uint64_t const sublayer = 0xFFF - std::min<uint64_t>(renderable.sublayer, 0xFFF);
+		uint64_t const atlas = renderable.atlasID & 0xFFF;
+		return (layer << 52) | (sublayer << 40) | (atlas << 28) | (index & drawKeyIndexMask);
+	}
+	
 	[[nodiscard]] inline static bool renderableComparator(Renderable const &a, Renderable const &b)
 	{
 		return (a.atlasID > b.atlasID) && (a.layer == b.layer) ? a.sublayer > b.sublayer : a.layer > b.layer;
@@ -32,6 +47,11 @@ struct RenderList
 		return this->list[index];
 	}
 	
+	[[nodiscard]] inline Renderable const& operator [](size_t index) const
+	{
+		return this->list[index];
+	}
+	
 	inline void add(std::initializer_list<Renderable> const &renderables)
 	{
 		this->list.insert(this->list.end(), renderables.begin(), renderables.end());
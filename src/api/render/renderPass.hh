@@ -1,13 +1,22 @@
 #pragma once
 
-#include "framebuffer.hh"
+#include "renderGraph.hh"
 
 struct RenderPass
 {
 	virtual ~RenderPass() = default;
 	
-	/// Process the pixels held by 'in', and write the result to 'out'
-	virtual void process(Framebuffer *out, Framebuffer *in) = 0;
+	/// Declare the pass's work in a post processing graph, it can add any number of graph passes and transient images
+	/// \param input The image to process
+	/// \return The resource holding the processed image
+	virtual RenderGraph::ResourceID addTo(RenderGraph &graph, RenderGraph::ResourceID input) = 0;
+	
+	/// How far in pixels the pass can carry content from where it was, ie a blur's spread
+	/// Layers run their passes over their content's bounds grown by this, so nothing the pass spreads is cut off
+	[[nodiscard]] virtual float reach() const
+	{
+		return 0.0f;
+	}
 	
 	bool enabled = true;
 	std::string name = "";
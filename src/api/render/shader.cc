@@ -1,6 +1,50 @@
 #include "shader.hh"
+#include "glState.hh"
+#include "programCache.hh"
 #include "../../global.hh"
 #include <glad/glad.h>
+#include <algorithm>
+
+namespace
+{
+	bool batching = false;
+	std::vector<Shader*> pendingShaders; //Built during a batch, waiting on finish()
+	Shader const *inUse = nullptr;
+}
+
+void Shader::beginBatch()
+{
+	batching = true;
+}
+
+std::string Shader::applyDefines(std::string const &source, std::vector<ShaderDefine> const &defines)
+{
+	std::string block;
+	for(ShaderDefine const &define : defines) block += "#define " + std::string(define.name) + " " + std::to_string(define.value) + "\n";
+	size_t insertAt = 0;
+	size_t const version = source.find("#version");
+	if(version != std::string::npos)
+	{
+		size_t const lineEnd = source.find('\n', version);
+		if(lineEnd == std::string::npos) return source + "\n" + block;
+		insertAt = lineEnd + 1;
+	}
+	std::string result = source;
+	result.insert(insertAt, block);
+	return result;
+}
+
+bool Shader::inBatch()
+{
+	return batching;
+}
+
+void Shader::endBatch()
+{
+	batching = false;
+	for(Shader *shader : pendingShaders) shader->finish();
+	pendingShaders.clear();
+}
 
 Shader::Shader(std::vector<uint8_t> const &vertShader, std::vector<uint8_t> const &fragShader) : Shader(std::string{vertShader.begin(), vertShader.end()}, std::string{fragShader.begin(), fragShader.end()}) {}
 
@@ -8,103 +52,20 @@ Shader::Shader(std::vector<uint8_t> const &compShader) : Shader(std::string{comp
 
 Shader::Shader(std::string const &vertShader, std::string const &fragShader)
 {
-	uint32_t vertHandle = glCreateShader(GL_VERTEX_SHADER), fragHandle = glCreateShader(GL_FRAGMENT_SHADER);
-	this->handle = glCreateProgram();
-	char const *vertSource = vertShader.data(), *fragSource = fragShader.data();
-	glShaderSource(vertHandle, 1, &vertSource, nullptr);
-	glShaderSource(fragHandle, 1, &fragSource, nullptr);
-	glCompileShader(vertHandle);
-	int32_t success = 0;
-	glGetShaderiv(vertHandle, GL_COMPILE_STATUS, &success);
-	if(!success)
-	{
-		int32_t maxLen = 0;
-		glGetShaderiv(vertHandle, GL_INFO_LOG_LENGTH, &maxLen);
-		std::vector<char> error;
-		error.resize(maxLen * sizeof(GLchar));
-		glGetShaderInfoLog(vertHandle, maxLen, &maxLen, error.data());
-		std::string errorStr{error.begin(), error.end()};
-		logger << Sev::ERR << "Shader failed to compile: " << errorStr << logger.endl();
-		return;
-	}
-	glCompileShader(fragHandle);
-	success = 0;
-	glGetShaderiv(fragHandle, GL_COMPILE_STATUS, &success);
-	if(!success)
-	{
-		int32_t maxLen = 0;
-		glGetShaderiv(fragHandle, GL_INFO_LOG_LENGTH, &maxLen);
-		std::vector<char> error;
-		error.resize(maxLen * sizeof(GLchar));
-		glGetShaderInfoLog(fragHandle, maxLen, &maxLen, error.data());
-		std::string errorStr{error.begin(), error.end()};
-		logger << Sev::ERR << "Shader failed to compile: " << errorStr << logger.endl();
-		return;
-	}
-	glAttachShader(this->handle, vertHandle);
-	glAttachShader(this->handle, fragHandle);
-	glLinkProgram(this->handle);
-	success = 0;
-	glGetProgramiv(this->handle, GL_LINK_STATUS, &success);
-	if(!success)
-	{
-		int32_t maxLen = 0;
-		glGetShaderiv(this->handle, GL_INFO_LOG_LENGTH, &maxLen);
-		std::vector<char> error;
-		error.resize(maxLen * sizeof(GLchar));
-		glGetShaderInfoLog(this->handle, maxLen, &maxLen, error.data());
-		std::string errorStr{error.begin(), error.end()};
-		logger << Sev::ERR << "Shader program " << this->handle << " failed to link" << logger.endl();
-		return;
-	}
-	glDetachShader(this->handle, vertHandle);
-	glDetachShader(this->handle, fragHandle);
-	glDeleteShader(vertHandle);
-	glDeleteShader(fragHandle);
+	this->build({{GL_VERTEX_SHADER, &vertShader}, {GL_FRAGMENT_SHADER, &fragShader}});
 }
 
 Shader::Shader(std::string const &compShader)
 {
-	uint32_t compHandle = glCreateShader(GL_COMPUTE_SHADER);
-	this->handle = glCreateProgram();
-	char const *compSource = compShader.data();
-	glShaderSource(compHandle, 1, &compSource, nullptr);
-	glCompileShader(compHandle);
-	int32_t success = 0;
-	glGetShaderiv(compHandle, GL_COMPILE_STATUS, &success);
-	if(!success)
-	{
-		int32_t maxLen = 0;
-		glGetShaderiv(compHandle, GL_INFO_LOG_LENGTH, &maxLen);
-		std::vector<char> error;
-		error.resize(maxLen * sizeof(GLchar));
-		glGetShaderInfoLog(compHandle, maxLen, &maxLen, error.data());
-		std::string errorStr{error.begin(), error.end()};
-		logger << Sev::ERR << "Shader failed to compile: " << errorStr << logger.endl();
-		return;
-	}
-	
-	glAttachShader(this->handle, compHandle);
-	glLinkProgram(this->handle);
-	success = 0;
-	glGetProgramiv(this->handle, GL_LINK_STATUS, &success);
-	if(!success)
-	{
-		int32_t maxLen = 0;
-		glGetShaderiv(this->handle, GL_INFO_LOG_LENGTH, &maxLen);
-		std::vector<char> error;
-		error.resize(maxLen * sizeof(GLchar));
-		glGetShaderInfoLog(this->handle, maxLen, &maxLen, error.data());
-		std::string errorStr{error.begin(), error.end()};
-		logger << Sev::ERR << "Shader program " << this->handle << " failed to link" << logger.endl();
-		return;
-	}
-	glDetachShader(this->handle, compHandle);
-	glDeleteShader(compHandle);
+	this->build({{GL_COMPUTE_SHADER, &compShader}});
 }
 
 Shader::~Shader()
 {
+	if(batching) std::erase(pendingShaders, this);
+	if(inUse == this) inUse = nullptr;
+	for(uint32_t stage : this->stages) glDeleteShader(stage);
+	GS::forgetProgram(this->handle);
 	glDeleteProgram(this->handle);
 }
 
@@ -112,12 +73,24 @@ Shader::Shader(Shader &other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->linked = other.linked;
+	this->uniforms = std::move(other.uniforms);
+	this->uniformIDs = std::move(other.uniformIDs);
+	this->workGroupSize = other.workGroupSize;
+	this->compute = other.compute;
+	if(inUse == &other) inUse = this;
 }
 
 Shader& Shader::operator=(Shader other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->linked = other.linked;
+	this->uniforms = std::move(other.uniforms);
+	this->uniformIDs = std::move(other.uniformIDs);
+	this->workGroupSize = other.workGroupSize;
+	this->compute = other.compute;
+	if(inUse == &other) inUse = this;
 	return *this;
 }
 
@@ -125,18 +98,44 @@ Shader::Shader(Shader &&other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->linked = other.linked;
+	this->uniforms = std::move(other.uniforms);
+	this->uniformIDs = std::move(other.uniformIDs);
+	this->workGroupSize = other.workGroupSize;
+	this->compute = other.compute;
+	if(inUse == &other) inUse = this;
 }
 
 Shader& Shader::operator=(Shader &&other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->linked = other.linked;
+	this->uniforms = std::move(other.uniforms);
+	this->uniformIDs = std::move(other.uniformIDs);
+	this->workGroupSize = other.workGroupSize;
+	this->compute = other.compute;
+	if(inUse == &other) inUse = this;
 	return *this;
 }
 
 void Shader::use()
 {
-	glUseProgram(this->handle);
+	GS::useProgram(this->handle);
+	inUse = this;
+}
+
+Shader const* Shader::current()
+{
+	return inUse;
+}
+
+std::array<uint32_t, 3> Shader::groupsFor(uint32_t width, uint32_t height, uint32_t depth) const
+{
+	std::array<uint32_t, 3> groups{0, 0, 0};
+	uint32_t const size[3] = {width, height, depth};
+	for(size_t i = 0; i < 3; i++) if(this->workGroupSize[i] != 0) groups[i] = (size[i] + this->workGroupSize[i] - 1) / this->workGroupSize[i];
+	return groups;
 }
 
 int32_t Shader::getUniformHandle(std::string const &location)
@@ -185,3 +184,148 @@ void Shader::sendMat4f(std::string const &location, float* val)
 {
 	glUniformMatrix4fv(this->getUniformHandle(location), 1, GL_FALSE, val);
 }
+
+int32_t Shader::getUniformHandle(UniformID id) const
+{
+	auto it = std::lower_bound(this->uniformIDs.begin(), this->uniformIDs.end(), id.hash, [](auto const &entry, uint64_t hash){return entry.first < hash;});
+	return it != this->uniformIDs.end() && it->first == id.hash ? it->second : -1;
+}
+
+void Shader::sendFloat(UniformID id, float val)
+{
+	glUniform1f(this->getUniformHandle(id), val);
+}
+
+void Shader::sendInt(UniformID id, int32_t val)
+{
+	glUniform1i(this->getUniformHandle(id), val);
+}
+
+void Shader::sendUInt(UniformID id, uint32_t val)
+{
+	glUniform1ui(this->getUniformHandle(id), val);
+}
+
+void Shader::sendVec2f(UniformID id, float const *val)
+{
+	glUniform2fv(this->getUniformHandle(id), 1, val);
+}
+
+void Shader::sendVec3f(UniformID id, float const *val)
+{
+	glUniform3fv(this->getUniformHandle(id), 1, val);
+}
+
+void Shader::sendVec4f(UniformID id, float const *val)
+{
+	glUniform4fv(this->getUniformHandle(id), 1, val);
+}
+
+void Shader::sendMat3f(UniformID id, float const *val)
+{
+	glUniformMatrix3fv(this->getUniformHandle(id), 1, GL_FALSE, val);
+}
+
+void Shader::sendMat4f(UniformID id, float const *val)
+{
+	glUniformMatrix4fv(this->getUniformHandle(id), 1, GL_FALSE, val);
+}
+
+void Shader::reflect()
+{
+	if(this->compute)
+	{
+		int32_t size[3] = {0, 0, 0};
+		glGetProgramiv(this->handle, GL_COMPUTE_WORK_GROUP_SIZE, size);
+		for(size_t i = 0; i < 3; i++) this->workGroupSize[i] = static_cast<uint32_t>(size[i]);
+	}
+	
+	
+	int32_t numUniforms = 0, maxNameLen = 0;
+	glGetProgramiv(this->handle, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(this->handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLen);
+	std::vector<char> nameBuf(std::max(maxNameLen, 1));
+	this->uniformIDs.clear();
+	for(int32_t i = 0; i < numUniforms; i++)
+	{
+		int32_t nameLen = 0;
+		glGetActiveUniformName(this->handle, (uint32_t)i, (int32_t)nameBuf.size(), &nameLen, nameBuf.data());
+		std::string name{nameBuf.data(), (size_t)nameLen};
+		int32_t location = glGetUniformLocation(this->handle, name.data());
+		if(location < 0) continue; //Members of uniform blocks don't have locations
+		if(name.ends_with("[0]")) name.resize(name.size() - 3); //Arrays are reported by their first element, but looked up by their name
+		this->uniformIDs.emplace_back(fnv1a64(name), location);
+		this->uniforms.emplace(name, location);
+	}
+	std::sort(this->uniformIDs.begin(), this->uniformIDs.end());
+}
+
+void Shader::build(std::initializer_list<std::pair<uint32_t, std::string const*>> sources)
+{
+	this->handle = glCreateProgram();
+	std::vector<std::string const*> texts;
+	for(auto const &[type, source] : sources)
+	{
+		texts.push_back(source);
+		if(type == GL_COMPUTE_SHADER) this->compute = true;
+	}
+	this->cacheKey = PC::key(texts);
+	if(PC::load(this->handle, this->cacheKey))
+	{
+		this->linked = true;
+		this->reflect();
+		return;
+	}
+	
+	//Every stage is compiled and the program linked before any status is queried, so a driver that compiles in the background can overlap them all
+	for(auto const &[type, source] : sources)
+	{
+		uint32_t stage = glCreateShader(type);
+		char const *text = source->data();
+		glShaderSource(stage, 1, &text, nullptr);
+		glCompileShader(stage);
+		glAttachShader(this->handle, stage);
+		this->stages.push_back(stage);
+	}
+	if(PC::enabled()) glProgramParameteri(this->handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(this->handle);
+	if(batching) pendingShaders.push_back(this);
+	else this->finish();
+}
+
+void Shader::finish()
+{
+	bool compiled = true;
+	for(uint32_t stage : this->stages)
+	{
+		int32_t success = 0;
+		glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
+		if(success) continue;
+		compiled = false;
+		int32_t maxLen = 0;
+		glGetShaderiv(stage, GL_INFO_LOG_LENGTH, &maxLen);
+		std::vector<char> error(std::max(maxLen, 1));
+		glGetShaderInfoLog(stage, maxLen, &maxLen, error.data());
+		logger << Sev::ERR << "Shader failed to compile: " << std::string{error.data(), (size_t)maxLen} << logger.endl();
+	}
+	int32_t success = 0;
+	if(compiled) glGetProgramiv(this->handle, GL_LINK_STATUS, &success);
+	if(compiled && !success)
+	{
+		int32_t maxLen = 0;
+		glGetProgramiv(this->handle, GL_INFO_LOG_LENGTH, &maxLen);
+		std::vector<char> error(std::max(maxLen, 1));
+		glGetProgramInfoLog(this->handle, maxLen, &maxLen, error.data());
+		logger << Sev::ERR << "Shader program " << this->handle << " failed to link: " << std::string{error.data(), (size_t)maxLen} << logger.endl();
+	}
+	for(uint32_t stage : this->stages)
+	{
+		glDetachShader(this->handle, stage);
+		glDeleteShader(stage);
+	}
+	this->stages.clear();
+	if(!compiled || !success) return;
+	this->linked = true;
+	this->reflect();
+	PC::store(this->handle, this->cacheKey);
+}
@@ -1,9 +1,59 @@
 #pragma once
 
+#include "../../hash.hh"
+
 #include <vector>
 #include <string>
+#include <string_view>
+#include <array>
 #include <cstdio>
+#include <initializer_list>
 #include <unordered_map>
+#include <utility>
+
+/// A uniform's name hashed at compile time, so looking a uniform up on the hot path never builds or hashes a string
+struct UniformID
+{
+	consteval explicit UniformID(char const *name) : hash(fnv1a64(name)) {}
+	
+	/// For names that are only known at runtime
+	[[nodiscard]] static UniformID fromName(std::string_view name)
+	{
+		UniformID id;
+		id.hash = fnv1a64(name);
+		return id;
+	}
+	
+	/// For IDs that were stored as their hash, ie in recorded commands
+	[[nodiscard]] static constexpr UniformID fromHash(uint64_t hash)
+	{
+		UniformID id;
+		id.hash = hash;
+		return id;
+	}
+	
+	bool operator==(UniformID const &other) const = default;
+	
+	uint64_t hash = 0;
+
+private:
+	constexpr UniformID() = default;
+};
+
+/// Uniforms used by the engine's own shaders
+namespace Uniforms
+{
+	inline constexpr UniformID mvp{"mvp"};
+	inline constexpr UniformID inputColor{"inputColor"};
+	inline constexpr UniformID firstSprite{"firstSprite"};
+}
+
+/// A #define injected into a shader's source, to pick one permutation of a source written with #if blocks
+struct ShaderDefine
+{
+	std::string_view name;
+	int64_t value = 1;
+};
 
 struct Shader
 {
@@ -16,6 +66,31 @@ struct Shader
 	
 	~Shader();
 	
+	/// Shaders created between beginBatch and endBatch are compiled and linked without waiting on the driver,
+	/// their status is checked together at endBatch so drivers that compile in the background can work on all of them at once
+	/// Shaders in a batch aren't usable, and mustn't be moved, until endBatch
+	static void beginBatch();
+	static void endBatch();
+	[[nodiscard]] static bool inBatch();
+	
+	/// Insert defines on the lines after a source's #version directive, which GLSL requires to come first
+	[[nodiscard]] static std::string applyDefines(std::string const &source, std::vector<ShaderDefine> const &defines);
+	
+	/// Identify a combination of defines, the order they're listed in doesn't matter
+	[[nodiscard]] static constexpr uint64_t variantKey(std::vector<ShaderDefine> const &defines)
+	{
+		uint64_t key = 0;
+		for(ShaderDefine const &define : defines)
+		{
+			uint64_t h = fnv1a64(define.name) ^ (static_cast<uint64_t>(define.value) * 0x9E3779B97F4A7C15ULL);
+			h ^= h >> 31;
+			h *= 0xBF58476D1CE4E5B9ULL;
+			h ^= h >> 29;
+			key += h;
+		}
+		return key;
+	}
+	
 	//copy
 	Shader(Shader &other);
 	Shader& operator=(Shader other);
@@ -25,7 +100,19 @@ struct Shader
 	Shader& operator=(Shader &&other);
 	
 	void use();
+	
+	/// The shader that was last used, nullptr if it's since been destroyed
+	[[nodiscard]] static Shader const* current();
+	
+	/// Work groups to dispatch so every invocation of a width * height * depth grid is covered, from the program's local size
+	/// \return All 0 for a program without a compute stage
+	[[nodiscard]] std::array<uint32_t, 3> groupsFor(uint32_t width, uint32_t height, uint32_t depth = 1) const;
+	
 	[[nodiscard]] int32_t getUniformHandle(std::string const &location);
+	
+	/// Find an active uniform by ID, resolved when the program was linked
+	/// \return The uniform's location, or -1 if the program has no such uniform
+	[[nodiscard]] int32_t getUniformHandle(UniformID id) const;
 	void sendFloat(std::string const &location, float val);
 	void sendInt(std::string const &location, int32_t val);
 	void sendUInt(std::string const &location, uint32_t val);
@@ -34,7 +121,32 @@ struct Shader
 	void sendVec4f(std::string const &location, float* val);
 	void sendMat3f(std::string const &location, float* val);
 	void sendMat4f(std::string const &location, float* val);
+	void sendFloat(UniformID id, float val);
+	void sendInt(UniformID id, int32_t val);
+	void sendUInt(UniformID id, uint32_t val);
+	void sendVec2f(UniformID id, float const *val);
+	void sendVec3f(UniformID id, float const *val);
+	void sendVec4f(UniformID id, float const *val);
+	void sendMat3f(UniformID id, float const *val);
+	void sendMat4f(UniformID id, float const *val);
 	
 	uint32_t handle = 0;
+	bool linked = false; //False if compilation or linking failed
 	std::unordered_map<std::string, int32_t> uniforms;
+	std::vector<std::pair<uint64_t, int32_t>> uniformIDs; //Sorted by ID hash, every active uniform's location
+	std::array<uint32_t, 3> workGroupSize{0, 0, 0}; //The local_size a compute program was linked with, queried from the driver
+
+private:
+	/// Compile and link from source, unless the program cache has a binary for these sources
+	void build(std::initializer_list<std::pair<uint32_t, std::string const*>> sources);
+	
+	/// Check the build's result, and cache the binary if it linked
+	void finish();
+	
+	/// Record the location of every active uniform, and a compute program's local size, called once the program has linked
+	void reflect();
+	
+	uint64_t cacheKey = 0;
+	bool compute = false;
+	std::vector<uint32_t> stages; //Only held between build and finish
 };
@@ -1,7 +1,14 @@
 #include "texture.hh"
+#include "glState.hh"
 
 #include <glad/glad.h>
 
+/// Drivers pad RGB8 out to 32 bits per pixel, so RGB and RGBA textures cost the same
+size_t bytesPerPixel(ColorFormat format)
+{
+	return format == ColorFormat::GREY ? 1 : 4;
+}
+
 Texture::Texture(uint32_t width, uint32_t height, ColorFormat colorFormat, InterpMode mode, bool sRGB)
 {
 	this->fmt = colorFormat;
@@ -24,6 +31,7 @@ Texture::Texture(uint32_t width, uint32_t height, ColorFormat colorFormat, Inter
 		f = GL_R8;
 	}
 	glTextureStorage2D(this->handle, 1, f, width, height);
+	this->memory = MB::Allocation(MB::Category::Textures, static_cast<size_t>(width) * height * bytesPerPixel(colorFormat));
 	this->clear();
 	this->setInterpolation(mode, mode);
 	this->setAnisotropyLevel(1);
@@ -55,6 +63,7 @@ Texture::Texture(uint8_t *data, uint32_t width, uint32_t height, ColorFormat col
 	glCreateTextures(GL_TEXTURE_2D, 1, &this->handle);
 	glTextureStorage2D(this->handle, 1, f, width, height);
 	glTextureSubImage2D(this->handle, 0, 0, 0, this->width, this->height, cf, GL_UNSIGNED_BYTE, data);
+	this->memory = MB::Allocation(MB::Category::Textures, static_cast<size_t>(width) * height * bytesPerPixel(colorFormat));
 	this->setInterpolation(mode, mode);
 	this->setAnisotropyLevel(1);
 }
@@ -73,12 +82,14 @@ Texture::Texture(uint8_t red, uint8_t green, uint8_t blue, uint8_t alpha, bool s
 	glCreateTextures(GL_TEXTURE_2D, 1, &this->handle);
 	glTextureStorage2D(this->handle, 1, sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8, this->width, this->height);
 	glTextureSubImage2D(this->handle, 0, 0, 0, this->width, 1, GL_RGBA, GL_UNSIGNED_BYTE, data[0]);
+	this->memory = MB::Allocation(MB::Category::Textures, 4);
 	this->setInterpolation(InterpMode::Linear, InterpMode::Linear);
 	this->setAnisotropyLevel(1);
 }
 
 Texture::~Texture()
 {
+	GS::forgetTexture(this->handle);
 	glDeleteTextures(1, &this->handle);
 }
 
@@ -86,12 +97,14 @@ Texture::Texture(Texture &other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->memory = std::move(other.memory);
 }
 
 Texture& Texture::operator=(Texture other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
@@ -99,20 +112,20 @@ Texture::Texture(Texture &&other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->memory = std::move(other.memory);
 }
 
 Texture& Texture::operator=(Texture &&other)
 {
 	this->handle = other.handle;
 	other.handle = 0;
+	this->memory = std::move(other.memory);
 	return *this;
 }
 
 void Texture::use(uint32_t target)
 {
-	int32_t curTex;
-	glGetIntegerv(GL_TEXTURE_BINDING_2D, &curTex);
-	glBindTextureUnit(target, this->handle);
+	GS::bindTextureUnit(target, this->handle);
 }
 
 void Texture::setInterpolation(InterpMode min, InterpMode mag)
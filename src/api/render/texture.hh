@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../../memoryBudget.hh"
+
 #include <cstdint>
 #include <vector>
 
@@ -44,4 +46,5 @@ struct Texture
 	
 	uint32_t handle = 0, width = 0, height = 0;
 	ColorFormat fmt;
+	MB::Allocation memory{};
 };
@@ -0,0 +1,161 @@
+#include "workGroupTuner.hh"
+#include "glState.hh"
+#include "programCache.hh"
+#include "../../global.hh"
+
+#include <glad/glad.h>
+#include <commons/fileio.hh>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+namespace WorkGroupTuner
+{
+	constexpr char const magic[] = {'W', 'G', 'T'};
+	constexpr uint32_t benchWidth = 1920, benchHeight = 1080; //Scratch image size, large enough that every candidate fills the GPU
+	constexpr uint32_t warmupRuns = 2, timedRuns = 8;
+	
+	/// Tried in order, so on a tie the first, and most commonly good, size wins
+	constexpr Size candidates[] = {{16, 16}, {8, 8}, {16, 8}, {8, 16}, {32, 8}, {32, 4}, {64, 4}, {32, 16}, {64, 1}, {32, 32}};
+	
+	std::string path;
+	bool on = false;
+	std::unordered_map<uint64_t, Size> results; //Keyed by the source's program cache key and its variant key
+	
+	uint64_t keyFor(std::string const &source, std::vector<ShaderDefine> const &defines)
+	{
+		return PC::key({&source}) ^ Shader::variantKey(defines);
+	}
+	
+	void save()
+	{
+		if(path.empty()) return;
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::path{path}.parent_path(), ec);
+		FILE *out = openFile(path, "wb");
+		if(!out)
+		{
+			logger << Sev::ERR << "Failed to write work group tuning results to " << path << logger.endl();
+			return;
+		}
+		uint64_t const count = results.size();
+		writeFile(out, magic, sizeof(magic));
+		writeFile(out, &count, sizeof(count));
+		for(auto const &[key, size] : results)
+		{
+			writeFile(out, &key, sizeof(key));
+			writeFile(out, &size.x, sizeof(size.x));
+			writeFile(out, &size.y, sizeof(size.y));
+		}
+		closeFile(out);
+	}
+	
+	void init(std::string const &filePath)
+	{
+		path = filePath;
+		results.clear();
+		FILE *in = openFile(path, "rb");
+		if(!in) return; //Nothing tuned yet
+		char magicIn[sizeof(magic)]{};
+		uint64_t count = 0;
+		bool valid = readFile(in, magicIn, sizeof(magicIn)) == sizeof(magicIn) && std::equal(magicIn, magicIn + sizeof(magic), magic);
+		valid = valid && readFile(in, &count, sizeof(count)) == sizeof(count);
+		for(uint64_t i = 0; valid && i < count; i++)
+		{
+			uint64_t key = 0;
+			Size size;
+			valid = readFile(in, &key, sizeof(key)) == sizeof(key) && readFile(in, &size.x, sizeof(size.x)) == sizeof(size.x) && readFile(in, &size.y, sizeof(size.y)) == sizeof(size.y);
+			if(valid) results[key] = size;
+		}
+		closeFile(in);
+		if(!valid) logger << Sev::ERR << "Work group tuning results in " << path << " are truncated, shaders missing from them will be tuned again" << logger.endl();
+	}
+	
+	void setEnabled(bool enabled)
+	{
+		on = enabled;
+	}
+	
+	bool enabled()
+	{
+		return on;
+	}
+	
+	std::optional<Size> localSize(std::string const &source, std::vector<ShaderDefine> const &defines)
+	{
+		if(source.find("LOCAL_SIZE_X") == std::string::npos) return std::nullopt;
+		auto it = results.find(keyFor(source, defines));
+		if(it != results.end()) return it->second;
+		if(!on || Shader::inBatch()) return std::nullopt;
+		return tune(source, defines);
+	}
+	
+	std::optional<Size> tune(std::string const &source, std::vector<ShaderDefine> const &defines)
+	{
+		int32_t maxInvocations = 0, maxX = 0, maxY = 0;
+		glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxX);
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &maxY);
+		
+		uint32_t scratch[2] = {0, 0};
+		glCreateTextures(GL_TEXTURE_2D, 2, scratch);
+		for(uint32_t texture : scratch)
+		{
+			glTextureStorage2D(texture, 1, GL_RGBA32F, benchWidth, benchHeight);
+			glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+		for(uint32_t unit = 0; unit < 2; unit++)
+		{
+			GS::bindTextureUnit(unit, scratch[unit]);
+			glBindImageTexture(unit, scratch[unit], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		}
+		uint32_t query = 0;
+		glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+		
+		std::optional<Size> best;
+		uint64_t bestNS = UINT64_MAX;
+		for(Size const &candidate : candidates)
+		{
+			if(static_cast<int32_t>(candidate.x * candidate.y) > maxInvocations || static_cast<int32_t>(candidate.x) > maxX || static_cast<int32_t>(candidate.y) > maxY) continue;
+			std::vector<ShaderDefine> sized = defines;
+			sized.push_back({"LOCAL_SIZE_X", candidate.x});
+			sized.push_back({"LOCAL_SIZE_Y", candidate.y});
+			Shader shader{Shader::applyDefines(source, sized)};
+			if(!shader.linked) continue;
+			shader.use();
+			auto const [x, y, z] = shader.groupsFor(benchWidth, benchHeight);
+			
+			//The first runs pay for any lazy work the driver does on a new program, so they're left out of the time
+			for(uint32_t i = 0; i < warmupRuns; i++) glDispatchCompute(x, y, z);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for(uint32_t i = 0; i < timedRuns; i++) glDispatchCompute(x, y, z);
+			glEndQuery(GL_TIME_ELAPSED);
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			if(elapsed < bestNS)
+			{
+				bestNS = elapsed;
+				best = candidate;
+			}
+		}
+		
+		glDeleteQueries(1, &query);
+		for(uint32_t texture : scratch) GS::forgetTexture(texture);
+		glDeleteTextures(2, scratch);
+		if(!best) return std::nullopt;
+		
+		logger << Sev::INFO << "Tuned a compute shader to a local size of " << best->x << "x" << best->y << ", " << static_cast<double>(bestNS) / (1000000.0 * timedRuns) << " ms per dispatch" << logger.endl();
+		results[keyFor(source, defines)] = *best;
+		save();
+		return best;
+	}
+	
+	void clear()
+	{
+		results.clear();
+		save();
+	}
+}
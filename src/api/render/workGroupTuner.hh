@@ -0,0 +1,42 @@
+#pragma once
+
+#include "shader.hh"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// Picks the fastest local size for compute shaders on the device they run on, by timing each candidate once and remembering the winner
+/// Only sources that size their work groups with LOCAL_SIZE_X and LOCAL_SIZE_Y defines can be tuned, results are keyed by source, defines and driver
+/// Only usable on the thread that owns the GL context
+namespace WorkGroupTuner
+{
+	struct Size
+	{
+		uint32_t x = 0, y = 0;
+	};
+	
+	/// Read results from previous runs, called once the GL context exists and after ProgramCache::init, whose driver hash the results are keyed with
+	/// \param filePath Where results are stored, written again whenever a shader is tuned
+	void init(std::string const &filePath);
+	
+	/// Tuning is off by default, a source without a stored result then keeps the local size it declares
+	/// Tuning a shader takes a few milliseconds per candidate and stalls on the GPU, so it's best left on for a one-time run, ie a benchmark option
+	void setEnabled(bool enabled);
+	[[nodiscard]] bool enabled();
+	
+	/// The local size to build a compute source with, tuning it now if it has no result yet and tuning is enabled
+	/// Never tunes between Shader::beginBatch and endBatch, as the candidates have to link before they can be timed
+	/// \return Nothing if the source should keep the local size it declares
+	[[nodiscard]] std::optional<Size> localSize(std::string const &source, std::vector<ShaderDefine> const &defines);
+	
+	/// Time every candidate local size the device supports and store the fastest
+	/// Candidates run over scratch images bound to image units 0 and 1 and texture units 0 and 1, with their uniforms left at 0
+	/// \return The fastest size, or nothing if no candidate linked
+	std::optional<Size> tune(std::string const &source, std::vector<ShaderDefine> const &defines);
+	
+	/// Forget every result, ie after swapping GPUs, the results file is rewritten
+	void clear();
+}
+namespace WGT = WorkGroupTuner;
@@ -1,35 +1,672 @@
 #include "assets.hh"
 #include "util.hh"
 #include "global.hh"
+#include "slotMap.hh"
+#include "hash.hh"
+#include "fileWatcher.hh"
 #include "api/assets/asa.hh"
 #include "api/assets/pngw.hh"
+#include "api/render/programCache.hh"
+#include "api/render/workGroupTuner.hh"
 
+#include <algorithm>
 #include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <filesystem>
+#include <optional>
+#include <commons/fileio.hh>
 #include <commons/misc.hh>
 
 namespace AssetRepository
 {
 	uint64_t meshOrthoQuadLL, meshOrthoQuadC, meshOrthoQuadUL, meshOrthoQuadLR, meshOrthoQuadUR, meshFullscreenQuad;
-	uint64_t shaderObject, shaderTransfer, shaderLine, shaderText;
-	uint64_t shaderBlur3X, shaderBlur3Y, shaderBlur5X, shaderBlur5Y, shaderBlur7X, shaderBlur7Y, shaderBlur9X, shaderBlur9Y, shaderBlur11X, shaderBlur11Y, shaderBlur13X, shaderBlur13Y;
-	uint64_t shaderBloom, shaderBloomComposite, shaderBloomSig, shaderDither, shaderTonemapACES, shaderTonemapFilmic, shaderTonemapSRGB, shaderTonemapUncharted2, shaderVignette;
+	uint64_t shaderObject, shaderTransfer, shaderLine, shaderText, shaderSprite;
+	uint64_t shaderFamilyMipDown, shaderFamilyMipUp;
 	uint64_t textureFallback;
+	size_t uploadsPerFrame = 4;
+	uint32_t hotReloadDebounceMS = 250;
 	UP<ASA> engineASA = nullptr;
 	
-	std::vector<UP<ASA>> asaFiles;
-	std::vector<UP<MeshFile>> meshFiles;
-	std::vector<UP<Texture>> textures;
-	std::vector<UP<Shader>> shaders;
-	std::vector<UP<Mesh>> meshes;
-	std::vector<UP<Atlas>> atlases;
-	
-	UP<Texture> nTexture = nullptr;
-	UP<Shader> nShader = nullptr;
-	UP<Mesh> nMesh = nullptr;
-	UP<Atlas> nAtlas = nullptr;
+	SlotMap<SP<ASA>> asaFiles; //Shared so background loads keep their archive alive
+	SlotMap<UP<MeshFile>> meshFiles;
+	SlotMap<UP<Texture>> textures;
+	SlotMap<UP<Shader>> shaders;
+	SlotMap<UP<Mesh>> meshes;
+	SlotMap<UP<Atlas>> atlases;
+	SlotMap<UP<Font>> fonts;
+	
+	/// Sources are kept so variants can be built whenever they're first asked for, only one of comp or vert/frag is set
+	struct ShaderFamily
+	{
+		std::string compSrc, vertSrc, fragSrc;
+		std::unordered_map<uint64_t, uint64_t> variants; //Variant key to shader ID
+	};
+	SlotMap<ShaderFamily> shaderFamilies;
+	
 	std::vector<uint8_t> nFile{};
 	MeshData nModel{};
 	
+	uint64_t releaseClock = 0; //Shared by every AssetCache so entries released from different caches can be compared
+	
+	/// Reference counts for assets loaded from archives by filename, so loading the same file twice shares one GL object
+	/// Assets whose last reference is released stay resident, least recently released first out, until the caches together are over budget
+	struct AssetCache
+	{
+		struct Entry
+		{
+			uint64_t id = 0;
+			size_t bytes = 0;
+			uint32_t refs = 0;
+			uint64_t releasedAt = 0;
+			std::list<uint64_t>::iterator lruPos{};
+		};
+		
+		/// Add a reference to a cached asset
+		/// \return The asset's ID, or 0 if nothing is cached under the key
+		uint64_t acquire(uint64_t key)
+		{
+			auto it = this->entries.find(key);
+			if(it == this->entries.end()) return 0;
+			Entry &entry = it->second;
+			if(entry.refs == 0) this->lru.erase(entry.lruPos);
+			entry.refs++;
+			return entry.id;
+		}
+		
+		/// Start tracking a newly created asset with a single reference
+		void add(uint64_t key, uint64_t id, size_t bytes)
+		{
+			this->entries[key] = Entry{id, bytes, 1};
+			this->keys[id] = key;
+			this->totalBytes += bytes;
+		}
+		
+		/// Drop a reference to an asset
+		/// \return False if the asset isn't cached, and should be deleted by the caller instead
+		bool release(uint64_t id)
+		{
+			auto keyIt = this->keys.find(id);
+			if(keyIt == this->keys.end()) return false;
+			Entry &entry = this->entries[keyIt->second];
+			
+			//Still true, the caller mustn't destroy an asset the cache holds on to
+			if(entry.refs == 0)
+			{
+				logger << Sev::ERR << "Releasing a cached asset that has no references left: " << id << logger.endl();
+				return true;
+			}
+			entry.refs--;
+			if(entry.refs == 0)
+			{
+				this->lru.push_front(keyIt->second);
+				entry.lruPos = this->lru.begin();
+				entry.releasedAt = ++releaseClock;
+			}
+			return true;
+		}
+		
+		/// Move an asset to the key of what it holds now, ie after a hot reload replaced its contents
+		/// \param key 0 if its contents no longer come from an archive, it's then still counted but never shared again
+		void rekey(uint64_t id, uint64_t key, size_t bytes)
+		{
+			auto keyIt = this->keys.find(id);
+			if(keyIt == this->keys.end()) return;
+			uint64_t const oldKey = keyIt->second;
+			
+			//Another asset may already be cached with the new contents, this one is then kept apart rather than merged into it
+			if(key == 0 || (key != oldKey && this->entries.contains(key))) key = xxHash64(&id, sizeof(id), oldKey);
+			auto node = this->entries.extract(oldKey);
+			Entry &entry = node.mapped();
+			this->totalBytes = this->totalBytes - entry.bytes + bytes;
+			entry.bytes = bytes;
+			if(entry.refs == 0) *entry.lruPos = key;
+			node.key() = key;
+			this->entries.insert(std::move(node));
+			keyIt->second = key;
+		}
+		
+		/// When the least recently released asset was released
+		/// \return UINT64_MAX if every cached asset is referenced
+		[[nodiscard]] uint64_t oldestRelease()
+		{
+			if(this->lru.empty()) return UINT64_MAX;
+			return this->entries[this->lru.back()].releasedAt;
+		}
+		
+		/// Destroy the least recently released asset, if there is one
+		template <typename F> void evictOldest(F const &destroy)
+		{
+			if(this->lru.empty()) return;
+			uint64_t key = this->lru.back();
+			this->lru.pop_back();
+			Entry const &entry = this->entries[key];
+			this->totalBytes -= entry.bytes;
+			this->keys.erase(entry.id);
+			destroy(entry.id);
+			this->entries.erase(key);
+		}
+		
+		void clear()
+		{
+			this->entries.clear();
+			this->keys.clear();
+			this->lru.clear();
+			this->totalBytes = 0;
+		}
+		
+		std::unordered_map<uint64_t, Entry> entries; //Cache key -> entry
+		std::unordered_map<uint64_t, uint64_t> keys; //Asset ID -> cache key
+		std::list<uint64_t> lru; //Keys of entries with no references, most recently released first
+		size_t totalBytes = 0;
+	};
+	
+	AssetCache textureCache, shaderCache;
+	size_t cacheBudget = 256 * 1024 * 1024;
+	
+	/// Identify a file in an archive, files that were content hashed when archived are identified by their content so identical files in different archives share a cache entry
+	/// \param variant Distinguishes different GPU objects made from the same file, ie sRGB and linear textures
+	/// \return The key, or 0 if the file isn't in the archive
+	uint64_t cacheKey(uint64_t asaID, SP<ASA> const &asa, std::string const &fileName, uint64_t variant = 0)
+	{
+		SP<ASAEntry> entry = asa ? asa->find(fileName) : nullptr;
+		if(!entry) return 0;
+		if(entry->hasHash) return xxHash64(&entry->hash, sizeof(entry->hash), variant);
+		return xxHash64(fileName, xxHash64(&asaID, sizeof(asaID), variant));
+	}
+	
+	uint64_t cacheKey(uint64_t first, uint64_t second)
+	{
+		if(first == 0 || second == 0) return 0;
+		uint64_t const pair[2] = {first, second};
+		return xxHash64(pair, sizeof(pair));
+	}
+	
+	size_t textureBytes(uint64_t id)
+	{
+		UP<Texture> &texture = textures.get(id);
+		if(!texture) return 0;
+		return texture->memory.bytes;
+	}
+	
+	/// Destroy released textures and shaders, least recently released first whichever cache it's in, until both together fit in the budget
+	void evictCaches()
+	{
+		while(textureCache.totalBytes + shaderCache.totalBytes > cacheBudget)
+		{
+			uint64_t const oldestTexture = textureCache.oldestRelease(), oldestShader = shaderCache.oldestRelease();
+			if(oldestTexture == UINT64_MAX && oldestShader == UINT64_MAX) break;
+			if(oldestTexture < oldestShader) textureCache.evictOldest([](uint64_t id){textures.erase(id);});
+			else shaderCache.evictOldest([](uint64_t id){shaders.erase(id);});
+		}
+	}
+	
+	std::queue<std::function<void()>> uploadQueue; //GL object creation for assets loaded in the background, drained by processUploads()
+	std::mutex uploadMtx;
+	std::atomic<bool> uploadsClosed = false; //Set by terminateUploads, after which background loads are dropped
+	
+	size_t loadsInFlight = 0; //Background loads queued on the thread pool or running, guarded by loadMtx
+	std::mutex loadMtx;
+	std::condition_variable loadsDone;
+	
+	void queueUpload(std::function<void()> const &upload)
+	{
+		std::lock_guard<std::mutex> lck {uploadMtx};
+		if(uploadsClosed) return;
+		uploadQueue.push(upload);
+	}
+	
+	/// Run a load on the thread pool, counted so terminateUploads can wait for it to finish before the assets it uploads into go away
+	template <typename F> void loadInBackground(F &&load)
+	{
+		{
+			std::lock_guard<std::mutex> lck {loadMtx};
+			loadsInFlight++;
+		}
+		threadPool.enqueue([load = std::forward<F>(load)]() mutable
+		{
+			if(!uploadsClosed) load(); //Loads that hadn't started by teardown are skipped
+			std::lock_guard<std::mutex> lck {loadMtx};
+			if(--loadsInFlight == 0) loadsDone.notify_all();
+		});
+	}
+	
+	UP<Texture> makeTexture(PNG const &decoded, bool srgb)
+	{
+		return MU<Texture>(const_cast<uint8_t*>(decoded.imageData.data()), decoded.width, decoded.height, decoded.colorFormat == 2 ? ColorFormat::RGB : ColorFormat::RGBA, InterpMode::Nearest, srgb);
+	}
+	
+	UP<Mesh> makeMesh(MeshData const &data)
+	{
+		if(data.numVertElements == 0) return nullptr;
+		if(!data.indices.empty())
+		{
+			VertexLayout layout{};
+			std::vector<uint8_t> records = data.interleave(layout);
+			return MU<Mesh>(records.data(), records.size() / layout.stride, layout, data.indices.data(), data.indices.size(), sizeof(uint32_t));
+		}
+		if(data.numUVElements > 0)
+		{
+			if(data.numNormalElements > 0) return MU<Mesh>(data.vertElements, data.uvElements, data.normalElements);
+			return MU<Mesh>(data.vertElements, data.uvElements);
+		}
+		return MU<Mesh>(data.vertElements);
+	}
+	
+	/// Upload a version 2 model straight from its file's buffer, version 1 models are de-interleaved first
+	UP<Mesh> makeMesh(MeshFile &file, SP<MeshEntry> const &entry)
+	{
+		if(!entry) return nullptr;
+		MeshView view = file.view(entry);
+		if(view.empty()) return makeMesh(file.read(entry));
+		return MU<Mesh>(view.vertices.data(), view.numVerts, view.layout, view.indices.empty() ? nullptr : view.indices.data(), view.numIndices, view.indexSize);
+	}
+	
+	uint64_t newTexture(PNG const &decoded, bool srgb)
+	{
+		return textures.insert(makeTexture(decoded, srgb));
+	}
+	
+	// Hot Reload -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+	
+	/// Where an asset loaded by filename came from, so it can be rebuilt when that file changes
+	struct AssetSource
+	{
+		uint64_t asaID = 0;
+		std::vector<std::string> fileNames; //Shaders have one per stage
+		bool srgb = false;
+		std::string modelName = ""; //Meshes also need the model within the mesh file
+	};
+	
+	std::unordered_map<uint64_t, AssetSource> textureSources, shaderSources, meshFileSources, meshSources;
+	std::unordered_map<uint64_t, std::string> asaPaths; //Archive ID -> path on disk
+	std::unordered_map<std::string, std::string> looseOverrides; //Filename -> path of a loose file that has replaced the archived copy
+	UP<FileWatcher> watcher = nullptr;
+	
+	std::string normalizePath(std::string const &path)
+	{
+		return std::filesystem::path(path).lexically_normal().string();
+	}
+	
+	std::string overridePath(std::string const &fileName)
+	{
+		auto it = looseOverrides.find(fileName);
+		return it == looseOverrides.end() ? "" : it->second;
+	}
+	
+	/// Read a file for reloading, from its loose override if it has one, otherwise from the archive, safe to call from workers
+	std::vector<uint8_t> readReloadSource(SP<ASA> const &asa, std::string const &loosePath, std::string const &fileName)
+	{
+		if(loosePath.empty()) return asa ? asa->read(fileName) : std::vector<uint8_t>{};
+		std::vector<uint8_t> out;
+		std::error_code ec;
+		size_t size = std::filesystem::file_size(loosePath, ec);
+		if(ec) return out;
+		FILE *in = openFile(loosePath, "rb");
+		if(!in) return out;
+		out.resize(size);
+		out.resize(readFile(in, out.data(), size));
+		closeFile(in);
+		return out;
+	}
+	
+	void reloadTexture(uint64_t id, AssetSource const &src)
+	{
+		std::string const &fileName = src.fileNames[0];
+		loadInBackground([id, asaID = src.asaID, asa = asaFiles.get(src.asaID), loosePath = overridePath(fileName), fileName, srgb = src.srgb]()
+		{
+			std::vector<uint8_t> data = readReloadSource(asa, loosePath, fileName);
+			if(data.empty()) return;
+			SP<PNG> decoded = MS<PNG>(decodePNG(data));
+			if(decoded->width == 0 || decoded->height == 0) return;
+			queueUpload([id, asaID, decoded, srgb, fileName, loose = !loosePath.empty()]()
+			{
+				UP<Texture> &texture = textures.get(id);
+				if(!texture) return;
+				texture = makeTexture(*decoded, srgb); //Swapped under the same handle
+				
+				//Cached under what it holds now, so loading the old contents doesn't hand out the new ones
+				textureCache.rekey(id, loose ? 0 : cacheKey(asaID, asaFiles.get(asaID), fileName, srgb), textureBytes(id));
+				evictCaches();
+			});
+		});
+	}
+	
+	void reloadShader(uint64_t id, AssetSource const &src)
+	{
+		std::vector<std::string> loosePaths;
+		for(auto const &fileName : src.fileNames) loosePaths.push_back(overridePath(fileName));
+		loadInBackground([id, asaID = src.asaID, asa = asaFiles.get(src.asaID), loosePaths, fileNames = src.fileNames]()
+		{
+			SP<std::vector<std::vector<uint8_t>>> stages = MS<std::vector<std::vector<uint8_t>>>();
+			for(size_t i = 0; i < fileNames.size(); i++)
+			{
+				stages->push_back(readReloadSource(asa, loosePaths[i], fileNames[i]));
+				if(stages->back().empty()) return;
+			}
+			bool const loose = std::any_of(loosePaths.begin(), loosePaths.end(), [](std::string const &path) { return !path.empty(); });
+			queueUpload([id, asaID, stages, fileNames, loose]()
+			{
+				UP<Shader> &shader = shaders.get(id);
+				if(!shader) return;
+				UP<Shader> fresh = stages->size() == 1 ? MU<Shader>((*stages)[0]) : MU<Shader>((*stages)[0], (*stages)[1]);
+				if(!fresh->linked)
+				{
+					logger << Sev::ERR << "Reloaded shader " << fileNames.back() << " failed to build, keeping the previous version" << logger.endl();
+					return;
+				}
+				shader = std::move(fresh);
+				
+				//Keyed the same way newShader keys it, by each stage's file
+				uint64_t key = 0;
+				SP<ASA> &current = asaFiles.get(asaID);
+				if(!loose && fileNames.size() == 1) key = cacheKey(asaID, current, fileNames[0]);
+				else if(!loose) key = cacheKey(cacheKey(asaID, current, fileNames[0]), cacheKey(asaID, current, fileNames[1]));
+				size_t bytes = 0;
+				for(auto const &stage : *stages) bytes += stage.size();
+				shaderCache.rekey(id, key, bytes);
+				evictCaches();
+			});
+		});
+	}
+	
+	void reloadMeshFile(uint64_t id, AssetSource const &src)
+	{
+		std::string const &fileName = src.fileNames[0];
+		loadInBackground([id, asa = asaFiles.get(src.asaID), loosePath = overridePath(fileName), fileName]()
+		{
+			std::vector<uint8_t> data = readReloadSource(asa, loosePath, fileName);
+			if(data.empty()) return;
+			SP<UP<MeshFile>> meshFile = MS<UP<MeshFile>>(MeshFile::open(std::move(data)));
+			if(!*meshFile) return;
+			queueUpload([id, meshFile]()
+			{
+				UP<MeshFile> &slot = meshFiles.get(id);
+				if(slot) slot = std::move(*meshFile);
+			});
+		});
+	}
+	
+	void reloadMesh(uint64_t id, AssetSource const &src)
+	{
+		std::string const &fileName = src.fileNames[0];
+		loadInBackground([id, asa = asaFiles.get(src.asaID), loosePath = overridePath(fileName), fileName, modelName = src.modelName]()
+		{
+			std::vector<uint8_t> fileData = readReloadSource(asa, loosePath, fileName);
+			if(fileData.empty()) return;
+			SP<MeshFile> meshFile = MeshFile::open(std::move(fileData));
+			auto entry = meshFile ? meshFile->find(modelName) : nullptr;
+			if(!entry) return;
+			queueUpload([id, meshFile, entry]()
+			{
+				UP<Mesh> &mesh = meshes.get(id);
+				UP<Mesh> fresh = makeMesh(*meshFile, entry);
+				if(mesh && fresh) mesh = std::move(fresh);
+			});
+		});
+	}
+	
+	void reloadAtlasTile(uint64_t id, SP<ASA> const &asa, std::string const &fileName)
+	{
+		loadInBackground([id, asa, loosePath = overridePath(fileName), fileName]()
+		{
+			std::vector<uint8_t> data = readReloadSource(asa, loosePath, fileName);
+			if(data.empty()) return;
+			SP<PNG> decoded = MS<PNG>(decodePNG(data));
+			if(decoded->width == 0 || decoded->height == 0) return;
+			queueUpload([id, decoded, fileName]()
+			{
+				UP<Atlas> &atlas = atlases.get(id);
+				ColorFormat fmt = decoded->colorFormat == PNG::COLOR_FMT_GREY ? ColorFormat::GREY : decoded->colorFormat == PNG::COLOR_FMT_RGB ? ColorFormat::RGB : ColorFormat::RGBA;
+				if(atlas) atlas->replaceTile(fileName, fmt, std::move(decoded->imageData), decoded->width, decoded->height);
+			});
+		});
+	}
+	
+	/// Rebuild everything that was loaded from the given file
+	/// \param asaID The archive the file changed in, or 0 if a loose file changed, which overrides that filename in every archive
+	void reloadFile(uint64_t asaID, std::string const &fileName)
+	{
+		auto affected = [asaID, &fileName](AssetSource const &src)
+		{
+			if(asaID != 0 && src.asaID != asaID) return false;
+			for(auto const &name : src.fileNames) if(name == fileName) return true;
+			return false;
+		};
+		auto reloadAll = [&affected](auto &sources, auto const &table, auto const &reload)
+		{
+			for(auto it = sources.begin(); it != sources.end();)
+			{
+				if(!table.contains(it->first)) it = sources.erase(it); //The asset's been deleted since it was loaded
+				else
+				{
+					if(affected(it->second)) reload(it->first, it->second);
+					it++;
+				}
+			}
+		};
+		reloadAll(textureSources, textures, reloadTexture);
+		reloadAll(shaderSources, shaders, reloadShader);
+		reloadAll(meshFileSources, meshFiles, reloadMeshFile);
+		reloadAll(meshSources, meshes, reloadMesh);
+		SP<ASA> asa = asaFiles.get(asaID);
+		atlases.forEach([&asa, &fileName](uint64_t id, UP<Atlas> &atlas)
+		{
+			if(atlas && atlas->contains(fileName)) reloadAtlasTile(id, asa, fileName);
+		});
+	}
+	
+	/// Reopen an archive that's been rewritten on disk, and reload only the entries whose contents changed
+	void reloadArchive(uint64_t asaID, std::string const &path)
+	{
+		loadInBackground([asaID, path, old = asaFiles.get(asaID)]()
+		{
+			SP<ASA> fresh = nullptr;
+			try
+			{
+				fresh = ASA::open(path);
+			}
+			catch(std::exception const &e)
+			{
+				logger << Sev::ERR << "Failed to reload archive " << path << ": " << e.what() << logger.endl();
+				return;
+			}
+			if(!fresh) return;
+			SP<std::vector<std::string>> changed = MS<std::vector<std::string>>();
+			for(auto const &entry : fresh->toc)
+			{
+				SP<ASAEntry> prev = old ? old->find(entry->filename) : nullptr;
+				bool same = prev && prev->decompressedSize == entry->decompressedSize;
+				if(same && prev->hasHash && entry->hasHash) same = prev->hash == entry->hash;
+				else if(same) same = prev->offset == entry->offset && prev->compressedSize == entry->compressedSize; //Unhashed archives can only be compared by layout
+				if(!same) changed->push_back(entry->filename);
+			}
+			queueUpload([asaID, fresh, changed]()
+			{
+				SP<ASA> &asa = asaFiles.get(asaID);
+				if(!asa) return;
+				asa = fresh;
+				for(auto const &fileName : *changed) reloadFile(asaID, fileName);
+			});
+		});
+	}
+	
+	/// Batched sprites, the renderer draws instances of one quad and each reads its transform, UVs and tint from the sprite storage buffer
+	/// Built from source since it's bound to the renderer's FrameUniforms and SpriteInstance layouts
+	char const *const spriteVertSrc = R"(#version 450
+
+layout(location = 0) in vec3 pos;
+out vec2 uv;
+out vec4 tint;
+
+layout(std140, binding = 0) uniform Frame
+{
+	mat4 view;
+	mat4 projection;
+	vec4 resolution;
+	float time;
+	float delta;
+} frame;
+
+struct Sprite
+{
+	mat4 model;
+	vec4 uvRect;
+	vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer Sprites
+{
+	Sprite sprites[];
+};
+
+uniform uint firstSprite;
+
+void main()
+{
+	Sprite sprite = sprites[firstSprite + gl_InstanceID];
+	uv = vec2(pos.x > 0.0 ? sprite.uvRect.z : sprite.uvRect.x, pos.y > 0.0 ? sprite.uvRect.y : sprite.uvRect.w);
+	tint = sprite.color;
+	gl_Position = frame.projection * frame.view * sprite.model * vec4(pos, 1.0);
+}
+)";
+	
+	/// Batched sprites and glyphs, glyphs are white in the glyph atlas so their color comes entirely from the tint
+	char const *const spriteFragSrc = R"(#version 450
+
+in vec2 uv;
+in vec4 tint;
+layout(binding = 0) uniform sampler2D tex;
+out vec4 fragColor;
+
+void main()
+{
+	fragColor = texture(tex, uv) * tint;
+}
+)";
+	
+	/// Halves an image, sampled bilinearly so each tap averages four texels
+	/// Every level of a chain costs a quarter of the one above, so a whole chain is a fixed fraction of a full resolution pass whatever its radius
+	char const *const mipDownCompSrc = R"(#version 450
+
+#ifndef HIGH_QUALITY
+#define HIGH_QUALITY 0
+#endif
+#ifndef PREFILTER
+#define PREFILTER 0
+#endif
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+layout(binding = 0) uniform sampler2D source;
+layout(binding = 0) uniform writeonly image2D imageOut; //No format, stores convert to whatever the bound level is
+
+uniform float threshold;
+uniform float knee;
+
+vec4 tap(vec2 uv)
+{
+	return texture(source, uv);
+}
+
+//Alpha is scaled with the color, images are premultiplied so what's kept covers as much as it glows
+vec4 prefilter(vec4 color)
+{
+	float brightness = max(color.r, max(color.g, color.b));
+	float soft = clamp(brightness - threshold + knee, 0.0f, 2.0f * knee);
+	soft = soft * soft / (4.0f * knee + 0.00001f);
+	return color * (max(soft, brightness - threshold) / max(brightness, 0.00001f));
+}
+
+void main()
+{
+	ivec2 current = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(imageOut);
+	if(current.x >= size.x || current.y >= size.y) return;
+	vec2 uv = (vec2(current) + 0.5f) / vec2(size);
+	vec2 texel = 1.0f / vec2(textureSize(source, 0));
+#if HIGH_QUALITY
+	vec4 outer = tap(uv + texel * vec2(-2, 2)) + tap(uv + texel * vec2(2, 2)) + tap(uv + texel * vec2(-2, -2)) + tap(uv + texel * vec2(2, -2));
+	vec4 edges = tap(uv + texel * vec2(0, 2)) + tap(uv + texel * vec2(-2, 0)) + tap(uv + texel * vec2(2, 0)) + tap(uv + texel * vec2(0, -2));
+	vec4 inner = tap(uv + texel * vec2(-1, 1)) + tap(uv + texel * vec2(1, 1)) + tap(uv + texel * vec2(-1, -1)) + tap(uv + texel * vec2(1, -1));
+	vec4 color = tap(uv) * 0.125f + outer * 0.03125f + edges * 0.0625f + inner * 0.125f;
+#else
+	vec4 color = tap(uv) * 4.0f + tap(uv - texel) + tap(uv + texel) + tap(uv + vec2(texel.x, -texel.y)) + tap(uv - vec2(texel.x, -texel.y));
+	color *= 0.125f;
+#endif
+#if PREFILTER
+	color = prefilter(color);
+#endif
+	imageStore(imageOut, current, color);
+}
+)";
+	
+	/// Doubles a level of a mip chain, the source is sampled bilinearly and the level being written is read from the same texel
+	char const *const mipUpCompSrc = R"(#version 450
+
+#ifndef HIGH_QUALITY
+#define HIGH_QUALITY 0
+#endif
+#ifndef ACCUMULATE
+#define ACCUMULATE 0
+#endif
+#ifndef LOCAL_SIZE_X
+#define LOCAL_SIZE_X 8
+#endif
+#ifndef LOCAL_SIZE_Y
+#define LOCAL_SIZE_Y 8
+#endif
+
+layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;
+layout(binding = 0) uniform sampler2D source;
+layout(binding = 1) uniform sampler2D base;
+layout(binding = 0) uniform writeonly image2D imageOut; //No format, stores convert to whatever the bound level is
+
+uniform float radius;
+uniform float intensity;
+
+vec4 tap(vec2 uv)
+{
+	return texture(source, uv);
+}
+
+void main()
+{
+	ivec2 current = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(imageOut);
+	if(current.x >= size.x || current.y >= size.y) return;
+	vec2 uv = (vec2(current) + 0.5f) / vec2(size);
+	vec2 offset = radius / vec2(textureSize(source, 0));
+#if HIGH_QUALITY
+	vec4 corners = tap(uv + offset * vec2(-1, 1)) + tap(uv + offset * vec2(1, 1)) + tap(uv + offset * vec2(-1, -1)) + tap(uv + offset * vec2(1, -1));
+	vec4 edges = tap(uv + offset * vec2(0, 1)) + tap(uv + offset * vec2(-1, 0)) + tap(uv + offset * vec2(1, 0)) + tap(uv + offset * vec2(0, -1));
+	vec4 color = (tap(uv) * 4.0f + edges * 2.0f + corners) / 16.0f;
+#else
+	vec4 edges = tap(uv + offset * vec2(-2, 0)) + tap(uv + offset * vec2(2, 0)) + tap(uv + offset * vec2(0, 2)) + tap(uv + offset * vec2(0, -2));
+	vec4 corners = tap(uv + offset * vec2(-1, 1)) + tap(uv + offset * vec2(1, 1)) + tap(uv + offset * vec2(-1, -1)) + tap(uv + offset * vec2(1, -1));
+	vec4 color = (edges + corners * 2.0f) / 12.0f;
+#endif
+#if ACCUMULATE
+	//The upsampled glow goes over what's under it, so it covers transparent texels it spreads onto as much as it lights them
+	vec4 under = texelFetch(base, current, 0);
+	vec4 glow = color * intensity;
+	imageStore(imageOut, current, vec4(under.rgb + glow.rgb, under.a + glow.a * (1.0f - under.a)));
+#else
+	imageStore(imageOut, current, color);
+#endif
+}
+)";
+	
 	void init()
 	{
 		engineASA = ASA::open(getCWD() + "engine.asa");
@@ -52,409 +689,605 @@ namespace AssetRepository
 		
 		textureFallback =           newTexture(engineASA->read("fallback.png"));
 		
+		//Engine shaders come from the binary cache when they were built on a previous run, the rest build together so the driver can overlap them
+		PC::init(getCWD() + "shadercache");
+		WGT::init(getCWD() + "shadercache/workgroups.bin");
+		Shader::beginBatch();
 		shaderObject =              newShader(engineASA->read("default.vert"), engineASA->read("default.frag"));
 		shaderTransfer =            newShader(engineASA->read("transfer.vert"), engineASA->read("transfer.frag"));
 		shaderLine =                newShader(engineASA->read("line.vert"), engineASA->read("line.frag"));
 		shaderText =                newShader(engineASA->read("default.vert"), engineASA->read("text.frag"));
+		shaderSprite =              newShaderSrc(spriteVertSrc, spriteFragSrc);
+		Shader::endBatch();
 		
-		shaderBloom =               newShader(engineASA->read("bloom.comp"));
-		shaderBloomComposite =      newShader(engineASA->read("bloomComposite.comp"));
-		shaderBloomSig =            newShader(engineASA->read("bloomSigmoid.comp"));
-		shaderBlur3X =              newShader(engineASA->read("blur3X.comp"));
-		shaderBlur3Y =              newShader(engineASA->read("blur3Y.comp"));
-		shaderBlur5X =              newShader(engineASA->read("blur5X.comp"));
-		shaderBlur5Y =              newShader(engineASA->read("blur5Y.comp"));
-		shaderBlur7X =              newShader(engineASA->read("blur7X.comp"));
-		shaderBlur7Y =              newShader(engineASA->read("blur7Y.comp"));
-		shaderBlur9X =              newShader(engineASA->read("blur9X.comp"));
-		shaderBlur9Y =              newShader(engineASA->read("blur9Y.comp"));
-		shaderBlur11X =             newShader(engineASA->read("blur11X.comp"));
-		shaderBlur11Y =             newShader(engineASA->read("blur11Y.comp"));
-		shaderBlur13X =             newShader(engineASA->read("blur13X.comp"));
-		shaderBlur13Y =             newShader(engineASA->read("blur13Y.comp"));
-		shaderDither =              newShader(engineASA->read("dither.comp"));
-		shaderTonemapACES =         newShader(engineASA->read("tonemapACES.comp"));
-		shaderTonemapFilmic =       newShader(engineASA->read("tonemapFilmic.comp"));
-		shaderTonemapSRGB =         newShader(engineASA->read("tonemapSRGB.comp"));
-		shaderTonemapUncharted2 =   newShader(engineASA->read("tonemapUncharted2.comp"));
-		shaderVignette =            newShader(engineASA->read("vignette.comp"));
+		//Post processing variants are compiled the first time a pass asks for them, the per pixel passes generate their own kernels
+		shaderFamilyMipDown =       newShaderFamily(mipDownCompSrc);
+		shaderFamilyMipUp =         newShaderFamily(mipUpCompSrc);
 	}
 	
 	uint64_t loadASA(std::string const &filePath)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < asaFiles.size(); i++)
-		{
-			if(!asaFiles[i])
-			{
-				index = i;
-				break;
-			}
-		}
-		if(index == 0)
-		{
-			asaFiles.push_back(ASA::open(filePath));
-			index = static_cast<uint64_t>(asaFiles.size() - 1);
-		}
-		else
-		{
-			asaFiles[index] = ASA::open(filePath);
-		}
-		return index;
+		SP<ASA> asa = ASA::open(filePath);
+		if(!asa) return 0;
+		uint64_t id = asaFiles.insert(std::move(asa));
+		asaPaths[id] = normalizePath(filePath);
+		return id;
 	}
 	
 	uint64_t loadMeshFile(uint64_t asaID, std::string const &fileName)
 	{
 		std::vector<uint8_t> meshData = getFileFromASA(asaID, fileName);
 		if(meshData.empty()) return 0;
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < meshFiles.size(); i++)
-		{
-			if(!meshFiles[i])
-			{
-				index = i;
-				break;
-			}
-		}
-		if(index == 0)
-		{
-			meshFiles.push_back(MeshFile::open(meshData));
-			index = static_cast<uint32_t>(meshFiles.size() - 1);
-		}
-		else
-		{
-			meshFiles[index] = MeshFile::open(meshData);
-		}
-		return index;
+		uint64_t id = meshFiles.insert(MeshFile::open(std::move(meshData)));
+		meshFileSources[id] = AssetSource{asaID, {fileName}};
+		return id;
 	}
 	
 	uint64_t newTexture(uint64_t asaID, std::string const &fileName, bool srgb)
 	{
+		uint64_t key = cacheKey(asaID, asaFiles.get(asaID), fileName, srgb);
+		if(key == 0) return 0;
+		if(uint64_t cached = textureCache.acquire(key)) return cached;
 		std::vector<uint8_t> data = getFileFromASA(asaID, fileName);
 		if(data.empty()) return 0;
-		return newTexture(data, srgb);
+		uint64_t id = newTexture(data, srgb);
+		textureCache.add(key, id, textureBytes(id));
+		textureSources[id] = AssetSource{asaID, {fileName}, srgb};
+		evictCaches();
+		return id;
 	}
 	
 	uint64_t newShader(uint64_t asaID, std::string const &compFileName)
 	{
+		uint64_t key = cacheKey(asaID, asaFiles.get(asaID), compFileName);
+		if(key == 0) return 0;
+		if(uint64_t cached = shaderCache.acquire(key)) return cached;
 		std::vector<uint8_t> compData = getFileFromASA(asaID, compFileName);
 		if(compData.empty()) return 0;
-		return newShader(compData);
+		uint64_t id = newShader(compData);
+		shaderCache.add(key, id, compData.size());
+		shaderSources[id] = AssetSource{asaID, {compFileName}};
+		evictCaches();
+		return id;
 	}
 	
 	uint64_t newShader(uint64_t asaID, std::string const &vertFileName, std::string const &fragFileName)
 	{
+		SP<ASA> &asa = asaFiles.get(asaID);
+		uint64_t key = cacheKey(cacheKey(asaID, asa, vertFileName), cacheKey(asaID, asa, fragFileName));
+		if(key == 0) return 0;
+		if(uint64_t cached = shaderCache.acquire(key)) return cached;
 		std::vector<uint8_t> vertData = getFileFromASA(asaID, vertFileName);
 		std::vector<uint8_t> fragData = getFileFromASA(asaID, fragFileName);
 		if(vertData.empty() || fragData.empty()) return 0;
-		return newShader(vertData, fragData);
+		uint64_t id = newShader(vertData, fragData);
+		shaderCache.add(key, id, vertData.size() + fragData.size());
+		shaderSources[id] = AssetSource{asaID, {vertFileName, fragFileName}};
+		evictCaches();
+		return id;
 	}
 	
 	uint64_t newMesh(uint64_t meshID, std::string const &modelName) //TODO repo for model files
 	{
-		MeshData data = getMesh(meshID, modelName);
-		if(data.numVertElements > 0)
-		{
-			if(data.numUVElements >0)
-			{
-				if(data.numNormalElements > 0)
-				{
-					return newMesh(data.vertElements, data.uvElements, data.normalElements);
-				}
-				return newMesh(data.vertElements, data.uvElements);
-			}
-			return newMesh(data.vertElements);
-		}
-		return 0;
+		UP<MeshFile> &meshFile = meshFiles.get(meshID);
+		if(!meshFile) return 0;
+		UP<Mesh> mesh = makeMesh(*meshFile, meshFile->find(modelName));
+		if(!mesh) return 0;
+		uint64_t id = meshes.insert(std::move(mesh));
+		auto src = meshFileSources.find(meshID);
+		if(src != meshFileSources.end()) meshSources[id] = AssetSource{src->second.asaID, src->second.fileNames, false, modelName};
+		return id;
 	}
 	
 	uint64_t newTexture(std::vector<uint8_t> const &textureData, bool srgb)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < textures.size(); i++)
-		{
-			if(!textures[i])
-			{
-				index = i;
-				break;
-			}
-		}
-		if(index == 0)
-		{
-			PNG tmp = decodePNG(textureData);
-			textures.push_back(MU<Texture>(tmp.imageData.data(), tmp.width, tmp.height, tmp.colorFormat == 2 ? ColorFormat::RGB : ColorFormat::RGBA, InterpMode::Nearest, srgb));
-			index = static_cast<uint32_t>(textures.size() - 1);
-		}
-		else
-		{
-			PNG tmp = decodePNG(textureData);
-			textures[index] = MU<Texture>(tmp.imageData.data(), tmp.width, tmp.height, tmp.colorFormat == 2 ? ColorFormat::RGB : ColorFormat::RGBA, InterpMode::Nearest, srgb);
-		}
-		return index;
+		return newTexture(decodePNG(textureData), srgb);
 	}
 	
 	uint64_t newTexture(uint32_t width, uint32_t height, ColorFormat format, InterpMode mode)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < textures.size(); i++)
-		{
-			if(!textures[i])
-			{
-				index = i;
-				break;
-			}
-		}
-		if(index == 0)
-		{
-			textures.push_back(MU<Texture>(width, height, format, mode));
-			index = (uint32_t)(textures.size() - 1);
-		}
-		else textures[index] = MU<Texture>(width, height, format, mode);
-		return index;
+		return textures.insert(MU<Texture>(width, height, format, mode));
 	}
 	
 	uint64_t newTexture(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < textures.size(); i++)
-		{
-			if(!textures[i])
-			{
-				index = i;
-				break;
-			}
-		}
-		if(index == 0)
-		{
-			textures.push_back(MU<Texture>(r, g, b, a));
-			index = (uint32_t)(textures.size() - 1);
-		}
-		else textures[index] = MU<Texture>(r, g, b, a);
-		return index;
+		return textures.insert(MU<Texture>(r, g, b, a));
 	}
 	
 	uint64_t newShader(std::vector<uint8_t> const &compShaderData)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < shaders.size(); i++)
+		return shaders.insert(MU<Shader>(compShaderData));
+	}
+	
+	uint64_t newShader(std::vector<uint8_t> const &vertShaderData, std::vector<uint8_t> const &fragShaderData)
+	{
+		return shaders.insert(MU<Shader>(vertShaderData, fragShaderData));
+	}
+	
+	uint64_t newShaderSrc(std::string const &compSrc)
+	{
+		return shaders.insert(MU<Shader>(compSrc));
+	}
+	
+	uint64_t newShaderSrc(std::string const &vertSrc, std::string const &fragSrc)
+	{
+		return shaders.insert(MU<Shader>(vertSrc, fragSrc));
+	}
+	
+	uint64_t newShaderFamily(std::string const &compSrc)
+	{
+		ShaderFamily family;
+		family.compSrc = compSrc;
+		return shaderFamilies.insert(std::move(family));
+	}
+	
+	uint64_t newShaderFamily(std::string const &vertSrc, std::string const &fragSrc)
+	{
+		ShaderFamily family;
+		family.vertSrc = vertSrc;
+		family.fragSrc = fragSrc;
+		return shaderFamilies.insert(std::move(family));
+	}
+	
+	uint64_t getShaderVariant(uint64_t familyID, std::vector<ShaderDefine> const &defines)
+	{
+		if(!shaderFamilies.contains(familyID))
 		{
-			if(!shaders[i])
+			logger << Sev::ERR << "Trying to get a variant of an invalid or deleted shader family: " << familyID << logger.endl();
+			return 0;
+		}
+		ShaderFamily &family = shaderFamilies.get(familyID);
+		uint64_t const key = Shader::variantKey(defines);
+		auto it = family.variants.find(key);
+		if(it != family.variants.end()) return it->second;
+		
+		uint64_t id = 0;
+		if(!family.compSrc.empty())
+		{
+			//Built with the local size tuned for this device, when there is one
+			std::vector<ShaderDefine> sized = defines;
+			if(std::optional<WGT::Size> size = WGT::localSize(family.compSrc, defines))
 			{
-				index = i;
-				break;
+				sized.push_back({"LOCAL_SIZE_X", size->x});
+				sized.push_back({"LOCAL_SIZE_Y", size->y});
 			}
+			id = newShaderSrc(Shader::applyDefines(family.compSrc, sized));
 		}
-		if(index == 0)
+		else id = newShaderSrc(Shader::applyDefines(family.vertSrc, defines), Shader::applyDefines(family.fragSrc, defines));
+		family.variants.emplace(key, id);
+		return id;
+	}
+	
+	void prewarmShaderVariants(uint64_t familyID, std::vector<std::vector<ShaderDefine>> const &variants)
+	{
+		//Tuning needs linked programs to time, so variants that still need it are tuned before the batch starts
+		if(WGT::enabled() && shaderFamilies.contains(familyID) && !shaderFamilies.get(familyID).compSrc.empty())
 		{
-			shaders.push_back(MU<Shader>(compShaderData));
-			index = (uint32_t)(shaders.size() - 1);
+			for(auto const &defines : variants) static_cast<void>(WGT::localSize(shaderFamilies.get(familyID).compSrc, defines));
 		}
-		else shaders[index] = MU<Shader>(compShaderData);
-		return index;
+		Shader::beginBatch();
+		for(auto const &defines : variants) static_cast<void>(getShaderVariant(familyID, defines));
+		Shader::endBatch();
 	}
 	
-	uint64_t newShader(std::vector<uint8_t> const &vertShaderData, std::vector<uint8_t> const &fragShaderData)
+	uint64_t newMesh(std::vector<float> const &verts)
+	{
+		return meshes.insert(MU<Mesh>(verts));
+	}
+	
+	uint64_t newMesh(std::vector<float> const &verts, std::vector<float> const &uvs)
+	{
+		return meshes.insert(MU<Mesh>(verts, uvs));
+	}
+	
+	uint64_t newMesh(std::vector<float> const &verts, std::vector<float> const &uvs, std::vector<float> const &normals)
+	{
+		return meshes.insert(MU<Mesh>(verts, uvs, normals));
+	}
+	
+	uint64_t newAtlas()
+	{
+		return atlases.insert(MU<Atlas>());
+	}
+	
+	uint64_t newFont(uint64_t asaID, std::string const &fileName, uint32_t cellWidth, uint32_t cellHeight, char32_t firstCodepoint)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < shaders.size(); i++)
+		std::vector<uint8_t> data = getFileFromASA(asaID, fileName);
+		if(data.empty())
 		{
-			if(!shaders[i])
-			{
-				index = i;
-				break;
-			}
+			logger << Sev::ERR << "Failed to read font sheet " << fileName << logger.endl();
+			return 0;
 		}
-		if(index == 0)
+		return newFont(MU<BitmapFont>(decodePNG(data), cellWidth, cellHeight, firstCodepoint));
+	}
+	
+	uint64_t newFont(UP<Font> &&font)
+	{
+		return font ? fonts.insert(std::move(font)) : 0;
+	}
+	
+	void releaseAsync(AsyncAsset::State const &state)
+	{
+		switch(state.kind)
 		{
-			shaders.push_back(MU<Shader>(vertShaderData, fragShaderData));
-			index = (uint32_t)(shaders.size() - 1);
+			case AsyncAsset::Kind::TEXTURE: deleteTexture(state.id); break;
+			case AsyncAsset::Kind::SHADER: deleteShader(state.id); break;
+			case AsyncAsset::Kind::MESH: deleteMesh(state.id); break;
 		}
-		else shaders[index] = MU<Shader>(vertShaderData, fragShaderData);
-		return index;
 	}
 	
-	uint64_t newShaderSrc(std::string const &compSrc)
+	void AsyncAsset::release()
+	{
+		//A pending load sees the flag and gives its reference back once it's uploaded, failed loads never took one
+		if(!this->state || this->state->released.exchange(true)) return;
+		if(this->state->status == Status::READY) releaseAsync(*this->state);
+	}
+	
+	AsyncAsset loadTextureAsync(uint64_t asaID, std::string const &fileName, bool srgb)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < shaders.size(); i++)
+		AsyncAsset out{MS<AsyncAsset::State>(), textureFallback};
+		out.state->kind = AsyncAsset::Kind::TEXTURE;
+		SP<ASA> asa = asaFiles.get(asaID);
+		if(!asa)
 		{
-			if(!shaders[i])
-			{
-				index = i;
-				break;
-			}
+			logger << Sev::ERR << "Trying to load a texture from an invalid ASA ID: " << asaID << logger.endl();
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
+		}
+		uint64_t key = cacheKey(asaID, asa, fileName, srgb);
+		if(key == 0)
+		{
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		if(index == 0)
+		if(uint64_t cached = textureCache.acquire(key))
 		{
-			shaders.push_back(MU<Shader>(compSrc));
-			index = (uint32_t)(shaders.size() - 1);
+			out.state->id = cached;
+			out.state->status = AsyncAsset::Status::READY;
+			return out;
 		}
-		else shaders[index] = MU<Shader>(compSrc);
-		return index;
+		loadInBackground([asa, asaID, fileName, srgb, key, state = out.state]()
+		{
+			if(state->released) return; //Released before it started, nothing to read
+			std::vector<uint8_t> data = asa->read(fileName);
+			if(data.empty())
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			SP<PNG> decoded = MS<PNG>(decodePNG(data));
+			if(decoded->width == 0 || decoded->height == 0)
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			queueUpload([decoded, asaID, fileName, srgb, key, state]()
+			{
+				uint64_t id = textureCache.acquire(key); //Another load of the same file may have finished first
+				if(id == 0)
+				{
+					id = newTexture(*decoded, srgb);
+					textureCache.add(key, id, textureBytes(id));
+					textureSources[id] = AssetSource{asaID, {fileName}, srgb};
+					evictCaches();
+				}
+				state->id = id;
+				state->status = AsyncAsset::Status::READY;
+				if(state->released) releaseAsync(*state); //Released while it was loading, so the reference taken here is given straight back
+			});
+		});
+		return out;
 	}
 	
-	uint64_t newShaderSrc(std::string const &vertSrc, std::string const &fragSrc)
+	AsyncAsset loadShaderAsync(uint64_t asaID, std::string const &compFileName)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < shaders.size(); i++)
+		AsyncAsset out{MS<AsyncAsset::State>(), 0};
+		out.state->kind = AsyncAsset::Kind::SHADER;
+		SP<ASA> asa = asaFiles.get(asaID);
+		if(!asa)
 		{
-			if(!shaders[i])
-			{
-				index = i;
-				break;
-			}
+			logger << Sev::ERR << "Trying to load a shader from an invalid ASA ID: " << asaID << logger.endl();
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		if(index == 0)
+		uint64_t key = cacheKey(asaID, asa, compFileName);
+		if(key == 0)
 		{
-			shaders.push_back(MU<Shader>(vertSrc, fragSrc));
-			index = (uint32_t)(shaders.size() - 1);
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		else shaders[index] = MU<Shader>(vertSrc, fragSrc);
-		return index;
+		if(uint64_t cached = shaderCache.acquire(key))
+		{
+			out.state->id = cached;
+			out.state->status = AsyncAsset::Status::READY;
+			return out;
+		}
+		loadInBackground([asa, asaID, compFileName, key, state = out.state]()
+		{
+			if(state->released) return; //Released before it started, nothing to read
+			SP<std::vector<uint8_t>> compData = MS<std::vector<uint8_t>>(asa->read(compFileName));
+			if(compData->empty())
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			queueUpload([compData, asaID, compFileName, key, state]()
+			{
+				uint64_t id = shaderCache.acquire(key);
+				if(id == 0)
+				{
+					id = newShader(*compData);
+					shaderCache.add(key, id, compData->size());
+					shaderSources[id] = AssetSource{asaID, {compFileName}};
+					evictCaches();
+				}
+				state->id = id;
+				state->status = AsyncAsset::Status::READY;
+				if(state->released) releaseAsync(*state); //Released while it was loading, so the reference taken here is given straight back
+			});
+		});
+		return out;
 	}
 	
-	uint64_t newMesh(std::vector<float> const &verts)
+	AsyncAsset loadShaderAsync(uint64_t asaID, std::string const &vertFileName, std::string const &fragFileName)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < meshes.size(); i++)
+		AsyncAsset out{MS<AsyncAsset::State>(), shaderObject};
+		out.state->kind = AsyncAsset::Kind::SHADER;
+		SP<ASA> asa = asaFiles.get(asaID);
+		if(!asa)
 		{
-			if(!meshes[i])
-			{
-				index = i;
-				break;
-			}
+			logger << Sev::ERR << "Trying to load a shader from an invalid ASA ID: " << asaID << logger.endl();
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		if(index == 0)
+		uint64_t key = cacheKey(cacheKey(asaID, asa, vertFileName), cacheKey(asaID, asa, fragFileName));
+		if(key == 0)
 		{
-			meshes.push_back(MU<Mesh>(verts));
-			index = (uint32_t)(meshes.size() - 1);
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		else meshes[index] = MU<Mesh>(verts);
-		return index;
+		if(uint64_t cached = shaderCache.acquire(key))
+		{
+			out.state->id = cached;
+			out.state->status = AsyncAsset::Status::READY;
+			return out;
+		}
+		loadInBackground([asa, asaID, vertFileName, fragFileName, key, state = out.state]()
+		{
+			if(state->released) return; //Released before it started, nothing to read
+			SP<std::vector<uint8_t>> vertData = MS<std::vector<uint8_t>>(asa->read(vertFileName));
+			SP<std::vector<uint8_t>> fragData = MS<std::vector<uint8_t>>(asa->read(fragFileName));
+			if(vertData->empty() || fragData->empty())
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			queueUpload([vertData, fragData, asaID, vertFileName, fragFileName, key, state]()
+			{
+				uint64_t id = shaderCache.acquire(key);
+				if(id == 0)
+				{
+					id = newShader(*vertData, *fragData);
+					shaderCache.add(key, id, vertData->size() + fragData->size());
+					shaderSources[id] = AssetSource{asaID, {vertFileName, fragFileName}};
+					evictCaches();
+				}
+				state->id = id;
+				state->status = AsyncAsset::Status::READY;
+				if(state->released) releaseAsync(*state); //Released while it was loading, so the reference taken here is given straight back
+			});
+		});
+		return out;
 	}
 	
-	uint64_t newMesh(std::vector<float> const &verts, std::vector<float> const &uvs)
+	AsyncAsset loadMeshAsync(uint64_t asaID, std::string const &meshFileName, std::string const &modelName)
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < meshes.size(); i++)
+		AsyncAsset out{MS<AsyncAsset::State>(), meshOrthoQuadC};
+		out.state->kind = AsyncAsset::Kind::MESH;
+		SP<ASA> asa = asaFiles.get(asaID);
+		if(!asa)
 		{
-			if(!meshes[i])
-			{
-				index = i;
-				break;
-			}
+			logger << Sev::ERR << "Trying to load a mesh from an invalid ASA ID: " << asaID << logger.endl();
+			out.state->status = AsyncAsset::Status::FAILED;
+			return out;
 		}
-		if(index == 0)
+		loadInBackground([asa, asaID, meshFileName, modelName, state = out.state]()
 		{
-			meshes.push_back(MU<Mesh>(verts, uvs));
-			index = (uint32_t)(meshes.size() - 1);
-		}
-		else meshes[index] = MU<Mesh>(verts, uvs);
-		return index;
+			if(state->released) return; //Released before it started, nothing to read
+			std::vector<uint8_t> fileData = asa->read(meshFileName);
+			if(fileData.empty())
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			SP<MeshFile> meshFile = MeshFile::open(std::move(fileData));
+			auto entry = meshFile ? meshFile->find(modelName) : nullptr;
+			if(!entry)
+			{
+				state->status = AsyncAsset::Status::FAILED;
+				return;
+			}
+			queueUpload([meshFile, entry, asaID, meshFileName, modelName, state]()
+			{
+				UP<Mesh> mesh = makeMesh(*meshFile, entry);
+				if(!mesh)
+				{
+					state->status = AsyncAsset::Status::FAILED;
+					return;
+				}
+				uint64_t id = meshes.insert(std::move(mesh));
+				meshSources[id] = AssetSource{asaID, {meshFileName}, false, modelName};
+				state->id = id;
+				state->status = AsyncAsset::Status::READY;
+				if(state->released) releaseAsync(*state); //Released while it was loading, so the reference taken here is given straight back
+			});
+		});
+		return out;
 	}
 	
-	uint64_t newMesh(std::vector<float> const &verts, std::vector<float> const &uvs, std::vector<float> const &normals)
+	void processUploads()
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < meshes.size(); i++)
+		for(size_t i = 0; i < uploadsPerFrame; i++)
 		{
-			if(!meshes[i])
+			std::function<void()> upload;
 			{
-				index = i;
-				break;
+				std::lock_guard<std::mutex> lck {uploadMtx};
+				if(uploadQueue.empty()) return;
+				upload = std::move(uploadQueue.front());
+				uploadQueue.pop();
 			}
+			upload();
 		}
-		if(index == 0)
+	}
+	
+	void watchDirectory(std::string const &directoryPath)
+	{
+		if(!watcher) watcher = MU<FileWatcher>();
+		watcher->watchDirectory(normalizePath(directoryPath));
+	}
+	
+	void watchASA(uint64_t asaID)
+	{
+		auto it = asaPaths.find(asaID);
+		if(it == asaPaths.end() || !asaFiles.contains(asaID))
 		{
-			meshes.push_back(MU<Mesh>(verts, uvs, normals));
-			index = (uint32_t)(meshes.size() - 1);
+			logger << Sev::ERR << "Trying to watch an invalid ASA ID: " << asaID << logger.endl();
+			return;
 		}
-		else meshes[index] = MU<Mesh>(verts, uvs, normals);
-		return index;
+		if(!watcher) watcher = MU<FileWatcher>();
+		watcher->watchFile(it->second);
 	}
 	
-	uint64_t newAtlas()
+	void processReloads()
 	{
-		uint64_t index = 0;
-		for(uint64_t i = 0; i < atlases.size(); i++)
+		if(!watcher) return;
+		for(auto const &path : watcher->poll(std::chrono::milliseconds(hotReloadDebounceMS)))
 		{
-			if(!atlases[i])
+			bool archive = false;
+			for(auto const &[asaID, asaPath] : asaPaths)
 			{
-				index = i;
-				break;
+				if(asaPath != path || !asaFiles.contains(asaID)) continue;
+				reloadArchive(asaID, path);
+				archive = true;
 			}
+			if(archive) continue;
+			std::string fileName = std::filesystem::path(path).filename().string();
+			looseOverrides[fileName] = path;
+			reloadFile(0, fileName);
 		}
-		if(index == 0)
-		{
-			atlases.push_back(MU<Atlas>());
-			index = (uint32_t)(atlases.size() - 1);
-		}
-		else atlases[index] = MU<Atlas>();
-		return index;
+	}
+	
+	size_t pendingUploads()
+	{
+		std::lock_guard<std::mutex> lck {uploadMtx};
+		return uploadQueue.size();
+	}
+	
+	void setCacheBudget(size_t bytes)
+	{
+		cacheBudget = bytes;
+		evictCaches();
+	}
+	
+	size_t cacheUsage()
+	{
+		return textureCache.totalBytes + shaderCache.totalBytes;
 	}
 	
 	void deleteASAFile(uint64_t id)
 	{
-		if(id >= asaFiles.size() - 1) logger << Sev::ERR << "Trying to delete invalid ASA ID: " << id << logger.endl();
-		else if(!asaFiles[id]) logger << Sev::ERR << "Trying to delete an already deleted ASA file: " << id << logger.endl();
+		if(!asaFiles.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted ASA file: " << id << logger.endl();
 	}
 	
 	void deleteTexture(uint64_t id)
 	{
-		if(id >= textures.size() - 1) logger << Sev::ERR << "Trying to delete invalid texture ID: " << id << logger.endl();
-		else if(!textures[id]) logger << Sev::ERR << "Trying to delete an already deleted texture: " << id << logger.endl();
-		else textures[id].reset();
+		if(id == textureFallback)
+		{
+			logger << Sev::ERR << "Trying to delete the engine's fallback texture, it's owned by the engine" << logger.endl();
+			return;
+		}
+		if(textureCache.release(id)) evictCaches();
+		else if(!textures.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted texture: " << id << logger.endl();
 	}
 	
 	void deleteShader(uint64_t id)
 	{
-		if(id >= shaders.size() - 1) logger << Sev::ERR << "Trying to delete invalid shader ID: " << id << logger.endl();
-		else if(!shaders[id]) logger << Sev::ERR << "Trying to delete an already deleted shader: " << id << logger.endl();
-		else shaders[id].reset();
+		if(id == shaderObject || id == shaderTransfer || id == shaderLine || id == shaderText || id == shaderSprite)
+		{
+			logger << Sev::ERR << "Trying to delete one of the engine's shaders, they're owned by the engine: " << id << logger.endl();
+			return;
+		}
+		if(shaderCache.release(id)) evictCaches();
+		else if(!shaders.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted shader: " << id << logger.endl();
+	}
+	
+	void deleteShaderFamily(uint64_t id)
+	{
+		if(!shaderFamilies.contains(id))
+		{
+			logger << Sev::ERR << "Trying to delete an invalid or already deleted shader family: " << id << logger.endl();
+			return;
+		}
+		for(auto const &[key, shaderID] : shaderFamilies.get(id).variants) shaders.erase(shaderID);
+		shaderFamilies.erase(id);
 	}
 	
 	void deleteMesh(uint64_t id)
 	{
-		if(id >= meshes.size() - 1) logger << Sev::ERR << "Trying to delete invalid mesh ID: " << id << logger.endl();
-		else if(!meshes[id]) logger << Sev::ERR << "Trying to delete an already deleted mesh: " << id << logger.endl();
-		else meshes[id].reset();
+		if(id == meshOrthoQuadLL || id == meshOrthoQuadC || id == meshOrthoQuadUL || id == meshOrthoQuadLR || id == meshOrthoQuadUR || id == meshFullscreenQuad)
+		{
+			logger << Sev::ERR << "Trying to delete one of the engine's meshes, they're owned by the engine: " << id << logger.endl();
+			return;
+		}
+		if(!meshes.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted mesh: " << id << logger.endl();
 	}
 	
 	void deleteAtlas(uint64_t id)
 	{
-		if(id >= atlases.size() - 1) logger << Sev::ERR << "Trying to delete invalid atlas ID: " << id << logger.endl();
-		else if(!atlases[id]) logger << Sev::ERR << "Trying to delete an already deleted atlas: " << id << logger.endl();
-		else atlases[id].reset();
+		if(!atlases.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted atlas: " << id << logger.endl();
+	}
+	
+	void deleteFont(uint64_t id)
+	{
+		if(!fonts.erase(id)) logger << Sev::ERR << "Trying to delete an invalid or already deleted font: " << id << logger.endl();
 	}
 	
 	std::vector<uint8_t> getFileFromASA(uint64_t id, std::string const &filename)
 	{
-		return (id <= asaFiles.size() - 1 && asaFiles[id]) ? asaFiles[id]->read(filename) : nFile;
+		SP<ASA> &asa = asaFiles.get(id);
+		return asa ? asa->read(filename) : nFile;
 	}
 	
 	MeshData getMesh(uint64_t meshID, std::string const &modelName) //TODO auto split the mesh files out into a modeldata repository on read?
 	{
-		return (meshID <= meshes.size() - 1 && meshes[meshID]) ? meshFiles[meshID]->read(modelName) : nModel;
+		UP<MeshFile> &meshFile = meshFiles.get(meshID);
+		if(!meshFile || !meshFile->find(modelName)) return nModel;
+		return meshFile->read(modelName);
 	}
 	
 	UP<Texture>& getTexture(uint64_t id)
 	{
-		return (id <= textures.size() - 1 && textures[id]) ? textures[id] : nTexture;
+		return textures.get(id);
 	}
 	
 	UP<Shader>& getShader(uint64_t id)
 	{
-		return (id <= shaders.size() - 1 && shaders[id]) ? shaders[id] : nShader;
+		return shaders.get(id);
 	}
 	
 	UP<Mesh>& getMesh(uint64_t id)
 	{
-		return (id <= meshes.size() - 1 && meshes[id]) ? meshes[id] : nMesh;
+		return meshes.get(id);
 	}
 	
 	UP<Atlas>& getAtlas(uint64_t id)
 	{
-		return (id <= atlases.size() - 1 && atlases[id]) ? atlases[id] : nAtlas;
+		return atlases.get(id);
+	}
+	
+	UP<Font>& getFont(uint64_t id)
+	{
+		return fonts.get(id);
 	}
 	
 	void terminateASAFiles()
@@ -464,11 +1297,14 @@ namespace AssetRepository
 	
 	void terminateTextures()
 	{
+		textureCache.clear();
 		textures.clear();
 	}
 	
 	void terminateShaders()
 	{
+		shaderCache.clear();
+		shaderFamilies.clear();
 		shaders.clear();
 	}
 	
@@ -481,4 +1317,27 @@ namespace AssetRepository
 	{
 		atlases.clear();
 	}
+	
+	void terminateFonts()
+	{
+		fonts.clear();
+	}
+	
+	void terminateHotReload()
+	{
+		watcher.reset();
+		looseOverrides.clear();
+	}
+	
+	void terminateUploads()
+	{
+		//Loads still running would otherwise queue uploads after the queue's been cleared, into assets that are about to be deleted
+		uploadsClosed = true;
+		{
+			std::unique_lock<std::mutex> lck {loadMtx};
+			loadsDone.wait(lck, []() { return loadsInFlight == 0; });
+		}
+		std::lock_guard<std::mutex> lck {uploadMtx};
+		uploadQueue = {};
+	}
 }
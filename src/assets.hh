@@ -5,20 +5,102 @@
 #include "api/render/shader.hh"
 #include "api/render/mesh.hh"
 #include "api/render/atlas.hh"
+#include "api/render/font.hh"
 #include "api/assets/models.hh"
 
+#include <atomic>
+
 namespace AssetRepository
 {
 	extern uint64_t meshOrthoQuadLL, meshOrthoQuadC, meshOrthoQuadUL, meshOrthoQuadLR, meshOrthoQuadUR, meshFullscreenQuad;
-	extern uint64_t shaderObject, shaderTransfer, shaderLine, shaderText;
-	extern uint64_t shaderBlur3X, shaderBlur3Y, shaderBlur5X, shaderBlur5Y, shaderBlur7X, shaderBlur7Y, shaderBlur9X, shaderBlur9Y, shaderBlur11X, shaderBlur11Y, shaderBlur13X, shaderBlur13Y;
-	extern uint64_t shaderBloom, shaderBloomComposite, shaderBloomSig, shaderDither, shaderTonemapACES, shaderTonemapFilmic, shaderTonemapSRGB, shaderTonemapUncharted2, shaderVignette;
+	extern uint64_t shaderObject, shaderTransfer, shaderLine, shaderText, shaderSprite;
+	
+	/// Shader families whose variants are only compiled once they're used, get a variant with getShaderVariant and mipDownVariant/mipUpVariant
+	extern uint64_t shaderFamilyMipDown, shaderFamilyMipUp;
 	extern uint64_t textureFallback;
 	
+	/// The maximum number of background-loaded assets that processUploads() will create GL objects for per call
+	extern size_t uploadsPerFrame;
+	
+	/// How long a watched file must go without changing before it's reloaded, so bulk saves are only picked up once
+	extern uint32_t hotReloadDebounceMS;
+	
+	/// A handle to an asset being loaded in the background
+	/// Resolves to a fallback asset until the real one has been uploaded to the GPU
+	/// Pair each load with release(), not a delete of get(), which may be the engine's fallback
+	struct AsyncAsset
+	{
+		enum struct Status : uint8_t
+		{
+			PENDING, READY, FAILED,
+		};
+		
+		enum struct Kind : uint8_t
+		{
+			TEXTURE, SHADER, MESH,
+		};
+		
+		struct State
+		{
+			std::atomic<Status> status{Status::PENDING};
+			std::atomic<uint64_t> id{0};
+			std::atomic<bool> released{false}; //A load released while pending is dropped, or deleted as soon as it's uploaded
+			Kind kind = Kind::TEXTURE;
+		};
+		
+		/// Whether the asset has finished loading and been uploaded
+		[[nodiscard]] inline bool ready() const
+		{
+			return this->state && this->state->status == Status::READY;
+		}
+		
+		/// Whether the asset couldn't be read or decoded, the handle will resolve to the fallback forever
+		[[nodiscard]] inline bool failed() const
+		{
+			return !this->state || this->state->status == Status::FAILED;
+		}
+		
+		/// The asset's ID if it's ready, otherwise the fallback asset's ID
+		[[nodiscard]] inline uint64_t get() const
+		{
+			return this->ready() ? this->state->id.load() : this->fallback;
+		}
+		
+		/// Give up the load's reference to the asset, whether or not it's finished, copies of the handle are released along with it
+		/// Only call from the thread that owns the GL context, the same as the delete functions
+		void release();
+		
+		SP<State> state = nullptr;
+		uint64_t fallback = 0;
+	};
+	
+	enum struct Tonemapper : uint8_t
+	{
+		ACES, Filmic, SRGB, Uncharted2,
+	};
+	
+	/// Defines for a variant of shaderFamilyMipDown, which halves an image for a blur or bloom mip chain
+	/// \param highQuality Use a 13 tap filter rather than the 5 tap dual filter, which flickers less on small bright details
+	/// \param prefilter Keep only what's brighter than the threshold uniform, for the first level of a bloom chain
+	[[nodiscard]] inline std::vector<ShaderDefine> mipDownVariant(bool highQuality, bool prefilter)
+	{
+		return {{"HIGH_QUALITY", highQuality}, {"PREFILTER", prefilter}};
+	}
+	
+	/// Defines for a variant of shaderFamilyMipUp, which doubles a level of a mip chain
+	/// \param highQuality Use a 9 tap tent filter rather than the 8 tap dual filter
+	/// \param accumulate Add the upsampled image onto the level it's written over, scaled by the intensity uniform, rather than replacing it
+	[[nodiscard]] inline std::vector<ShaderDefine> mipUpVariant(bool highQuality, bool accumulate)
+	{
+		return {{"HIGH_QUALITY", highQuality}, {"ACCUMULATE", accumulate}};
+	}
+	
 	void init();
 	[[nodiscard]] uint64_t loadASA(std::string const &filePath);
 	[[nodiscard]] uint64_t loadMeshFile(uint64_t asaID, std::string const &fileName);
 	
+	/// Textures and shaders loaded from an archive by filename are cached and reference counted
+	/// Loading the same file again returns the same ID, each load should be paired with a delete, or AsyncAsset::release for the async loads
 	[[nodiscard]] uint64_t newTexture(uint64_t asaID, std::string const &fileName, bool srgb = false);
 	[[nodiscard]] uint64_t newShader(uint64_t asaID, std::string const &compFileName);
 	[[nodiscard]] uint64_t newShader(uint64_t asaID, std::string const &vertFileName, std::string const &fragFileName);
@@ -36,11 +118,71 @@ namespace AssetRepository
 	[[nodiscard]] uint64_t newMesh(std::vector<float> const &vertsData, std::vector<float> const &uvsData, std::vector<float> const &normalsData);
 	[[nodiscard]] uint64_t newAtlas();
 	
+	/// Load a BitmapFont from a sheet of equally sized cells in an archive, see BitmapFont for the sheet's layout
+	/// \return The font's ID, for TextComponent::fontID, or 0 if the sheet couldn't be read
+	[[nodiscard]] uint64_t newFont(uint64_t asaID, std::string const &fileName, uint32_t cellWidth, uint32_t cellHeight, char32_t firstCodepoint = 32);
+	
+	/// Register a font with its own rasterizer
+	[[nodiscard]] uint64_t newFont(UP<Font> &&font);
+	
+	/// A family of shaders generated from one source by #defines
+	/// Nothing is compiled until a variant is asked for, then each combination of defines is compiled once and cached
+	[[nodiscard]] uint64_t newShaderFamily(std::string const &compSrc);
+	[[nodiscard]] uint64_t newShaderFamily(std::string const &vertSrc, std::string const &fragSrc);
+	
+	/// Get a variant of a family, compiling it if this is the first time it's been asked for
+	/// \return The variant's shader ID, owned by the family, or 0 if the family doesn't exist
+	[[nodiscard]] uint64_t getShaderVariant(uint64_t familyID, std::vector<ShaderDefine> const &defines);
+	
+	/// Compile the variants a level needs ahead of time, ie while it loads, so their first use doesn't stall a frame
+	/// They're compiled as one batch, so this mustn't be called between Shader::beginBatch and endBatch
+	void prewarmShaderVariants(uint64_t familyID, std::vector<std::vector<ShaderDefine>> const &variants);
+	
+	/// Read and decode a texture on a worker thread, resolves to textureFallback until it's ready
+	[[nodiscard]] AsyncAsset loadTextureAsync(uint64_t asaID, std::string const &fileName, bool srgb = false);
+	
+	/// Read a compute shader on a worker thread, resolves to 0 until it's ready
+	[[nodiscard]] AsyncAsset loadShaderAsync(uint64_t asaID, std::string const &compFileName);
+	
+	/// Read a vert/frag shader on a worker thread, resolves to shaderObject until it's ready
+	[[nodiscard]] AsyncAsset loadShaderAsync(uint64_t asaID, std::string const &vertFileName, std::string const &fragFileName);
+	
+	/// Read and parse a model from a mesh file on a worker thread, resolves to meshOrthoQuadC until it's ready
+	[[nodiscard]] AsyncAsset loadMeshAsync(uint64_t asaID, std::string const &meshFileName, std::string const &modelName);
+	
+	/// Create the GL objects for up to uploadsPerFrame assets that finished loading in the background
+	/// Must be called from the thread that owns the GL context, the renderer calls this once per frame
+	void processUploads();
+	
+	/// Watch a directory of loose files for hot reloading
+	/// When a file in it changes, every asset that was loaded from an archive under the same filename is rebuilt from the loose file instead
+	void watchDirectory(std::string const &directoryPath);
+	
+	/// Watch an archive on disk for hot reloading, when it's repacked only the entries whose contents changed are rebuilt
+	void watchASA(uint64_t asaID);
+	
+	/// Start reloading anything watched that's changed, reloads are decoded on worker threads and swapped in by processUploads() under the same ID
+	/// The renderer calls this once per frame
+	void processReloads();
+	
+	/// The number of background-loaded assets waiting on processUploads()
+	[[nodiscard]] size_t pendingUploads();
+	
+	/// Set how many bytes of cached textures and shaders may stay resident, the budget is shared by both
+	/// Once over budget, cached assets that are no longer referenced are destroyed, least recently released first
+	void setCacheBudget(size_t bytes);
+	
+	/// The number of bytes used by cached textures and shaders, referenced or not
+	[[nodiscard]] size_t cacheUsage();
+	
+	/// Deleting the engine's own assets, ie a fallback returned by AsyncAsset::get, is refused and logged
 	void deleteASAFile(uint64_t id);
 	void deleteTexture(uint64_t id);
 	void deleteShader(uint64_t id);
+	void deleteShaderFamily(uint64_t id);
 	void deleteMesh(uint64_t id);
 	void deleteAtlas(uint64_t id);
+	void deleteFont(uint64_t id); //Glyphs already in the renderer's glyph cache stay there until it's cleared
 	
 	[[nodiscard]] std::vector<uint8_t> getFileFromASA(uint64_t id, std::string const &filename);
 	[[nodiscard]] MeshData getMesh(uint64_t meshID, std::string const &modelName);
@@ -48,11 +190,15 @@ namespace AssetRepository
 	[[nodiscard]] UP<Shader>& getShader(uint64_t id);
 	[[nodiscard]] UP<Mesh>& getMesh(uint64_t id);
 	[[nodiscard]] UP<Atlas>& getAtlas(uint64_t id);
+	[[nodiscard]] UP<Font>& getFont(uint64_t id);
 	
 	void terminateASAFiles();
 	void terminateTextures();
 	void terminateShaders();
 	void terminateMeshes();
 	void terminateAtlases();
+	void terminateFonts();
+	void terminateHotReload();
+	void terminateUploads();
 }
 namespace AR = AssetRepository;
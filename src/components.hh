@@ -8,6 +8,7 @@
 #include <functional>
 #include <unordered_map>
 #include <commons/math/vec2.hh>
+#include <commons/math/vec4.hh>
 #include <commons/math/shapes.hh>
 
 struct Object;
@@ -80,13 +81,17 @@ struct AIComponent
 	
 };
 
+/// Text drawn through the renderer's glyph cache, strings are laid out once and then reused until they change
 struct TextComponent
 {
-	vec2<double> pos{}, scale{}; //If hudText is true, the origin is the upper-left corner of the window, if false the world's origin is the origin
+	vec2<double> pos{}, scale{1, 1}; //The upper left corner of the text, if hudText is true, the origin is the upper-left corner of the window, if false the world's origin is the origin
 	double rotation = 0.0f;
-	uint32_t width = 0, height = 0, x = 0, y = 0;
-	std::string text = "";
-	uint32_t texID = 0; //Don't modify this, it's handled internally
+	std::string text = ""; //UTF-8, newlines start a new line
+	uint64_t fontID = 0; //From AR::newFont
+	uint32_t pixelSize = 16; //Height of a line in pixels, before scale
+	vec4<float> color{1, 1, 1, 1}; //RGBA tint, 0-1
+	size_t layer = 0, sublayer = 0; //Drawn after the sprites of the same layer
+	bool hudText = false;
 };
 
 struct ScriptComponent
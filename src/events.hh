@@ -37,6 +37,7 @@ struct EventWindowMinimized : public EventBase<> {_CFWD};
 struct EventWindowMaximized : public EventBase<> {_CFWD};
 struct EventWindowTakeFocus : public EventBase<> {_CFWD};
 struct EventWindowMoved : public EventBase<> {_CFWD};
+struct EventMemoryBudget : public EventBase<bool, size_t, size_t> {_CFWD}; //Hard budget exceeded (otherwise soft), bytes in use, the budget that was exceeded
 
 using EventBus_t = EventBus<EventExiting,
 		EventPaused,
@@ -62,4 +63,5 @@ using EventBus_t = EventBus<EventExiting,
 		EventWindowMinimized,
 		EventWindowMaximized,
 		EventWindowTakeFocus,
-		EventWindowMoved>;
+		EventWindowMoved,
+		EventMemoryBudget>;
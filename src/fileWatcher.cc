@@ -0,0 +1,126 @@
+#include "fileWatcher.hh"
+#include "global.hh"
+
+#ifdef LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+FileWatcher::FileWatcher()
+{
+	#ifdef LINUX
+	this->inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(this->inotifyFD < 0) logger << Sev::ERR << "Failed to initialize inotify, falling back to polling for file changes" << logger.endl();
+	#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+	#ifdef LINUX
+	if(this->inotifyFD >= 0) close(this->inotifyFD);
+	#endif
+}
+
+void FileWatcher::watchDirectory(std::string const &directoryPath)
+{
+	this->addDirectory(directoryPath).allFiles = true;
+}
+
+void FileWatcher::watchFile(std::string const &filePath)
+{
+	fs::path path{filePath};
+	std::string dir = path.has_parent_path() ? path.parent_path().string() : ".";
+	this->addDirectory(dir).fileNames.insert(path.filename().string());
+}
+
+std::vector<std::string> FileWatcher::poll(std::chrono::milliseconds debounce)
+{
+	auto now = std::chrono::steady_clock::now();
+	bool useInotify = false;
+	#ifdef LINUX
+	useInotify = this->inotifyFD >= 0;
+	if(useInotify)
+	{
+		alignas(inotify_event) char buf[4096];
+		ssize_t len = 0;
+		while((len = read(this->inotifyFD, buf, sizeof(buf))) > 0)
+		{
+			for(char *cur = buf; cur < buf + len; cur += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(cur)->len)
+			{
+				inotify_event const *event = reinterpret_cast<inotify_event*>(cur);
+				auto dirIt = this->watchDescriptors.find(event->wd);
+				if(dirIt == this->watchDescriptors.end() || event->len == 0 || (event->mask & IN_ISDIR)) continue;
+				this->changed(this->dirs[dirIt->second], event->name);
+			}
+		}
+	}
+	#endif
+	if(!useInotify && now - this->lastScan >= this->scanInterval)
+	{
+		this->scan();
+		this->lastScan = now;
+	}
+	
+	std::vector<std::string> out;
+	for(auto it = this->pending.begin(); it != this->pending.end();)
+	{
+		if(now - it->second >= debounce)
+		{
+			out.push_back(it->first);
+			it = this->pending.erase(it);
+		}
+		else it++;
+	}
+	return out;
+}
+
+FileWatcher::WatchedDirectory& FileWatcher::addDirectory(std::string const &path)
+{
+	fs::path normalized = fs::path{path}.lexically_normal();
+	if(!normalized.has_filename() && normalized.has_parent_path()) normalized = normalized.parent_path(); //Drop the trailing separator so each directory is only watched once
+	std::string directoryPath = normalized.string();
+	for(auto &dir : this->dirs) if(dir.path == directoryPath) return dir;
+	WatchedDirectory &dir = this->dirs.emplace_back();
+	dir.path = directoryPath;
+	std::error_code ec;
+	for(auto const &entry : fs::directory_iterator(directoryPath, ec)) if(entry.is_regular_file(ec)) dir.modified[entry.path().filename().string()] = entry.last_write_time(ec);
+	if(ec) logger << Sev::ERR << "Failed to read watched directory " << directoryPath << ": " << ec.message() << logger.endl();
+	#ifdef LINUX
+	if(this->inotifyFD >= 0)
+	{
+		int wd = inotify_add_watch(this->inotifyFD, directoryPath.data(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if(wd < 0) logger << Sev::ERR << "Failed to watch directory " << directoryPath << logger.endl();
+		else this->watchDescriptors[wd] = this->dirs.size() - 1;
+	}
+	#endif
+	return dir;
+}
+
+void FileWatcher::changed(WatchedDirectory const &dir, std::string const &fileName)
+{
+	if(!dir.allFiles && !dir.fileNames.contains(fileName)) return;
+	this->pending[(fs::path{dir.path} / fileName).string()] = std::chrono::steady_clock::now();
+}
+
+void FileWatcher::scan()
+{
+	for(auto &dir : this->dirs)
+	{
+		std::error_code ec;
+		for(auto const &entry : fs::directory_iterator(dir.path, ec))
+		{
+			if(!entry.is_regular_file(ec)) continue;
+			std::string fileName = entry.path().filename().string();
+			fs::file_time_type time = entry.last_write_time(ec);
+			auto it = dir.modified.find(fileName);
+			if(it == dir.modified.end() || it->second != time)
+			{
+				dir.modified[fileName] = time;
+				this->changed(dir, fileName);
+			}
+		}
+	}
+}
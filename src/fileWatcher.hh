@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+
+/// Reports files that have been written to in watched directories
+/// Uses inotify on Linux, and falls back to polling modification times elsewhere
+/// Changes are debounced, a file is only reported once it's stopped changing, so bulk saves and partial writes are coalesced
+struct FileWatcher
+{
+	FileWatcher();
+	~FileWatcher();
+	
+	FileWatcher(FileWatcher const &other) = delete;
+	FileWatcher& operator=(FileWatcher const &other) = delete;
+	
+	/// Watch every file in a directory, non-recursive
+	void watchDirectory(std::string const &directoryPath);
+	
+	/// Watch a single file, its directory is watched so that files replaced by renaming are still picked up
+	void watchFile(std::string const &filePath);
+	
+	/// Collect changes without blocking
+	/// \param debounce How long a file must go without changing before it's reported
+	/// \return Paths of files that changed and have since settled
+	[[nodiscard]] std::vector<std::string> poll(std::chrono::milliseconds debounce = std::chrono::milliseconds(250));
+	
+	/// How often the polling fallback rescans modification times
+	std::chrono::milliseconds scanInterval{500};
+
+private:
+	struct WatchedDirectory
+	{
+		std::string path;
+		bool allFiles = false;
+		std::unordered_set<std::string> fileNames; //Only used if allFiles is false
+		std::unordered_map<std::string, std::filesystem::file_time_type> modified; //Polling fallback's last seen modification times
+	};
+	
+	WatchedDirectory& addDirectory(std::string const &path);
+	void changed(WatchedDirectory const &dir, std::string const &fileName);
+	void scan();
+	
+	std::vector<WatchedDirectory> dirs;
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> pending; //Path -> time of its most recent change
+	std::chrono::steady_clock::time_point lastScan{};
+	
+	#ifdef LINUX
+	int inotifyFD = -1;
+	std::unordered_map<int, size_t> watchDescriptors; //inotify watch descriptor -> index into dirs
+	#endif
+};
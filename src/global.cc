@@ -2,3 +2,4 @@
 
 Logger logger;
 size_t frame = 0;
+ThreadPool threadPool;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <commons/logger.hh>
+#include <commons/threadpool.hh>
 
 extern Logger logger;
 extern size_t frame;
+extern ThreadPool threadPool;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// 64 bit xxHash (XXH64), used for content hashing of assets, ie deduplication, integrity checks, and cache keys
+[[nodiscard]] inline uint64_t xxHash64(void const *data, size_t len, uint64_t seed = 0)
+{
+	constexpr uint64_t p1 = 0x9E3779B185EBCA87ULL, p2 = 0xC2B2AE3D27D4EB4FULL, p3 = 0x165667B19E3779F9ULL, p4 = 0x85EBCA77C2B2AE63ULL, p5 = 0x27D4EB2F165667C5ULL;
+	auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+	auto read64 = [](uint8_t const *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; };
+	auto read32 = [](uint8_t const *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; };
+	auto round = [&rotl](uint64_t acc, uint64_t input) { acc += input * p2; acc = rotl(acc, 31); return acc * p1; };
+	auto merge = [&round](uint64_t acc, uint64_t val) { acc ^= round(0, val); return acc * p1 + p4; };
+	
+	uint8_t const *cur = reinterpret_cast<uint8_t const*>(data);
+	uint8_t const *end = cur + len;
+	uint64_t h = 0;
+	if(len >= 32)
+	{
+		uint64_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+		do
+		{
+			v1 = round(v1, read64(cur));
+			v2 = round(v2, read64(cur + 8));
+			v3 = round(v3, read64(cur + 16));
+			v4 = round(v4, read64(cur + 24));
+			cur += 32;
+		} while(cur <= end - 32);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(h, v1);
+		h = merge(h, v2);
+		h = merge(h, v3);
+		h = merge(h, v4);
+	}
+	else h = seed + p5;
+	h += len;
+	for(; cur + 8 <= end; cur += 8) h = rotl(h ^ round(0, read64(cur)), 27) * p1 + p4;
+	if(cur + 4 <= end)
+	{
+		h = rotl(h ^ (read32(cur) * p1), 23) * p2 + p3;
+		cur += 4;
+	}
+	for(; cur < end; cur++) h = rotl(h ^ (*cur * p5), 11) * p1;
+	h ^= h >> 33;
+	h *= p2;
+	h ^= h >> 29;
+	h *= p3;
+	h ^= h >> 32;
+	return h;
+}
+
+[[nodiscard]] inline uint64_t xxHash64(std::vector<uint8_t> const &data, uint64_t seed = 0)
+{
+	return xxHash64(data.data(), data.size(), seed);
+}
+
+[[nodiscard]] inline uint64_t xxHash64(std::string const &data, uint64_t seed = 0)
+{
+	return xxHash64(data.data(), data.size(), seed);
+}
+
+/// 64 bit FNV-1a, weaker than xxHash but usable at compile time, used for short identifiers like uniform names
+[[nodiscard]] constexpr uint64_t fnv1a64(std::string_view text)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for(char c : text)
+	{
+		h ^= static_cast<uint8_t>(c);
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
@@ -1,11 +1,13 @@
 #include "loft.hh"
 #include "input.hh"
 #include "global.hh"
+#include "api/render/glState.hh"
 
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 #include <glad/glad.h>
 #include <commons/logger.hh>
+#include <algorithm>
 
 void glDebug(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *userParam)
 {
@@ -85,12 +87,12 @@ Loft::Loft(uint32_t width, uint32_t height, std::string const &windowTitle, bool
 	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 	glDebugMessageCallback(glDebug, nullptr);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, 0, GL_TRUE);
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glEnable(GL_CULL_FACE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glViewport(0, 0, this->width, this->height);
-	glScissor(0, 0, this->width, this->height);
+	GS::setCapability(GS::Capability::DepthTest, false);
+	GS::setCapability(GS::Capability::Blend, true);
+	GS::setCapability(GS::Capability::CullFace, true);
+	GS::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GS::viewport(0, 0, this->width, this->height);
+	GS::scissor(0, 0, this->width, this->height);
 	this->renderer = MU<Renderer>(this->eventBus, this->width, this->height);
 	
 	eventBus->registerEventHandler<EventWindowSizeChanged>([this](uint32_t newWidth, uint32_t newHeight)
@@ -114,6 +116,58 @@ void Loft::update(double delta)
 
 void Loft::renderFrame()
 {
-	this->renderer->render(this->world.getSceneGraph(), this->camera);
+	this->takeSnapshot(this->frame);
+	this->renderer->render(this->frame);
 	SDL_GL_SwapWindow(reinterpret_cast<SDL_Window*>(this->window));
+	
+	//Budgets are checked once per frame rather than on every allocation, and only crossings are reported
+	MB::Level level = MB::level();
+	if(level != this->memoryLevel)
+	{
+		if(level != MB::Level::Under)
+		{
+			bool hard = level == MB::Level::Hard;
+			size_t budget = hard ? MB::hardBudget() : MB::softBudget();
+			logger << Sev::ERR << "Memory usage of " << MB::total() << " bytes exceeds the " << (hard ? "hard" : "soft") << " budget of " << budget << " bytes" << logger.endl();
+			this->eventBus->post<EventMemoryBudget>(hard, MB::total(), budget);
+		}
+		this->memoryLevel = level;
+	}
+}
+
+void Loft::takeSnapshot(FrameSnapshot &frame)
+{
+	frame.tilemaps.clear();
+	for(auto const &tilemap : this->world.tilemaps) if(tilemap) frame.tilemaps.push_back({tilemap, tilemap->pos});
+	frame.renderList = this->world.getSceneGraph(this->camera);
+	frame.camera = this->camera;
+	
+	//Entries are overwritten in place, so strings that fit in what a previous snapshot in this slot allocated don't allocate again
+	size_t numTexts = 0;
+	for(auto const &obj : this->world.objects) if(obj->textComp && !obj->textComp->text.empty()) numTexts++;
+	frame.texts.resize(numTexts);
+	size_t index = 0;
+	for(auto const &obj : this->world.objects)
+	{
+		if(!obj->textComp || obj->textComp->text.empty()) continue;
+		TextComponent const &comp = *obj->textComp;
+		FrameSnapshot::TextDraw &text = frame.texts[index];
+		text.text.assign(comp.text);
+		text.pos = comp.pos;
+		text.scale = comp.scale;
+		text.rotation = comp.rotation;
+		text.color = comp.color;
+		text.fontID = comp.fontID;
+		text.pixelSize = comp.pixelSize;
+		text.layer = comp.layer;
+		text.sublayer = comp.sublayer;
+		text.order = index++;
+		text.hud = comp.hudText;
+	}
+	std::sort(frame.texts.begin(), frame.texts.end(), [](FrameSnapshot::TextDraw const &a, FrameSnapshot::TextDraw const &b)
+	{
+		if(a.layer != b.layer) return a.layer > b.layer;
+		if(a.sublayer != b.sublayer) return a.sublayer > b.sublayer;
+		return a.order < b.order;
+	});
 }
@@ -6,6 +6,7 @@
 #include "renderer.hh"
 #include "api/assets/camera.hh"
 #include "world.hh"
+#include "memoryBudget.hh"
 
 #include <cstdint>
 #include <string>
@@ -26,6 +27,9 @@ struct Loft
 	}
 	
 	void update(double delta);
+	
+	/// Snapshot the world and camera, then draw the snapshot and swap
+	/// The renderer only reads the snapshot, never live simulation state
 	void renderFrame();
 	
 	uint32_t width = 800, height = 600;
@@ -42,4 +46,10 @@ struct Loft
 	UP<Renderer> renderer = nullptr;
 	Camera camera;
 	World world;
+
+private:
+	void takeSnapshot(FrameSnapshot &frame);
+	
+	MB::Level memoryLevel = MB::Level::Under;
+	FrameSnapshot frame; //Kept between frames so its storage is reused
 };
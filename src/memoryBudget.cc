@@ -0,0 +1,178 @@
+#include "memoryBudget.hh"
+
+#include <atomic>
+#include <array>
+#include <cstdio>
+#include <commons/fileio.hh>
+
+namespace MemoryBudget
+{
+	constexpr size_t numCategories = static_cast<size_t>(Category::Count);
+	
+	std::array<std::atomic<size_t>, numCategories> usages{};
+	std::array<std::atomic<size_t>, numCategories> peaks{};
+	std::array<std::atomic<size_t>, numCategories> counts{};
+	std::atomic<size_t> soft{0}, hard{0};
+	
+	void track(Category category, size_t bytes)
+	{
+		size_t const index = static_cast<size_t>(category);
+		size_t const now = usages[index].fetch_add(bytes) + bytes;
+		size_t prev = peaks[index].load();
+		while(now > prev && !peaks[index].compare_exchange_weak(prev, now));
+	}
+	
+	void untrack(Category category, size_t bytes)
+	{
+		usages[static_cast<size_t>(category)].fetch_sub(bytes);
+	}
+	
+	Allocation::Allocation(Category category, size_t bytes) : category(category), bytes(bytes)
+	{
+		if(this->category == Category::Count) return;
+		track(this->category, this->bytes);
+		counts[static_cast<size_t>(this->category)]++;
+	}
+	
+	Allocation::~Allocation()
+	{
+		if(this->category == Category::Count) return;
+		untrack(this->category, this->bytes);
+		counts[static_cast<size_t>(this->category)]--;
+	}
+	
+	Allocation::Allocation(Allocation const &other) : Allocation(other.category, other.bytes) {}
+	
+	Allocation& Allocation::operator=(Allocation const &other)
+	{
+		if(this == &other) return *this;
+		*this = Allocation(other);
+		return *this;
+	}
+	
+	Allocation::Allocation(Allocation &&other) noexcept : category(other.category), bytes(other.bytes)
+	{
+		other.category = Category::Count; //Moved-from allocations no longer own anything
+		other.bytes = 0;
+	}
+	
+	Allocation& Allocation::operator=(Allocation &&other) noexcept
+	{
+		if(this == &other) return *this;
+		if(this->category != Category::Count)
+		{
+			untrack(this->category, this->bytes);
+			counts[static_cast<size_t>(this->category)]--;
+		}
+		this->category = other.category;
+		this->bytes = other.bytes;
+		other.category = Category::Count;
+		other.bytes = 0;
+		return *this;
+	}
+	
+	void Allocation::resize(size_t newBytes)
+	{
+		if(this->category == Category::Count) return;
+		if(newBytes > this->bytes) track(this->category, newBytes - this->bytes);
+		else untrack(this->category, this->bytes - newBytes);
+		this->bytes = newBytes;
+	}
+	
+	char const* categoryName(Category category)
+	{
+		switch(category)
+		{
+			case Category::Textures: return "Textures";
+			case Category::Atlases: return "Atlases";
+			case Category::Meshes: return "Meshes";
+			case Category::Framebuffers: return "Framebuffers";
+			case Category::Audio: return "Audio";
+			case Category::Archives: return "Archives";
+			default: return "Unknown";
+		}
+	}
+	
+	size_t usage(Category category)
+	{
+		return category == Category::Count ? 0 : usages[static_cast<size_t>(category)].load();
+	}
+	
+	size_t peak(Category category)
+	{
+		return category == Category::Count ? 0 : peaks[static_cast<size_t>(category)].load();
+	}
+	
+	size_t count(Category category)
+	{
+		return category == Category::Count ? 0 : counts[static_cast<size_t>(category)].load();
+	}
+	
+	size_t total()
+	{
+		size_t out = 0;
+		for(auto const &u : usages) out += u.load();
+		return out;
+	}
+	
+	void setSoftBudget(size_t bytes)
+	{
+		soft = bytes;
+	}
+	
+	void setHardBudget(size_t bytes)
+	{
+		hard = bytes;
+	}
+	
+	size_t softBudget()
+	{
+		return soft;
+	}
+	
+	size_t hardBudget()
+	{
+		return hard;
+	}
+	
+	Level level()
+	{
+		size_t const used = total();
+		if(hard != 0 && used > hard) return Level::Hard;
+		if(soft != 0 && used > soft) return Level::Soft;
+		return Level::Under;
+	}
+	
+	std::string report()
+	{
+		auto mib = [](size_t bytes)
+		{
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%.2f MiB", static_cast<double>(bytes) / (1024.0 * 1024.0));
+			return std::string(buf);
+		};
+		std::string out = "Memory usage:\n";
+		char line[128];
+		for(size_t i = 0; i < numCategories; i++)
+		{
+			Category const category = static_cast<Category>(i);
+			snprintf(line, sizeof(line), "  %-13s %14s  peak %14s  %zu allocations\n", categoryName(category), mib(usage(category)).data(), mib(peak(category)).data(), count(category));
+			out += line;
+		}
+		snprintf(line, sizeof(line), "  %-13s %14s\n", "Total", mib(total()).data());
+		out += line;
+		if(soft != 0) out += "  Soft budget   " + mib(soft) + "\n";
+		if(hard != 0) out += "  Hard budget   " + mib(hard) + "\n";
+		return out;
+	}
+	
+	bool dumpReport(std::string const &filePath)
+	{
+		FILE *out = openFile(filePath, "w");
+		if(!out) return false;
+		std::string const text = report();
+		writeFile(out, text.data(), text.size());
+		closeFile(out);
+		return true;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/// Byte accounting for every CPU and GPU resource the engine owns
+/// Resources hold an Allocation which adds to its category's total on creation and subtracts on destruction
+namespace MemoryBudget
+{
+	enum struct Category : uint8_t
+	{
+		Textures, Atlases, Meshes, Framebuffers, Audio, Archives, Count,
+	};
+	
+	/// Where the total usage sits relative to the soft and hard budgets
+	enum struct Level : uint8_t
+	{
+		Under, Soft, Hard,
+	};
+	
+	/// A tracked block of memory, copying it tracks the same amount again, moving it transfers ownership
+	struct Allocation
+	{
+		Allocation() = default;
+		Allocation(Category category, size_t bytes);
+		~Allocation();
+		
+		//copy
+		Allocation(Allocation const &other);
+		Allocation& operator=(Allocation const &other);
+		
+		//move
+		Allocation(Allocation &&other) noexcept;
+		Allocation& operator=(Allocation &&other) noexcept;
+		
+		/// Change the tracked size, ie after a buffer is regrown
+		void resize(size_t newBytes);
+		
+		Category category = Category::Count; //Count means nothing is tracked, ie default constructed or moved-from
+		size_t bytes = 0;
+	};
+	
+	[[nodiscard]] char const* categoryName(Category category);
+	
+	/// Bytes currently tracked in the given category
+	[[nodiscard]] size_t usage(Category category);
+	
+	/// The highest the given category's usage has been
+	[[nodiscard]] size_t peak(Category category);
+	
+	/// Number of live allocations in the given category
+	[[nodiscard]] size_t count(Category category);
+	
+	/// Bytes currently tracked across all categories
+	[[nodiscard]] size_t total();
+	
+	/// Budgets apply to the total across all categories, 0 disables a budget
+	void setSoftBudget(size_t bytes);
+	void setHardBudget(size_t bytes);
+	[[nodiscard]] size_t softBudget();
+	[[nodiscard]] size_t hardBudget();
+	[[nodiscard]] Level level();
+	
+	/// A human readable table of usage per category
+	[[nodiscard]] std::string report();
+	
+	/// Write report() to a file
+	/// \return False if the file couldn't be opened
+	bool dumpReport(std::string const &filePath);
+}
+namespace MB = MemoryBudget;
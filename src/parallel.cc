@@ -0,0 +1,89 @@
+#include "parallel.hh"
+#include "global.hh"
+#include "def.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+void parallelFor(size_t count, size_t grain, std::function<void(size_t begin, size_t end, size_t batch)> const &func)
+{
+	grain = std::max<size_t>(grain, 1);
+	size_t const numBatches = (count + grain - 1) / grain;
+	if(numBatches <= 1)
+	{
+		if(count != 0) func(0, count, 0);
+		return;
+	}
+	
+	//Helpers that only get scheduled after every batch has been claimed find nothing to do, so the state they share outlives this call
+	struct State
+	{
+		std::atomic<size_t> next{0}, done{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	SP<State> state = MS<State>();
+	auto work = [state, &func, count, grain, numBatches]()
+	{
+		for(size_t batch = state->next++; batch < numBatches; batch = state->next++)
+		{
+			func(batch * grain, std::min(count, (batch + 1) * grain), batch);
+			if(++state->done == numBatches)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+	size_t const helpers = std::min<size_t>(numBatches - 1, std::max(1u, std::thread::hardware_concurrency()) - 1);
+	for(size_t i = 0; i < helpers; i++) threadPool.enqueue(work);
+	work();
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, numBatches]() { return state->done == numBatches; });
+}
+
+void radixSort(std::vector<uint64_t> &keys)
+{
+	size_t constexpr grain = 1 << 16;
+	size_t const count = keys.size();
+	if(count < 2) return;
+	size_t const numBatches = (count + grain - 1) / grain;
+	std::vector<uint64_t> scratch(count);
+	std::vector<std::array<size_t, 256>> histograms(numBatches);
+	for(uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		parallelFor(count, grain, [&](size_t begin, size_t end, size_t batch)
+		{
+			std::array<size_t, 256> &histogram = histograms[batch];
+			histogram.fill(0);
+			for(size_t i = begin; i < end; i++) histogram[(keys[i] >> shift) & 0xFF]++;
+		});
+		
+		//Turn the counts into where each batch starts writing each digit, digits in order and batches in order within a digit keeps it stable
+		size_t offset = 0;
+		bool allSame = false;
+		for(size_t digit = 0; digit < 256; digit++)
+		{
+			size_t const digitStart = offset;
+			for(auto &histogram : histograms)
+			{
+				size_t const digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+			if(offset - digitStart == count) allSame = true;
+		}
+		if(allSame) continue;
+		
+		parallelFor(count, grain, [&](size_t begin, size_t end, size_t batch)
+		{
+			std::array<size_t, 256> &offsets = histograms[batch];
+			for(size_t i = begin; i < end; i++) scratch[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		});
+		keys.swap(scratch);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// Run func over [0, count) split into batches of at most grain, spread across the global thread pool
+/// The calling thread works through batches as well and only returns once every batch is done,
+/// so this never waits on the pool to make progress and is safe to call from a worker thread
+/// \param func Called with each batch's [begin, end) and the batch's index, batch b always starts at b * grain
+void parallelFor(size_t count, size_t grain, std::function<void(size_t begin, size_t end, size_t batch)> const &func);
+
+/// Sort keys in ascending order with a parallel least significant digit radix sort, 8 bits per pass
+/// The sort is stable, and passes where every key shares the same digit are skipped, so keys that only use their low bits take fewer passes
+void radixSort(std::vector<uint64_t> &keys);
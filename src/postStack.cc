@@ -1,8 +1,28 @@
 #include "postStack.hh"
+#include "api/render/postPasses.hh"
+
+RenderGraph::ResourceID chainPasses(RenderGraph &graph, std::vector<SP<RenderPass>> const &passes, RenderGraph::ResourceID input, bool fuse)
+{
+	RenderGraph::ResourceID current = input;
+	std::vector<PixelPass const*> run;
+	for(auto const &renderPass : passes)
+	{
+		if(!renderPass->enabled) continue;
+		PixelPass const *pixelPass = fuse ? dynamic_cast<PixelPass const*>(renderPass.get()) : nullptr;
+		if(pixelPass)
+		{
+			run.push_back(pixelPass);
+			continue;
+		}
+		current = PixelPass::addFused(graph, current, run);
+		run.clear();
+		current = renderPass->addTo(graph, current);
+	}
+	return PixelPass::addFused(graph, current, run);
+}
 
 void LayerPostStack::addToLayer(uint64_t layer, SP<RenderPass> const &renderPass)
 {
-	if(this->postOrder.find(layer) != this->postOrder.end()) this->postOrder[layer] = std::vector<SP<RenderPass>>{};
 	this->postOrder[layer].push_back(renderPass);
 }
 
@@ -28,6 +48,28 @@ bool LayerPostStack::empty()
 	return this->postOrder.empty();
 }
 
+bool LayerPostStack::anyEnabled(uint64_t layer) const
+{
+	auto it = this->postOrder.find(layer);
+	if(it == this->postOrder.end()) return false;
+	return std::any_of(it->second.begin(), it->second.end(), [](SP<RenderPass> const &renderPass) { return renderPass->enabled; });
+}
+
+float LayerPostStack::reach(uint64_t layer) const
+{
+	auto it = this->postOrder.find(layer);
+	if(it == this->postOrder.end()) return 0.0f;
+	float total = 0.0f;
+	for(auto const &renderPass : it->second) if(renderPass->enabled) total += renderPass->reach();
+	return total;
+}
+
+RenderGraph::ResourceID LayerPostStack::addTo(RenderGraph &graph, uint64_t layer, RenderGraph::ResourceID input)
+{
+	if(!this->contains(layer)) return input;
+	return chainPasses(graph, this->postOrder[layer], input, this->fusePixelPasses);
+}
+
 void GlobalPostStack::add(SP<RenderPass> const &renderPass)
 {
 	this->postOrder.push_back(renderPass);
@@ -47,3 +89,14 @@ bool GlobalPostStack::empty()
 {
 	return this->postOrder.empty();
 }
+
+bool GlobalPostStack::anyEnabled() const
+{
+	return std::any_of(this->postOrder.begin(), this->postOrder.end(), [](SP<RenderPass> const &renderPass) { return renderPass->enabled; });
+}
+
+RenderGraph::ResourceID GlobalPostStack::addTo(RenderGraph &graph, RenderGraph::ResourceID input)
+{
+	bool const fuse = this->fusePixelPasses && !(this->compareFusion && (this->frames++ & 1));
+	return chainPasses(graph, this->postOrder, input, fuse);
+}
@@ -6,12 +6,27 @@
 #include <algorithm>
 #include <unordered_map>
 
+/// Add passes to a graph one after another, consecutive pixel passes are run as one fused kernel when fuse is set
+RenderGraph::ResourceID chainPasses(RenderGraph &graph, std::vector<SP<RenderPass>> const &passes, RenderGraph::ResourceID input, bool fuse);
+
 struct LayerPostStack
 {
 	void addToLayer(uint64_t layer, SP<RenderPass> const &renderPass);
 	void removeFromLayer(uint64_t layer, SP<RenderPass> const &renderPass);
 	[[nodiscard]] std::vector<SP<RenderPass>> getPassesForLayer(uint64_t layer);
 	[[nodiscard]] bool empty();
+	
+	/// Whether any of a layer's passes would run, the renderer only draws a layer on its own when one will
+	[[nodiscard]] bool anyEnabled(uint64_t layer) const;
+	
+	/// How far the layer's enabled passes together can spread its content, in pixels
+	[[nodiscard]] float reach(uint64_t layer) const;
+	
+	/// Chain a layer's enabled passes into a graph
+	/// \return The resource holding the layer's processed image, input if the layer has no enabled passes
+	RenderGraph::ResourceID addTo(RenderGraph &graph, uint64_t layer, RenderGraph::ResourceID input);
+	
+	bool fusePixelPasses = true;
 
 private:
 	[[nodiscard]] bool contains(uint64_t layer);
@@ -25,7 +40,21 @@ struct GlobalPostStack
 	void remove(SP<RenderPass> const &renderPass);
 	[[nodiscard]] std::vector<SP<RenderPass>> getPasses();
 	[[nodiscard]] bool empty();
+	
+	/// Whether any pass would run, the renderer only draws the scene offscreen when one will
+	[[nodiscard]] bool anyEnabled() const;
+	
+	/// Chain the enabled passes into a graph
+	/// \return The resource holding the processed image, input if there are no enabled passes
+	RenderGraph::ResourceID addTo(RenderGraph &graph, RenderGraph::ResourceID input);
+	
+	/// Run consecutive pixel passes, ie tonemapping, vignette and dither, as one kernel that reads and writes the image once
+	bool fusePixelPasses = true;
+	
+	/// Alternate fused and unfused frames, so the GPU profiler reports both the fused pass and each pass on its own for comparison
+	bool compareFusion = false;
 
 private:
 	std::vector<SP<RenderPass>> postOrder;
+	uint64_t frames = 0;
 };
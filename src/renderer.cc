@@ -1,10 +1,21 @@
 #include "renderer.hh"
 #include "assets.hh"
 #include "util.hh"
+#include "global.hh"
+#include "api/render/glState.hh"
+#include "api/render/gpuProfiler.hh"
 
 #include <commons/math/quaternion.hh>
 #include <SDL2/SDL_video.h>
 #include <glad/glad.h>
+#include <cstring>
+#include <climits>
+#include <cmath>
+
+namespace
+{
+	constexpr uint32_t layerTargetStep = 64; //Layer targets are rounded up to a multiple of this, so content that moves a little keeps getting the same pooled target
+}
 
 Renderer::Renderer(UP<EventBus_t> const &eventBus, uint32_t contextWidth, uint32_t contextHeight)
 {
@@ -12,30 +23,50 @@ Renderer::Renderer(UP<EventBus_t> const &eventBus, uint32_t contextWidth, uint32
 	this->_contextWidth = contextWidth;
 	this->_contextHeight = contextHeight;
 	this->useBackBuffer();
-	glScissor(0, 0, this->_contextWidth, this->_contextHeight);
-	glViewport(0, 0, this->_contextWidth, this->_contextHeight);
+	GS::scissor(0, 0, this->_contextWidth, this->_contextHeight);
+	GS::viewport(0, 0, this->_contextWidth, this->_contextHeight);
+	
+	//Sprites drawn with the default shader are batched, their quad is instanced from one shared mesh and their transforms are read from a storage buffer
+	std::array<float, 12> quadVerts{0.5f, 0.5f, 0, -0.5f, 0.5f, 0, 0.5f, -0.5f, 0, -0.5f, -0.5f, 0};
+	this->_spriteQuad = MU<Mesh>(quadVerts.data(), quadVerts.size());
+	glCreateBuffers(1, &this->_frameUBO);
+	glNamedBufferStorage(this->_frameUBO, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCreateBuffers(1, &this->_spriteSSBO);
+	this->_glyphs = MU<GlyphCache>();
+	this->_startTime = this->_lastFrameTime = std::chrono::steady_clock::now();
 	
 	//Register event handlers
 	eventBus->registerEventHandler<EventWindowSizeChanged>([this](uint32_t newWidth, uint32_t newHeight)
 	{
-		this->_contextWidth = newWidth;
-		this->_contextHeight = newHeight;
-		glScissor(0, 0, this->_contextWidth, this->_contextHeight);
-		glViewport(0, 0, this->_contextWidth, this->_contextHeight);
+		std::scoped_lock lock(this->_pendingMutex);
+		this->_pendingResize = true;
+		this->_pendingWidth = newWidth;
+		this->_pendingHeight = newHeight;
 	});
 	eventBus->registerEventHandler<EventScreenshot>([this](std::string const &outputPath)
 	{
-		writeScreenshot(outputPath, this->_contextWidth, this->_contextHeight);
+		std::scoped_lock lock(this->_pendingMutex);
+		this->_pendingScreenshots.push_back(outputPath);
 	});
 }
 
 Renderer::~Renderer()
 {
+	glDeleteBuffers(1, &this->_frameUBO);
+	glDeleteBuffers(1, &this->_spriteSSBO);
+	this->_graphTargets.clear();
+	this->_sceneTarget = nullptr;
+	this->framebuffers.clear();
+	this->_glyphs = nullptr;
+	GP::terminate();
+	AR::terminateHotReload();
+	AR::terminateUploads();
+	AR::terminateAtlases(); //Atlases release their textures, so they go first
+	AR::terminateFonts();
 	AR::terminateMeshes();
 	AR::terminateTextures();
 	AR::terminateShaders();
 	AR::terminateASAFiles();
-	AR::terminateAtlases();
 }
 
 void Renderer::clear()
@@ -57,27 +88,27 @@ void Renderer::setSRGBClearColor(float r, float g, float b, float a)
 
 void Renderer::setDepthTesting(bool depthTest)
 {
-	depthTest ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+	GS::setCapability(GS::Capability::DepthTest, depthTest);
 }
 
 void Renderer::setScissorTesting(bool scissorTest)
 {
-	scissorTest ? glEnable(GL_SCISSOR_TEST) : glDisable(GL_SCISSOR_TEST);
+	GS::setCapability(GS::Capability::ScissorTest, scissorTest);
 }
 
 void Renderer::setBlend(bool blend)
 {
-	blend ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+	GS::setCapability(GS::Capability::Blend, blend);
 }
 
 void Renderer::setBlendMode(uint32_t src, uint32_t dst)
 {
-	glBlendFunc(src, dst);
+	GS::blendFunc(src, dst);
 }
 
 void Renderer::setCullFace(bool culling)
 {
-	culling ? glEnable(GL_CULL_FACE) : glDisable(GL_CULL_FACE);
+	GS::setCapability(GS::Capability::CullFace, culling);
 }
 
 uint32_t Renderer::getCurrentMonitorRefreshRate()
@@ -89,7 +120,7 @@ uint32_t Renderer::getCurrentMonitorRefreshRate()
 
 void Renderer::useBackBuffer()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GS::bindFramebuffer(0);
 }
 
 void Renderer::bindImage(uint32_t target, uint32_t const &handle, IO mode, CF format)
@@ -99,7 +130,14 @@ void Renderer::bindImage(uint32_t target, uint32_t const &handle, IO mode, CF fo
 
 void Renderer::startComputeShader(uint32_t contextWidth, uint32_t contextHeight)
 {
-	glDispatchCompute((uint32_t)(std::ceil((float)(contextWidth) / this->workSizeX)), (uint32_t)(std::ceil((float)(contextHeight) / this->workSizeY)), 1);
+	Shader const *shader = Shader::current();
+	if(!shader || shader->workGroupSize[0] == 0)
+	{
+		logger << Sev::ERR << "Trying to start a compute shader without a compute program in use" << logger.endl();
+		return;
+	}
+	auto const [x, y, z] = shader->groupsFor(contextWidth, contextHeight);
+	glDispatchCompute(x, y, z);
 }
 
 void Renderer::draw(DrawMode mode, size_t numElements)
@@ -107,7 +145,13 @@ void Renderer::draw(DrawMode mode, size_t numElements)
 	glDrawArrays((GLenum)mode, 0, (GLsizei)numElements);
 }
 
-void Renderer::drawRenderable(Renderable const &entry)
+void Renderer::draw(DrawMode mode, Mesh const &mesh)
+{
+	if(!mesh.indexed()) return this->draw(mode, mesh.numVerts);
+	glDrawElements((GLenum)mode, (GLsizei)mesh.numIndices, mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, reinterpret_cast<void const*>(mesh.indexOffset));
+}
+
+void Renderer::recordRenderable(Renderable const &entry)
 {
 	quat<float> rotation;
 	rotation.fromAxial(vec3<float>{entry.axis}, degToRad<float>(entry.rotation));
@@ -115,32 +159,500 @@ void Renderer::drawRenderable(Renderable const &entry)
 	roundedPos.round();
 	this->_m = modelMatrix(roundedPos, rotation, vec3<float>(vec2<float>{entry.scale}, 1));
 	this->_mvp = modelViewProjectionMatrix(this->_m, this->_v, this->_p);
-	AR::getShader(entry.shaderID)->use();
-	AR::getShader(entry.shaderID)->sendMat4f("mvp", &this->_mvp.data[0][0]);
+	this->_commands.bindPipeline(AR::getShader(entry.shaderID).get());
+	this->_commands.setMat4f(Uniforms::mvp, &this->_mvp.data[0][0]);
 	std::array<float, 12> quadVerts{0.5f, 0.5f, 0, -0.5f, 0.5f, 0, 0.5f, -0.5f, 0, -0.5f, -0.5f, 0};
 	auto uvs = AR::getAtlas(entry.atlasID)->getUVsForTile(entry.name);
 	std::array<float, 8> quadUVs{uvs.lowerRight.x(), uvs.lowerRight.y(), uvs.lowerLeft.x(), uvs.lowerLeft.y(),uvs.upperRight.x(), uvs.upperRight.y(), uvs.upperLeft.x(), uvs.upperLeft.y()};
-	Mesh mesh(quadVerts.data(), quadVerts.size(), quadUVs.data(), quadUVs.size());
-	mesh.use();
-	this->draw(DrawMode::TRISTRIPS, mesh.numVerts);
+	Mesh const &mesh = *this->_frameMeshes.emplace_back(MU<Mesh>(quadVerts.data(), quadVerts.size(), quadUVs.data(), quadUVs.size()));
+	this->_commands.drawMesh(DrawMode::TRISTRIPS, mesh);
 }
 
-void Renderer::render(RenderList renderList, Camera const &camera)
+void Renderer::recordSprites(RenderList const &renderList, size_t begin, size_t end)
 {
-	this->clear();
-	if(renderList.empty()) return;
-	this->_v = camera.getViewMatrix();
-	this->_p = camera.getOrthoProjectionMatrix();
-	size_t curAtlas = renderList[0].atlasID;
-	AR::getAtlas(curAtlas)->use(0);
-	for(size_t i = 0; i < renderList.size(); i++)
+	UP<Shader> &spriteShader = AR::getShader(AR::shaderSprite);
+	bool const batching = spriteShader && spriteShader->linked;
+	uint32_t batchStart = static_cast<uint32_t>(this->_sprites.size()), boundTexture = 0;
+	auto flush = [&]()
+	{
+		uint32_t const count = static_cast<uint32_t>(this->_sprites.size()) - batchStart;
+		if(count == 0) return;
+		this->_commands.bindPipeline(spriteShader.get());
+		this->_commands.setUInt(Uniforms::firstSprite, batchStart);
+		this->_commands.drawMesh(DrawMode::TRISTRIPS, *this->_spriteQuad, count);
+		batchStart = static_cast<uint32_t>(this->_sprites.size());
+	};
+	
+	//A batch is a run of default shaded sprites from one atlas, anything else ends it so draw order is kept
+	for(size_t i = begin; i < end; i++)
 	{
 		auto const &entry = renderList[i];
-		if(entry.atlasID != curAtlas)
+		UP<Atlas> &atlas = AR::getAtlas(entry.atlasID);
+		if(!atlas || !atlas->isFinalized()) continue;
+		uint32_t const texture = atlas->getHandle();
+		if(texture != boundTexture)
+		{
+			flush();
+			this->_commands.bindTexture(0, texture);
+			boundTexture = texture;
+		}
+		if(!batching || entry.shaderID != AR::shaderObject)
+		{
+			flush();
+			this->recordRenderable(entry);
+			continue;
+		}
+		quat<float> rotation;
+		rotation.fromAxial(vec3<float>{entry.axis}, degToRad<float>(entry.rotation));
+		vec3<float> roundedPos = vec3<float>{vec2<float>{entry.pos}, 0};
+		roundedPos.round();
+		this->_m = modelMatrix(roundedPos, rotation, vec3<float>(vec2<float>{entry.scale}, 1));
+		QuadUVs const uvs = atlas->getUVsForTile(entry.name);
+		SpriteInstance &sprite = this->_sprites.emplace_back();
+		std::memcpy(sprite.model, &this->_m.data[0][0], sizeof(sprite.model));
+		sprite.uvRect[0] = uvs.lowerLeft.x();
+		sprite.uvRect[1] = uvs.lowerLeft.y();
+		sprite.uvRect[2] = uvs.upperRight.x();
+		sprite.uvRect[3] = uvs.upperRight.y();
+	}
+	flush();
+}
+
+void Renderer::recordTexts(std::vector<FrameSnapshot::TextDraw> const &texts, size_t begin, size_t end, Camera const &camera)
+{
+	UP<Shader> &spriteShader = AR::getShader(AR::shaderSprite);
+	if(begin == end || !spriteShader || !spriteShader->linked) return;
+	
+	//Every glyph is in the one atlas, so all of a layer's text is a single batch
+	uint32_t const batchStart = static_cast<uint32_t>(this->_sprites.size());
+	double const viewHeight = camera.viewSize.y() != 0 ? static_cast<double>(camera.viewSize.y()) : static_cast<double>(this->_contextHeight);
+	for(size_t i = begin; i < end; i++)
+	{
+		FrameSnapshot::TextDraw const &text = texts[i];
+		if(text.text.empty()) continue;
+		GlyphCache::GlyphRun const *run = this->_glyphs->shape(text.fontID, text.pixelSize, text.text);
+		if(!run || run->glyphs.empty()) continue;
+		
+		//Runs grow down from their upper left corner while the world's y grows up, so glyphs are placed below the text's position
+		vec2<double> origin = text.hud ? vec2<double>{camera.pos.x() + text.pos.x(), camera.pos.y() + viewHeight - text.pos.y()} : text.pos;
+		origin = {std::round(origin.x()), std::round(origin.y())};
+		double const angle = degToRad<double>(text.rotation), cosAngle = std::cos(angle), sinAngle = std::sin(angle);
+		quat<float> rotation;
+		rotation.fromAxial(vec3<float>{0, 0, 1}, static_cast<float>(angle));
+		for(GlyphCache::PlacedGlyph const &glyph : run->glyphs)
+		{
+			double const offsetX = (glyph.x + glyph.width * 0.5) * text.scale.x(), offsetY = -(glyph.y + glyph.height * 0.5) * text.scale.y();
+			vec3<float> const center{static_cast<float>(origin.x() + offsetX * cosAngle - offsetY * sinAngle), static_cast<float>(origin.y() + offsetX * sinAngle + offsetY * cosAngle), 0};
+			this->_m = modelMatrix(center, rotation, vec3<float>{static_cast<float>(glyph.width * text.scale.x()), static_cast<float>(glyph.height * text.scale.y()), 1});
+			SpriteInstance &sprite = this->_sprites.emplace_back();
+			std::memcpy(sprite.model, &this->_m.data[0][0], sizeof(sprite.model));
+			std::memcpy(sprite.uvRect, glyph.uvRect, sizeof(sprite.uvRect));
+			sprite.color[0] = text.color.x();
+			sprite.color[1] = text.color.y();
+			sprite.color[2] = text.color.z();
+			sprite.color[3] = text.color.w();
+		}
+	}
+	uint32_t const count = static_cast<uint32_t>(this->_sprites.size()) - batchStart;
+	if(count == 0) return;
+	this->_commands.bindTexture(0, this->_glyphs->getHandle());
+	this->_commands.bindPipeline(spriteShader.get());
+	this->_commands.setUInt(Uniforms::firstSprite, batchStart);
+	this->_commands.drawMesh(DrawMode::TRISTRIPS, *this->_spriteQuad, count);
+}
+
+void Renderer::uploadFrameUniforms()
+{
+	auto const now = std::chrono::steady_clock::now();
+	FrameUniforms uniforms;
+	std::memcpy(uniforms.view, &this->_v.data[0][0], sizeof(uniforms.view));
+	std::memcpy(uniforms.projection, &this->_p.data[0][0], sizeof(uniforms.projection));
+	uniforms.resolution[0] = (float)this->_contextWidth;
+	uniforms.resolution[1] = (float)this->_contextHeight;
+	uniforms.resolution[2] = this->_contextWidth ? 1.0f / this->_contextWidth : 0.0f;
+	uniforms.resolution[3] = this->_contextHeight ? 1.0f / this->_contextHeight : 0.0f;
+	uniforms.time = std::chrono::duration<float>(now - this->_startTime).count();
+	uniforms.delta = std::chrono::duration<float>(now - this->_lastFrameTime).count();
+	this->_lastFrameTime = now;
+	glNamedBufferSubData(this->_frameUBO, 0, sizeof(FrameUniforms), &uniforms);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frameUniformBinding, this->_frameUBO);
+}
+
+void Renderer::uploadSprites()
+{
+	if(this->_sprites.empty()) return;
+	size_t const bytes = this->_sprites.size() * sizeof(SpriteInstance);
+	
+	//Respecifying the store orphans last frame's copy, so the driver never waits for draws still reading it
+	if(bytes > this->_spriteCapacity) this->_spriteCapacity = std::max(bytes, this->_spriteCapacity * 2);
+	glNamedBufferData(this->_spriteSSBO, (GLsizeiptr)this->_spriteCapacity, nullptr, GL_STREAM_DRAW);
+	glNamedBufferSubData(this->_spriteSSBO, 0, (GLsizeiptr)bytes, this->_sprites.data());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, spriteBufferBinding, this->_spriteSSBO);
+}
+
+void Renderer::drawTilemap(Tilemap &tilemap, vec2<double> const &layerPos, Camera const &camera)
+{
+	tilemap.rebuild();
+	
+	//Chunks are culled against the camera's view, which is the whole context if the camera hasn't been given a size
+	vec2<double> viewSize = camera.viewSize.x() != 0 && camera.viewSize.y() != 0 ? vec2<double>{camera.viewSize} : vec2<double>{(double)this->_contextWidth, (double)this->_contextHeight};
+	vec2<double> viewMin{camera.pos.x(), camera.pos.y()};
+	vec2<double> viewMax{viewMin.x() + viewSize.x(), viewMin.y() + viewSize.y()};
+	this->_visibleChunks.clear();
+	tilemap.visibleChunks(layerPos, viewMin, viewMax, this->_visibleChunks);
+	if(this->_visibleChunks.empty()) return;
+	
+	UP<Shader> &shader = AR::getShader(tilemap.shaderID);
+	UP<Atlas> &atlas = AR::getAtlas(tilemap.atlasID);
+	if(!shader || !atlas || !atlas->isFinalized()) return;
+	this->_commands.bindTexture(0, atlas->getHandle());
+	this->_commands.bindPipeline(shader.get());
+	quat<float> rotation;
+	rotation.fromAxial(vec3<float>{0, 0, 1}, 0);
+	for(uint32_t index : this->_visibleChunks)
+	{
+		Mesh &mesh = *tilemap.getChunk(index).mesh;
+		this->_m = modelMatrix(vec3<float>{vec2<float>{tilemap.chunkOrigin(index, layerPos)}, 0}, rotation, vec3<float>{1, 1, 1});
+		this->_mvp = modelViewProjectionMatrix(this->_m, this->_v, this->_p);
+		this->_commands.setMat4f(Uniforms::mvp, &this->_mvp.data[0][0]);
+		this->_commands.drawMesh(DrawMode::TRIS, mesh);
+	}
+}
+
+void Renderer::render(RenderList renderList, Camera const &camera, std::vector<SP<Tilemap>> const &tilemaps)
+{
+	FrameSnapshot frame{std::move(renderList), camera, {}, {}};
+	for(auto const &tilemap : tilemaps) if(tilemap) frame.tilemaps.push_back({tilemap, tilemap->pos});
+	this->render(frame);
+}
+
+void Renderer::render(FrameSnapshot const &frame)
+{
+	std::vector<std::string> screenshots;
+	{
+		std::scoped_lock lock(this->_pendingMutex);
+		if(this->_pendingResize)
+		{
+			this->_pendingResize = false;
+			this->_contextWidth = this->_pendingWidth;
+			this->_contextHeight = this->_pendingHeight;
+			GS::scissor(0, 0, this->_contextWidth, this->_contextHeight);
+			GS::viewport(0, 0, this->_contextWidth, this->_contextHeight);
+			
+			//Targets of the old size won't be asked for again
+			this->_graphTargets.clear();
+			this->_sceneTarget = nullptr;
+			this->framebuffers.onResize(this->_contextWidth, this->_contextHeight);
+		}
+		screenshots.swap(this->_pendingScreenshots);
+	}
+	
+	GP::beginFrame();
+	AR::processReloads();
+	AR::processUploads();
+	this->_glyphs->beginFrame();
+	bool const postProcessing = this->postStack.anyEnabled();
+	if(postProcessing) this->bindSceneTarget();
+	else
+	{
+		//Handed back so the pool can reclaim them once post processing has been off for a few frames
+		this->_graphTargets.clear();
+		this->_sceneTarget = nullptr;
+		this->useBackBuffer();
+	}
+	this->clear();
+	this->_v = frame.camera.getViewMatrix();
+	this->_p = frame.camera.getOrthoProjectionMatrix();
+	this->uploadFrameUniforms();
+	this->_sprites.clear();
+	this->_numSegments = 0;
+	auto const [sceneBegin, sceneEnd] = GP::scope("Scene");
+	this->_commands.timestamp(sceneBegin);
+	for(auto const &layer : frame.tilemaps) if(layer.tilemap) this->drawTilemap(*layer.tilemap, layer.pos, frame.camera);
+	
+	//Sprites are recorded a layer at a time, followed by the layer's text, a layer with post passes gets a segment of its own so it can be drawn and processed apart from the scene
+	//The render list and texts are both sorted higher layers first, so they're walked together
+	RenderList const &renderList = frame.renderList;
+	auto const &texts = frame.texts;
+	for(size_t begin = 0, textBegin = 0; begin < renderList.size() || textBegin < texts.size();)
+	{
+		size_t layer = 0;
+		if(begin < renderList.size()) layer = renderList[begin].layer;
+		if(textBegin < texts.size() && (begin == renderList.size() || texts[textBegin].layer > layer)) layer = texts[textBegin].layer;
+		size_t end = begin, textEnd = textBegin;
+		while(end < renderList.size() && renderList[end].layer == layer) end++;
+		while(textEnd < texts.size() && texts[textEnd].layer == layer) textEnd++;
+		if(this->layerPostStack.anyEnabled(layer))
+		{
+			static_cast<void>(this->endSegment());
+			this->recordSprites(renderList, begin, end);
+			size_t const firstGlyph = this->_sprites.size();
+			this->recordTexts(texts, textBegin, textEnd, frame.camera);
+			DrawSegment &segment = this->endSegment();
+			segment.layerPost = true;
+			segment.layer = layer;
+			segment.minX = segment.minY = INT32_MAX;
+			segment.maxX = segment.maxY = INT32_MIN;
+			for(size_t i = begin; i < end; i++) this->growLayerBounds(segment, renderList[i]);
+			for(size_t i = firstGlyph; i < this->_sprites.size(); i++)
+			{
+				std::memcpy(&this->_m.data[0][0], this->_sprites[i].model, sizeof(SpriteInstance::model));
+				this->growLayerBounds(segment, this->_m);
+			}
+		}
+		else
+		{
+			this->recordSprites(renderList, begin, end);
+			this->recordTexts(texts, textBegin, textEnd, frame.camera);
+		}
+		begin = end;
+		textBegin = textEnd;
+	}
+	this->_commands.timestamp(sceneEnd);
+	static_cast<void>(this->endSegment());
+	this->uploadSprites();
+	
+	uint32_t const sceneFramebuffer = postProcessing ? this->_sceneTarget->handle : 0;
+	for(size_t i = 0; i < this->_numSegments; i++)
+	{
+		DrawSegment &segment = this->_segments[i];
+		if(segment.layerPost) this->drawLayerPost(segment, sceneFramebuffer);
+		else
+		{
+			GS::bindFramebuffer(sceneFramebuffer);
+			this->submit(segment.commands);
+		}
+		segment.commands.clear();
+	}
+	this->_layerTargets.clear();
+	this->_frameMeshes.clear();
+	if(postProcessing) this->applyPostStack();
+	
+	//Taken before the swap, while the back buffer still holds the finished frame
+	for(auto const &outputPath : screenshots) writeScreenshot(outputPath, this->_contextWidth, this->_contextHeight);
+	this->framebuffers.endFrame();
+	GS::endFrame();
+}
+
+void Renderer::bindSceneTarget()
+{
+	this->_sceneTarget = nullptr; //Released first so the pool hands the same one back
+	this->_sceneTarget = this->framebuffers.acquire(this->_contextWidth, this->_contextHeight, {Attachment::Color, Attachment::Alpha, Attachment::Depth});
+	this->_sceneTarget->use();
+	GS::viewport(0, 0, this->_contextWidth, this->_contextHeight);
+}
+
+Renderer::DrawSegment& Renderer::endSegment()
+{
+	if(this->_numSegments == this->_segments.size()) this->_segments.emplace_back();
+	DrawSegment &segment = this->_segments[this->_numSegments++];
+	std::swap(segment.commands, this->_commands); //The segment's buffer was cleared when it was last submitted, so recording carries on into an empty one
+	segment.layerPost = false;
+	return segment;
+}
+
+void Renderer::growLayerBounds(DrawSegment &segment, Renderable const &entry)
+{
+	quat<float> rotation;
+	rotation.fromAxial(vec3<float>{entry.axis}, degToRad<float>(entry.rotation));
+	vec3<float> roundedPos = vec3<float>{vec2<float>{entry.pos}, 0};
+	roundedPos.round();
+	this->growLayerBounds(segment, modelMatrix(roundedPos, rotation, vec3<float>(vec2<float>{entry.scale}, 1)));
+}
+
+void Renderer::growLayerBounds(DrawSegment &segment, mat4x4<float> const &model)
+{
+	mat4x4<float> const mvp = modelViewProjectionMatrix(model, this->_v, this->_p);
+	for(float const cornerX : {-0.5f, 0.5f})
+	{
+		for(float const cornerY : {-0.5f, 0.5f})
+		{
+			//Matrices are laid out column by column, the way they're uploaded to GL
+			float const clipX = mvp.data[0][0] * cornerX + mvp.data[1][0] * cornerY + mvp.data[3][0];
+			float const clipY = mvp.data[0][1] * cornerX + mvp.data[1][1] * cornerY + mvp.data[3][1];
+			float const clipW = mvp.data[0][3] * cornerX + mvp.data[1][3] * cornerY + mvp.data[3][3];
+			if(clipW == 0.0f) continue;
+			float const pixelX = (clipX / clipW * 0.5f + 0.5f) * static_cast<float>(this->_contextWidth);
+			float const pixelY = (clipY / clipW * 0.5f + 0.5f) * static_cast<float>(this->_contextHeight);
+			segment.minX = std::min(segment.minX, static_cast<int32_t>(std::floor(pixelX)));
+			segment.minY = std::min(segment.minY, static_cast<int32_t>(std::floor(pixelY)));
+			segment.maxX = std::max(segment.maxX, static_cast<int32_t>(std::ceil(pixelX)));
+			segment.maxY = std::max(segment.maxY, static_cast<int32_t>(std::ceil(pixelY)));
+		}
+	}
+}
+
+void Renderer::drawLayerPost(DrawSegment &segment, uint32_t sceneFramebuffer)
+{
+	//Grown by how far the passes spread, then clipped to the screen
+	int32_t const pad = static_cast<int32_t>(std::ceil(this->layerPostStack.reach(segment.layer)));
+	int32_t const x = std::max(segment.minX - pad, 0), y = std::max(segment.minY - pad, 0);
+	int32_t const right = std::min(segment.maxX + pad, static_cast<int32_t>(this->_contextWidth));
+	int32_t const top = std::min(segment.maxY + pad, static_cast<int32_t>(this->_contextHeight));
+	if(right <= x || top <= y) return;
+	uint32_t const width = (static_cast<uint32_t>(right - x) + layerTargetStep - 1) / layerTargetStep * layerTargetStep;
+	uint32_t const height = (static_cast<uint32_t>(top - y) + layerTargetStep - 1) / layerTargetStep * layerTargetStep;
+	
+	//The viewport is offset so the layer lands on its target where it would on screen, only the region is ever rasterized or processed
+	SP<Framebuffer> const &target = this->_layerTargets.emplace_back(this->framebuffers.acquire(width, height, {Attachment::Color, Attachment::Alpha, Attachment::Depth}));
+	float const transparent[4] = {0.0f, 0.0f, 0.0f, 0.0f}, farDepth = 1.0f;
+	glClearNamedFramebufferfv(target->handle, GL_COLOR, 0, transparent);
+	glClearNamedFramebufferfv(target->handle, GL_DEPTH, 0, &farDepth);
+	target->use();
+	GS::viewport(-x, -y, static_cast<int32_t>(this->_contextWidth), static_cast<int32_t>(this->_contextHeight));
+	
+	//Alpha is accumulated the way premultiplied compositing expects, so edges that aren't fully opaque come out as they would drawn straight onto the scene
+	GS::BlendFactors const blend = GS::currentBlendFunc();
+	GS::blendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	this->submit(segment.commands);
+	
+	this->_layerGraph.clear();
+	RenderGraph::ResourceID const layerImage = this->_layerGraph.importResource("Layer " + std::to_string(segment.layer), CF::RGBA32F, width, height, target->colorHandle);
+	RenderGraph::ResourceID const result = this->layerPostStack.addTo(this->_layerGraph, segment.layer, layerImage);
+	this->_layerGraph.markOutput(result);
+	this->_layerGraph.compile(width, height);
+	this->execute(this->_layerGraph);
+	
+	//Composited as premultiplied, so light a pass spreads onto transparent texels, ie a glow, is added onto the scene rather than hidden by their alpha
+	GS::bindFramebuffer(sceneFramebuffer);
+	GS::viewport(x, y, static_cast<int32_t>(width), static_cast<int32_t>(height));
+	UP<Shader> &transfer = AR::getShader(AR::shaderTransfer);
+	UP<Mesh> &quad = AR::getMesh(AR::meshFullscreenQuad);
+	if(transfer && quad)
+	{
+		GS::blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		this->_commands.bindTexture(0, this->_layerGraph.texture(this->_layerGraph.isDefined(result) ? result : layerImage));
+		this->_commands.bindPipeline(transfer.get());
+		this->_commands.drawMesh(DrawMode::TRISTRIPS, *quad);
+		this->submit(this->_commands);
+		this->_commands.clear();
+	}
+	if(blend.srcRGB != 0xFFFFFFFF) GS::blendFuncSeparate(blend.srcRGB, blend.dstRGB, blend.srcAlpha, blend.dstAlpha);
+	GS::viewport(0, 0, static_cast<int32_t>(this->_contextWidth), static_cast<int32_t>(this->_contextHeight));
+}
+
+void Renderer::applyPostStack()
+{
+	this->_postGraph.clear();
+	RenderGraph::ResourceID const scene = this->_postGraph.importResource("Scene", CF::RGBA32F, this->_contextWidth, this->_contextHeight, this->_sceneTarget->colorHandle);
+	RenderGraph::ResourceID const result = this->postStack.addTo(this->_postGraph, scene);
+	this->_postGraph.markOutput(result);
+	this->_postGraph.compile(this->_contextWidth, this->_contextHeight);
+	this->execute(this->_postGraph);
+	
+	//The graph ends with a barrier, so its result can be sampled straight away
+	//If the stack couldn't produce one the scene is shown unprocessed, compile has already logged why
+	this->useBackBuffer();
+	this->clear();
+	UP<Shader> &transfer = AR::getShader(AR::shaderTransfer);
+	UP<Mesh> &quad = AR::getMesh(AR::meshFullscreenQuad);
+	if(!transfer || !quad) return;
+	this->_commands.bindTexture(0, this->_postGraph.texture(this->_postGraph.isDefined(result) ? result : scene));
+	this->_commands.bindPipeline(transfer.get());
+	this->_commands.drawMesh(DrawMode::TRISTRIPS, *quad);
+	this->submit(this->_commands);
+	this->_commands.clear();
+}
+
+void Renderer::execute(RenderGraph &graph)
+{
+	//Physical textures come from the framebuffer pool, last execution's are released first so a graph that compiles the same way each frame gets the same ones back
+	this->_graphTargets.clear();
+	auto const &physical = graph.getPhysical();
+	for(size_t i = 0; i < physical.size(); i++)
+	{
+		RenderGraph::Physical const &target = physical[i];
+		SP<Framebuffer> const &fbo = this->_graphTargets.emplace_back(this->framebuffers.acquire(target.width, target.height, {Attachment::Color}, target.format));
+		graph.setPhysicalHandle(i, fbo->colorHandle);
+	}
+	
+	//Passes in a group don't touch each other's images, so they only need a barrier before the next group reads what they wrote
+	//When profiling, each pass is timed on its own, passes in a group can overlap on the GPU so their times may add up to more than the group took
+	RenderGraph::PassContext const context{graph, this->_graphCommands};
+	for(auto const &group : graph.getGroups())
+	{
+		for(RenderGraph::PassID id : group)
+		{
+			RenderGraph::Pass const &pass = graph.getPass(id);
+			if(!pass.execute) continue;
+			auto const [begin, end] = GP::scope(pass.name);
+			this->_graphCommands.timestamp(begin);
+			pass.execute(context);
+			this->_graphCommands.timestamp(end);
+		}
+		this->_graphCommands.barrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	}
+	this->submit(this->_graphCommands);
+	this->_graphCommands.clear();
+}
+
+void Renderer::submit(CommandBuffer const &commands)
+{
+	Shader *pipeline = nullptr;
+	for(Command const &command : commands.getCommands())
+	{
+		switch(command.type)
 		{
-			curAtlas = entry.atlasID;
-			AR::getAtlas(curAtlas)->use(0);
+			case CommandType::BindPipeline:
+				pipeline = command.bindPipeline.shader;
+				if(pipeline) pipeline->use();
+				break;
+			case CommandType::BindTexture:
+				GS::bindTextureUnit(command.bindTexture.unit, command.bindTexture.handle);
+				break;
+			case CommandType::BindImage:
+			{
+				Command::BindImage const &image = command.bindImage;
+				glBindImageTexture(image.unit, image.handle, 0, GL_FALSE, 0, (uint32_t)image.access, (uint32_t)image.format);
+				break;
+			}
+			case CommandType::BindMesh:
+				GS::bindVertexArray(command.bindMesh.mesh ? command.bindMesh.mesh->vao : 0);
+				break;
+			case CommandType::SetUniform:
+			{
+				if(!pipeline) break;
+				Command::SetUniform const &uniform = command.setUniform;
+				int32_t const location = pipeline->getUniformHandle(UniformID::fromHash(uniform.uniform));
+				auto const *floats = reinterpret_cast<float const*>(commands.getUniformData(uniform));
+				switch(uniform.type)
+				{
+					case UniformType::Float: glUniform1f(location, commands.getUniform<float>(uniform)); break;
+					case UniformType::Int: glUniform1i(location, commands.getUniform<int32_t>(uniform)); break;
+					case UniformType::UInt: glUniform1ui(location, commands.getUniform<uint32_t>(uniform)); break;
+					case UniformType::Vec2f: glUniform2fv(location, 1, floats); break;
+					case UniformType::Vec3f: glUniform3fv(location, 1, floats); break;
+					case UniformType::Vec4f: glUniform4fv(location, 1, floats); break;
+					case UniformType::Mat3f: glUniformMatrix3fv(location, 1, GL_FALSE, floats); break;
+					case UniformType::Mat4f: glUniformMatrix4fv(location, 1, GL_FALSE, floats); break;
+				}
+				break;
+			}
+			case CommandType::Draw:
+			{
+				Command::Draw const &draw = command.draw;
+				if(draw.instances == 1) glDrawArrays((GLenum)draw.mode, (GLint)draw.first, (GLsizei)draw.count);
+				else glDrawArraysInstanced((GLenum)draw.mode, (GLint)draw.first, (GLsizei)draw.count, (GLsizei)draw.instances);
+				break;
+			}
+			case CommandType::DrawIndexed:
+			{
+				Command::DrawIndexed const &draw = command.drawIndexed;
+				GLenum const indexType = draw.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+				void const *offset = reinterpret_cast<void const*>(draw.indexOffset);
+				if(draw.instances == 1) glDrawElements((GLenum)draw.mode, (GLsizei)draw.count, indexType, offset);
+				else glDrawElementsInstanced((GLenum)draw.mode, (GLsizei)draw.count, indexType, offset, (GLsizei)draw.instances);
+				break;
+			}
+			case CommandType::Dispatch:
+				glDispatchCompute(command.dispatch.groupsX, command.dispatch.groupsY, command.dispatch.groupsZ);
+				break;
+			case CommandType::Barrier:
+				glMemoryBarrier(command.barrier.bits);
+				break;
+			case CommandType::Timestamp:
+				glQueryCounter(command.timestamp.query, GL_TIMESTAMP);
+				break;
 		}
-		this->drawRenderable(entry);
 	}
 }
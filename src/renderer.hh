@@ -6,41 +6,85 @@
 #include "events.hh"
 #include "api/assets/camera.hh"
 #include "api/render/renderList.hh"
+#include "api/render/mesh.hh"
+#include "api/render/commandBuffer.hh"
+#include "api/render/renderGraph.hh"
+#include "api/render/framebuffer.hh"
+#include "api/render/glyphCache.hh"
 #include "postStack.hh"
+#include "tilemap.hh"
 
 #include <commons/math/vec2.hh>
+#include <commons/math/vec4.hh>
 #include <commons/math/mat4.hh>
+#include <chrono>
 #include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
 
-/// Access types for compute shader imnage binding
-enum struct IO
+/// Everything needed to draw a frame, taken from the world by the simulation so the renderer never reads live simulation state
+struct FrameSnapshot
 {
-	READ = 0x88B8, WRITE = 0x88B9, READWRITE = 0x88BA
+	struct TilemapLayer
+	{
+		SP<Tilemap> tilemap = nullptr;
+		vec2<double> pos{}; //The layer's position when the snapshot was taken
+	};
+	
+	/// A TextComponent as it was when the snapshot was taken
+	struct TextDraw
+	{
+		std::string text;
+		vec2<double> pos{}, scale{};
+		double rotation = 0;
+		vec4<float> color{};
+		uint64_t fontID = 0;
+		uint32_t pixelSize = 0;
+		size_t layer = 0, sublayer = 0, order = 0; //Sorted like the render list, higher layers first, ties kept in the objects' order
+		bool hud = false; //pos is from the upper left corner of the view rather than the world's origin
+	};
+	
+	RenderList renderList;
+	Camera camera;
+	std::vector<TilemapLayer> tilemaps;
+	std::vector<TextDraw> texts; //Resized rather than cleared between snapshots, so their strings keep their memory
 };
 
-/// Color format for compute shader image binding
-enum struct CF
+/// Values shared by every draw in a frame, laid out std140 and bound once per frame to Renderer::frameUniformBinding
+struct FrameUniforms
 {
-	R32F = 0x822E, RGB8 = 0x8051, RGBA8 = 0x8058, RGB16 = 0x8054, RGBA16 = 0x805B, RGB32I = 0x8D83, RGBA32I = 0x8D82,
-	RGB32UI = 0x8D71, RGBA32UI = 0x8D70, RGB16F = 0x881B, RGBA16F = 0x881A, RGB32F = 0x8815, RGBA32F = 0x8814,
-	DEPTH32F = 0x8CAC,
+	float view[16]{}, projection[16]{};
+	float resolution[4]{}; //Width, height, 1 / width, 1 / height
+	float time = 0, delta = 0; //Seconds since the renderer was created, and since the previous frame
+	float padding[2]{};
 };
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must match the std140 block");
 
-/// Mode to draw a VAO in
-enum struct DrawMode
+/// One batched sprite, laid out std430 in the sprite storage buffer
+struct SpriteInstance
 {
-	TRIS = 0x0004, TRISTRIPS = 0x0005, TRIFANS = 0x0006,
-	LINES = 0x0001, LINESTRIPS = 0x0003, LINELOOPS = 0x0002,
-	POINTS = 0x0000,
+	float model[16]{};
+	float uvRect[4]{}; //Left, lower, right, upper
+	float color[4]{1, 1, 1, 1}; //Multiplied with the texture, glyphs are white so this is their color
 };
+static_assert(sizeof(SpriteInstance) == 96, "SpriteInstance must match the std430 struct");
 
 struct Renderer
 {
+	static constexpr uint32_t frameUniformBinding = 0, spriteBufferBinding = 0;
+	
 	Renderer(UP<EventBus_t> const &eventBus, uint32_t contextWidth, uint32_t contextHeight);
 	~Renderer();
 	
-	/// Render a given list
-	void render(RenderList renderList, Camera const &camera);
+	/// Render a given list, on top of any tilemaps
+	/// \param tilemaps Static tile layers, drawn in order, only their chunks that overlap the camera's view are drawn
+	void render(RenderList renderList, Camera const &camera, std::vector<SP<Tilemap>> const &tilemaps = {});
+	
+	/// Render a frame snapshot, on the thread that owns the GL context
+	/// Its texts are drawn through the glyph cache, after the sprites of their layer
+	/// Resizes and screenshots requested through events since the last frame are applied here
+	void render(FrameSnapshot const &frame);
 	
 	/// Set the RGBA color to clear the context to
 	void setClearColor(float r, float g, float b, float a);
@@ -75,20 +119,84 @@ struct Renderer
 	/// Bind a texture for use with compute shaders
 	void bindImage(uint32_t target, uint32_t const &handle, IO mode, CF format);
 	
-	/// Run the currently bound compute shader program
+	/// Run the shader last used over a grid of contextWidth * contextHeight invocations, in groups of the program's own local size
 	void startComputeShader(uint32_t contextWidth, uint32_t contextHeight);
 	
 	/// Run the currently bound vert/frag shader program
 	void draw(DrawMode mode, size_t numElements);
 	
+	/// Draw a mesh, through its element buffer if it's indexed, the mesh must already be in use
+	void draw(DrawMode mode, Mesh const &mesh);
+	
+	/// Replay recorded commands against GL, binds go through GLState so ones that are already bound are skipped
+	void submit(CommandBuffer const &commands);
+	
+	/// Take the physical textures of a compiled graph from the framebuffer pool and run its passes, with a barrier between each of its groups
+	void execute(RenderGraph &graph);
+	
 	RenderList list;
 	
-	uint32_t workSizeX = 40, workSizeY = 20;
+	/// Passes run over each finished frame, when any are enabled the scene is drawn offscreen and the stack's result is copied to the back buffer
+	GlobalPostStack postStack;
+	
+	/// Passes run over single layers, a layer with any enabled is drawn on its own and only the part of the screen its content covers is processed
+	/// Each layer is processed at the size of its bounds, so passes that depend on the image's size, ie vignette, work over those bounds rather than the screen
+	LayerPostStack layerPostStack;
+	
+	/// Offscreen targets for the scene and render graphs, reused across frames by size and format
+	/// Its cap, stats and report are only safe to use from the thread that owns the GL context
+	FramebufferPool framebuffers;
 
 private:
-	void drawRenderable(Renderable const &entry);
+	void recordRenderable(Renderable const &entry);
+	void recordSprites(RenderList const &renderList, size_t begin, size_t end);
+	void recordTexts(std::vector<FrameSnapshot::TextDraw> const &texts, size_t begin, size_t end, Camera const &camera);
+	void uploadFrameUniforms();
+	void uploadSprites();
+	void drawTilemap(Tilemap &tilemap, vec2<double> const &layerPos, Camera const &camera);
+	void bindSceneTarget();
+	void applyPostStack();
+	
+	/// A run of the frame's draws, drawn onto the scene or, for a layer with post passes, onto a target of its own
+	struct DrawSegment
+	{
+		CommandBuffer commands;
+		bool layerPost = false;
+		size_t layer = 0;
+		int32_t minX = 0, minY = 0, maxX = 0, maxY = 0; //Pixel bounds of the layer's content, bottom left origin
+	};
+	
+	/// Move the draws recorded so far into a new segment
+	DrawSegment& endSegment();
+	void growLayerBounds(DrawSegment &segment, Renderable const &entry);
+	void growLayerBounds(DrawSegment &segment, mat4x4<float> const &model);
+	void drawLayerPost(DrawSegment &segment, uint32_t sceneFramebuffer);
 	
 	uint32_t _contextWidth, _contextHeight;
+	
+	//Events can be posted from any thread, so their GL work is queued here for the next render
+	std::mutex _pendingMutex;
+	bool _pendingResize = false;
+	uint32_t _pendingWidth = 0, _pendingHeight = 0;
+	std::vector<std::string> _pendingScreenshots;
 	Color _clearColor;
 	mat4x4<float> _m, _v, _p, _mvp;
+	std::vector<uint32_t> _visibleChunks;
+	CommandBuffer _commands; //The frame's draws, recorded then submitted
+	std::vector<UP<Mesh>> _frameMeshes; //Quads for sprites that couldn't be batched, kept alive until _commands is submitted
+	std::vector<SpriteInstance> _sprites;
+	UP<Mesh> _spriteQuad = nullptr;
+	UP<GlyphCache> _glyphs = nullptr;
+	uint32_t _frameUBO = 0, _spriteSSBO = 0;
+	size_t _spriteCapacity = 0; //Bytes allocated for _spriteSSBO
+	std::chrono::steady_clock::time_point _startTime, _lastFrameTime;
+	
+	SP<Framebuffer> _sceneTarget = nullptr; //Only held while a post pass is enabled
+	RenderGraph _postGraph;
+	CommandBuffer _graphCommands;
+	std::vector<SP<Framebuffer>> _graphTargets; //The last executed graph's physical textures, held until the next graph is executed
+	std::vector<DrawSegment> _segments; //Reused between frames so their commands keep their memory
+	size_t _numSegments = 0;
+	RenderGraph _layerGraph;
+	std::vector<SP<Framebuffer>> _layerTargets; //Held until the end of the frame, which is when the pool reclaims
 };
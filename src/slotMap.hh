@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// Handle-addressed storage with O(1) insertion, removal, and lookup
+/// Handles pack a slot index into the low 32 bits and that slot's generation into the high 32 bits
+/// A slot's generation is bumped whenever it's freed, so handles to removed values are detected as stale even after the slot is reused
+/// Generations start at 1, so 0 is never a valid handle and can be used to mean "nothing"
+template <typename T> struct SlotMap
+{
+	/// Store a value in a free slot, reusing previously freed slots before growing
+	/// \return The new value's handle
+	[[nodiscard]] uint64_t insert(T &&value)
+	{
+		uint32_t index = 0;
+		if(!this->freeList.empty())
+		{
+			index = this->freeList.back();
+			this->freeList.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(this->slots.size());
+			this->slots.emplace_back();
+		}
+		Slot &slot = this->slots[index];
+		slot.value = std::move(value);
+		slot.occupied = true;
+		this->count++;
+		return makeHandle(index, slot.generation);
+	}
+	
+	/// Remove the value the handle refers to, invalidating the handle
+	/// \return False if the handle was invalid or stale
+	bool erase(uint64_t handle)
+	{
+		if(!this->contains(handle)) return false;
+		uint32_t index = indexOf(handle);
+		this->release(index);
+		return true;
+	}
+	
+	/// Check whether the handle refers to a live value
+	[[nodiscard]] bool contains(uint64_t handle) const
+	{
+		uint32_t index = indexOf(handle);
+		return index < this->slots.size() && this->slots[index].occupied && this->slots[index].generation == generationOf(handle);
+	}
+	
+	/// Get the value the handle refers to
+	/// \return The value, or a reference to a default constructed value if the handle is invalid or stale
+	[[nodiscard]] T& get(uint64_t handle)
+	{
+		if(!this->contains(handle))
+		{
+			this->nValue = T{};
+			return this->nValue;
+		}
+		return this->slots[indexOf(handle)].value;
+	}
+	
+	/// Remove every value, all existing handles become stale
+	void clear()
+	{
+		for(uint32_t i = 0; i < this->slots.size(); i++) if(this->slots[i].occupied) this->release(i);
+	}
+	
+	/// The number of live values
+	[[nodiscard]] size_t size() const
+	{
+		return this->count;
+	}
+	
+	[[nodiscard]] bool empty() const
+	{
+		return this->count == 0;
+	}
+	
+	/// Call func(handle, value) for every live value
+	template <typename F> void forEach(F const &func)
+	{
+		for(uint32_t i = 0; i < this->slots.size(); i++) if(this->slots[i].occupied) func(makeHandle(i, this->slots[i].generation), this->slots[i].value);
+	}
+
+private:
+	struct Slot
+	{
+		T value{};
+		uint32_t generation = 1;
+		bool occupied = false;
+	};
+	
+	[[nodiscard]] static inline uint64_t makeHandle(uint32_t index, uint32_t generation)
+	{
+		return (static_cast<uint64_t>(generation) << 32) | index;
+	}
+	
+	[[nodiscard]] static inline uint32_t indexOf(uint64_t handle)
+	{
+		return static_cast<uint32_t>(handle & 0xFFFFFFFF);
+	}
+	
+	[[nodiscard]] static inline uint32_t generationOf(uint64_t handle)
+	{
+		return static_cast<uint32_t>(handle >> 32);
+	}
+	
+	void release(uint32_t index)
+	{
+		Slot &slot = this->slots[index];
+		slot.value = T{};
+		slot.occupied = false;
+		slot.generation++;
+		if(slot.generation == 0) slot.generation = 1; //Generation 0 is reserved so that a handle of 0 is never valid
+		this->freeList.push_back(index);
+		this->count--;
+	}
+	
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeList;
+	size_t count = 0;
+	T nValue{};
+};
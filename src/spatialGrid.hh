@@ -0,0 +1,150 @@
+#pragma once
+
+#include <commons/math/vec2.hh>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+/// A uniform grid over world space for finding the items near a region without visiting every item
+/// Items are bucketed into every cell their bounds overlap, and are only rebucketed when they move into a different set of cells
+template <typename T> struct SpatialGrid
+{
+	explicit SpatialGrid(double cellSize = 256.0) : cellSize(cellSize) {}
+	
+	/// Insert an item, or move it if it's already in the grid
+	void update(T const &item, vec2<double> const &min, vec2<double> const &max)
+	{
+		CellRange range = this->rangeOf(min, max);
+		auto [it, inserted] = this->items.try_emplace(item);
+		Entry &entry = it->second;
+		entry.min = min;
+		entry.max = max;
+		entry.synced = this->syncStamp;
+		if(!inserted && entry.range == range) return;
+		if(!inserted) this->unbucket(item, entry.range);
+		entry.range = range;
+		this->bucket(item, range);
+	}
+	
+	void remove(T const &item)
+	{
+		auto it = this->items.find(item);
+		if(it == this->items.end()) return;
+		this->unbucket(item, it->second.range);
+		this->items.erase(it);
+	}
+	
+	/// Start a full resync, items that aren't update()d before endSync() are removed
+	void beginSync()
+	{
+		this->syncStamp++;
+	}
+	
+	void endSync()
+	{
+		for(auto it = this->items.begin(); it != this->items.end();)
+		{
+			if(it->second.synced != this->syncStamp)
+			{
+				this->unbucket(it->first, it->second.range);
+				it = this->items.erase(it);
+			}
+			else it++;
+		}
+	}
+	
+	/// Call func once for every item whose bounds overlap the region
+	/// \return How many candidates were visited, ie items in the overlapped cells
+	template <typename F> size_t query(vec2<double> const &min, vec2<double> const &max, F &&func)
+	{
+		CellRange range = this->rangeOf(min, max);
+		this->queryStamp++;
+		size_t visited = 0;
+		for(int64_t y = range.minY; y <= range.maxY; y++)
+		{
+			for(int64_t x = range.minX; x <= range.maxX; x++)
+			{
+				auto cell = this->cells.find(cellKey(x, y));
+				if(cell == this->cells.end()) continue;
+				for(auto const &item : cell->second)
+				{
+					Entry &entry = this->items.find(item)->second;
+					if(entry.queried == this->queryStamp) continue; //Already seen in another cell
+					entry.queried = this->queryStamp;
+					visited++;
+					if(entry.max.x() >= min.x() && entry.min.x() <= max.x() && entry.max.y() >= min.y() && entry.min.y() <= max.y()) func(item);
+				}
+			}
+		}
+		return visited;
+	}
+	
+	void clear()
+	{
+		this->cells.clear();
+		this->items.clear();
+	}
+	
+	[[nodiscard]] size_t size() const
+	{
+		return this->items.size();
+	}
+
+private:
+	struct CellRange
+	{
+		bool operator==(CellRange const &other) const = default;
+		
+		int64_t minX = 0, minY = 0, maxX = -1, maxY = -1;
+	};
+	
+	struct Entry
+	{
+		vec2<double> min{}, max{};
+		CellRange range{};
+		uint64_t synced = 0, queried = 0;
+	};
+	
+	[[nodiscard]] static uint64_t cellKey(int64_t x, int64_t y)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+	}
+	
+	[[nodiscard]] CellRange rangeOf(vec2<double> const &min, vec2<double> const &max) const
+	{
+		return {static_cast<int64_t>(std::floor(min.x() / this->cellSize)), static_cast<int64_t>(std::floor(min.y() / this->cellSize)),
+				static_cast<int64_t>(std::floor(max.x() / this->cellSize)), static_cast<int64_t>(std::floor(max.y() / this->cellSize))};
+	}
+	
+	void bucket(T const &item, CellRange const &range)
+	{
+		for(int64_t y = range.minY; y <= range.maxY; y++) for(int64_t x = range.minX; x <= range.maxX; x++) this->cells[cellKey(x, y)].push_back(item);
+	}
+	
+	void unbucket(T const &item, CellRange const &range)
+	{
+		for(int64_t y = range.minY; y <= range.maxY; y++)
+		{
+			for(int64_t x = range.minX; x <= range.maxX; x++)
+			{
+				auto cell = this->cells.find(cellKey(x, y));
+				if(cell == this->cells.end()) continue;
+				auto &bucket = cell->second;
+				auto it = std::find(bucket.begin(), bucket.end(), item);
+				if(it != bucket.end())
+				{
+					*it = bucket.back(); //Order within a cell doesn't matter
+					bucket.pop_back();
+				}
+				if(bucket.empty()) this->cells.erase(cell);
+			}
+		}
+	}
+	
+	double cellSize = 256.0;
+	std::unordered_map<uint64_t, std::vector<T>> cells;
+	std::unordered_map<T, Entry> items;
+	uint64_t syncStamp = 0, queryStamp = 0;
+};
@@ -0,0 +1,154 @@
+#include "tilemap.hh"
+#include "assets.hh"
+#include "global.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <cmath>
+
+Tilemap::Tilemap(uint32_t width, uint32_t height, vec2<double> const &tileSize, uint64_t atlasID, uint64_t shaderID)
+{
+	this->width = width;
+	this->height = height;
+	this->tileSize = tileSize;
+	this->atlasID = atlasID;
+	this->shaderID = shaderID;
+	this->tiles.resize(static_cast<size_t>(width) * height, emptyTile);
+	this->chunksX = (width + chunkSize - 1) / chunkSize;
+	this->chunksY = (height + chunkSize - 1) / chunkSize;
+	this->chunks.resize(static_cast<size_t>(this->chunksX) * this->chunksY);
+	
+	//Whole number tile sizes fit in 16 bit chunk relative positions as long as the chunk is small enough, which halves the vertex size
+	double const chunkExtent = std::max(tileSize.x(), tileSize.y()) * chunkSize;
+	bool const shortPositions = tileSize.x() == std::floor(tileSize.x()) && tileSize.y() == std::floor(tileSize.y()) && chunkExtent <= 32767.0;
+	this->layout = VertexLayout::make(shortPositions ? VertexFormat::Short2 : VertexFormat::Float2, VertexFormat::UNorm16x2);
+}
+
+uint16_t Tilemap::addTileType(std::string const &tileName)
+{
+	std::scoped_lock lock(this->mutex);
+	auto it = std::find(this->tileNames.begin(), this->tileNames.end(), tileName);
+	if(it != this->tileNames.end()) return static_cast<uint16_t>(it - this->tileNames.begin());
+	if(this->tileNames.size() > ui16Max)
+	{
+		logger << Sev::ERR << "Too many tile types in tilemap, can't add " << tileName << logger.endl();
+		return emptyTile;
+	}
+	this->tileNames.push_back(tileName);
+	return static_cast<uint16_t>(this->tileNames.size() - 1);
+}
+
+void Tilemap::setTile(uint32_t x, uint32_t y, uint16_t tile)
+{
+	std::scoped_lock lock(this->mutex);
+	if(x >= this->width || y >= this->height || tile >= this->tileNames.size()) return;
+	uint16_t &cur = this->tiles[static_cast<size_t>(y) * this->width + x];
+	if(cur == tile) return;
+	cur = tile;
+	this->chunks[(y / chunkSize) * this->chunksX + x / chunkSize].dirty = true;
+}
+
+uint16_t Tilemap::getTile(uint32_t x, uint32_t y) const
+{
+	if(x >= this->width || y >= this->height) return emptyTile;
+	std::scoped_lock lock(this->mutex);
+	return this->tiles[static_cast<size_t>(y) * this->width + x];
+}
+
+void Tilemap::rebuild()
+{
+	std::scoped_lock lock(this->mutex);
+	if(this->tileUVs.size() != this->tileNames.size())
+	{
+		UP<Atlas> &atlas = AR::getAtlas(this->atlasID);
+		if(!atlas) return;
+		this->tileUVs.resize(this->tileNames.size());
+		for(size_t i = 1; i < this->tileNames.size(); i++)
+		{
+			if(!atlas->contains(this->tileNames[i])) logger << Sev::ERR << "Tilemap's atlas doesn't contain the tile " << this->tileNames[i] << logger.endl();
+			else this->tileUVs[i] = atlas->getUVsForTile(this->tileNames[i]);
+		}
+	}
+	for(uint32_t chunkY = 0; chunkY < this->chunksY; chunkY++)
+	{
+		for(uint32_t chunkX = 0; chunkX < this->chunksX; chunkX++)
+		{
+			if(this->chunks[chunkY * this->chunksX + chunkX].dirty) this->bake(chunkX, chunkY);
+		}
+	}
+}
+
+void Tilemap::visibleChunks(vec2<double> const &layerPos, vec2<double> const &min, vec2<double> const &max, std::vector<uint32_t> &out) const
+{
+	double const chunkWidth = this->tileSize.x() * chunkSize, chunkHeight = this->tileSize.y() * chunkSize;
+	if(chunkWidth <= 0 || chunkHeight <= 0) return;
+	int64_t const firstX = std::max<int64_t>(0, static_cast<int64_t>(std::floor((min.x() - layerPos.x()) / chunkWidth)));
+	int64_t const firstY = std::max<int64_t>(0, static_cast<int64_t>(std::floor((min.y() - layerPos.y()) / chunkHeight)));
+	int64_t const lastX = std::min<int64_t>(this->chunksX - 1, static_cast<int64_t>(std::floor((max.x() - layerPos.x()) / chunkWidth)));
+	int64_t const lastY = std::min<int64_t>(this->chunksY - 1, static_cast<int64_t>(std::floor((max.y() - layerPos.y()) / chunkHeight)));
+	for(int64_t chunkY = firstY; chunkY <= lastY; chunkY++)
+	{
+		for(int64_t chunkX = firstX; chunkX <= lastX; chunkX++)
+		{
+			uint32_t const index = static_cast<uint32_t>(chunkY * this->chunksX + chunkX);
+			if(this->chunks[index].mesh) out.push_back(index);
+		}
+	}
+}
+
+Tilemap::Chunk const& Tilemap::getChunk(uint32_t index) const
+{
+	return this->chunks[index];
+}
+
+vec2<double> Tilemap::chunkOrigin(uint32_t index, vec2<double> const &layerPos) const
+{
+	uint32_t const chunkX = index % this->chunksX, chunkY = index / this->chunksX;
+	return {layerPos.x() + chunkX * chunkSize * this->tileSize.x(), layerPos.y() + chunkY * chunkSize * this->tileSize.y()};
+}
+
+void Tilemap::bake(uint32_t chunkX, uint32_t chunkY)
+{
+	Chunk &chunk = this->chunks[chunkY * this->chunksX + chunkX];
+	chunk.dirty = false;
+	uint32_t const startX = chunkX * chunkSize, startY = chunkY * chunkSize;
+	uint32_t const endX = std::min(startX + chunkSize, this->width), endY = std::min(startY + chunkSize, this->height);
+	
+	//4 vertices and 6 indices per tile, wound the same way as sprite quads
+	std::vector<uint8_t> records;
+	std::vector<uint16_t> indices;
+	records.reserve(static_cast<size_t>(chunkSize) * chunkSize * 4 * this->layout.stride);
+	indices.reserve(static_cast<size_t>(chunkSize) * chunkSize * 6);
+	auto addVertex = [&](double x, double y, vec2<float> const &uv)
+	{
+		size_t const offset = records.size();
+		records.resize(offset + this->layout.stride);
+		float const position[2] = {static_cast<float>(x), static_cast<float>(y)};
+		float const texCoord[2] = {uv.x(), uv.y()};
+		VertexLayout::encode(this->layout.position, position, records.data() + offset);
+		VertexLayout::encode(this->layout.uv, texCoord, records.data() + offset + this->layout.uvOffset);
+	};
+	for(uint32_t y = startY; y < endY; y++)
+	{
+		for(uint32_t x = startX; x < endX; x++)
+		{
+			uint16_t const tile = this->tiles[static_cast<size_t>(y) * this->width + x];
+			if(tile == emptyTile || tile >= this->tileUVs.size()) continue;
+			QuadUVs const &uvs = this->tileUVs[tile];
+			double const left = (x - startX) * this->tileSize.x(), top = (y - startY) * this->tileSize.y();
+			double const right = left + this->tileSize.x(), bottom = top + this->tileSize.y();
+			uint16_t const base = static_cast<uint16_t>(records.size() / this->layout.stride);
+			addVertex(right, bottom, uvs.lowerRight);
+			addVertex(left, bottom, uvs.lowerLeft);
+			addVertex(right, top, uvs.upperRight);
+			addVertex(left, top, uvs.upperLeft);
+			indices.insert(indices.end(), {base, static_cast<uint16_t>(base + 1), static_cast<uint16_t>(base + 2), static_cast<uint16_t>(base + 2), static_cast<uint16_t>(base + 1), static_cast<uint16_t>(base + 3)});
+		}
+	}
+	if(indices.empty())
+	{
+		chunk.mesh = nullptr;
+		return;
+	}
+	chunk.mesh = MU<Mesh>(records.data(), records.size() / this->layout.stride, this->layout, indices.data(), indices.size(), sizeof(uint16_t));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "def.hh"
+#include "api/render/mesh.hh"
+#include "api/render/atlas.hh"
+
+#include <commons/math/vec2.hh>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// A layer of static tiles, stored as a 2D array of tile IDs
+/// The tiles are baked into one mesh per chunkSize x chunkSize chunk, which is only rebuilt when one of its tiles changes,
+/// so drawing a layer costs a draw call per visible chunk rather than one per tile
+/// The tile data is guarded by a mutex, so tiles can be edited from worker threads while the renderer rebuilds chunks
+struct Tilemap
+{
+	static constexpr uint32_t chunkSize = 32;
+	static constexpr uint16_t emptyTile = 0;
+	
+	struct Chunk
+	{
+		UP<Mesh> mesh = nullptr; //Null if every tile in the chunk is empty, vertices are relative to the chunk's origin
+		bool dirty = true;
+	};
+	
+	/// \param width Width of the layer in tiles
+	/// \param height Height of the layer in tiles
+	/// \param tileSize Size of a tile in world units
+	/// \param atlasID Atlas the tiles' images are in
+	/// \param shaderID Shader to draw the tiles with
+	Tilemap(uint32_t width, uint32_t height, vec2<double> const &tileSize, uint64_t atlasID, uint64_t shaderID);
+	
+	[[nodiscard]] static SP<Tilemap> create(uint32_t width, uint32_t height, vec2<double> const &tileSize, uint64_t atlasID, uint64_t shaderID)
+	{
+		return MS<Tilemap>(width, height, tileSize, atlasID, shaderID);
+	}
+	
+	/// Register a tile from the atlas so it can be placed
+	/// \param tileName Name of the tile in the atlas
+	/// \return The ID to place the tile with, the same name always gets the same ID
+	uint16_t addTileType(std::string const &tileName);
+	
+	/// Place a tile, marking its chunk for rebuilding if it changed
+	/// \param tile A tile ID from addTileType, or emptyTile to clear it
+	void setTile(uint32_t x, uint32_t y, uint16_t tile);
+	
+	[[nodiscard]] uint16_t getTile(uint32_t x, uint32_t y) const;
+	
+	/// Rebake the geometry of chunks whose tiles have changed, must be called on the thread that owns the GL context
+	void rebuild();
+	
+	/// Find the chunks with geometry that overlap a world space rectangle
+	/// \param layerPos Where the layer is, the renderer passes the pos captured in its frame snapshot rather than reading pos live
+	/// \param out Indices of the visible chunks, appended to
+	void visibleChunks(vec2<double> const &layerPos, vec2<double> const &min, vec2<double> const &max, std::vector<uint32_t> &out) const;
+	
+	[[nodiscard]] Chunk const& getChunk(uint32_t index) const;
+	
+	/// Top left of a chunk in world space, for the layer at layerPos
+	[[nodiscard]] vec2<double> chunkOrigin(uint32_t index, vec2<double> const &layerPos) const;
+	
+	vec2<double> pos{}; //Top left of the layer in world space, moving it doesn't require rebuilding any chunks
+	uint32_t width = 0, height = 0;
+	vec2<double> tileSize{};
+	uint64_t atlasID = 0, shaderID = 0;
+
+private:
+	void bake(uint32_t chunkX, uint32_t chunkY);
+	
+	mutable std::mutex mutex; //Guards tiles, tileNames and the chunks' dirty flags
+	std::vector<uint16_t> tiles; //Row major, width x height
+	std::vector<std::string> tileNames{""}; //Indexed by tile ID, 0 is the empty tile
+	std::vector<QuadUVs> tileUVs; //Resolved from the atlas when chunks are baked
+	std::vector<Chunk> chunks; //Row major, chunksX x chunksY
+	uint32_t chunksX = 0, chunksY = 0;
+	VertexLayout layout{};
+};
@@ -1,13 +1,11 @@
 #include "util.hh"
+#include "global.hh"
 #include "api/assets/pngw.hh"
 
 #include <glad/glad.h>
-#include <commons/threadpool.hh>
 #include <commons/fileio.hh>
 #include <cstring>
 
-ThreadPool threadPool;
-
 void screenshotIOThread(std::string const &folderPath, uint32_t width, uint32_t height, std::vector<uint8_t> pixels)
 {
 	createDirectory(folderPath); //Create the screenshots directory if it doesn't exist
@@ -1,4 +1,8 @@
 #include "world.hh"
+#include "parallel.hh"
+
+#include <algorithm>
+#include <cmath>
 
 void World::update(double delta)
 {
@@ -35,25 +39,176 @@ std::vector<SP<Object>> World::getObjectsAtPosition(const vec2<float> & pos)
 	return out;
 }
 
-struct RenderList World::getSceneGraph()
+Renderable makeRenderable(Object const &obj)
 {
+	return Renderable{
+		obj.spatialComp->pos,
+		obj.spatialComp->scale,
+		obj.spatialComp->rotation,
+		vec3<double>{0.0, 0.0, 1.0},
+		obj.graphicsComp->atlasID,
+		obj.graphicsComp->shaderID,
+		obj.graphicsComp->layer,
+		obj.graphicsComp->subLayer,
+		obj.name};
+}
+
+/// Emit draw packets for the candidates across the thread pool, each batch into its own bucket, then merge the buckets by draw key
+template <typename F> RenderList buildRenderList(size_t numCandidates, F const &candidate)
+{
+	size_t constexpr grain = 2048;
+	size_t const numBatches = (numCandidates + grain - 1) / grain;
+	std::vector<std::vector<Renderable>> buckets(numBatches);
+	parallelFor(numCandidates, grain, [&](size_t begin, size_t end, size_t batch)
+	{
+		std::vector<Renderable> &bucket = buckets[batch];
+		bucket.reserve(end - begin);
+		for(size_t i = begin; i < end; i++)
+		{
+			Object const &obj = candidate(i);
+			if(obj.graphicsComp && obj.spatialComp) bucket.push_back(makeRenderable(obj));
+		}
+	});
+	
+	//Buckets are laid end to end in batch order, so a packet's index in that order keeps sorting stable and locates it again after sorting
+	std::vector<size_t> offsets(numBatches + 1, 0);
+	for(size_t batch = 0; batch < numBatches; batch++) offsets[batch + 1] = offsets[batch] + buckets[batch].size();
+	size_t const total = offsets.back();
+	std::vector<uint64_t> keys(total);
+	parallelFor(numBatches, 1, [&](size_t batch, size_t, size_t)
+	{
+		for(size_t i = 0; i < buckets[batch].size(); i++) keys[offsets[batch] + i] = RenderList::drawKey(buckets[batch][i], offsets[batch] + i);
+	});
+	radixSort(keys);
+	
 	RenderList out;
-	for(auto const &obj : this->objects)
+	out.list.resize(total);
+	parallelFor(total, grain, [&](size_t begin, size_t end, size_t)
 	{
-		if(obj->graphicsComp && obj->spatialComp)
+		for(size_t i = begin; i < end; i++)
 		{
-			Renderable r{
-				obj->spatialComp->pos,
-				obj->spatialComp->scale,
-				obj->spatialComp->rotation,
-				vec3<double>{0.0, 0.0, 1.0},
-				obj->graphicsComp->atlasID,
-				obj->graphicsComp->shaderID,
-				obj->graphicsComp->layer,
-				obj->graphicsComp->subLayer,
-				obj->name};
-			out.add(r);
-		};
-	}
+			size_t const index = keys[i] & RenderList::drawKeyIndexMask;
+			size_t const batch = std::upper_bound(offsets.begin(), offsets.end(), index) - offsets.begin() - 1;
+			out.list[i] = std::move(buckets[batch][index - offsets[batch]]);
+		}
+	});
+	return out;
+}
+
+struct RenderList World::getSceneGraph()
+{
+	return buildRenderList(this->objects.size(), [this](size_t i) -> Object const&
+	{
+		return *this->objects[i];
+	});
+}
+
+struct RenderList World::getSceneGraph(Camera const &camera)
+{
+	//A camera without a view size can't be culled against
+	if(camera.viewSize.x() == 0 || camera.viewSize.y() == 0) return this->getSceneGraph();
+	this->syncSpatialIndex();
+	vec2<double> viewMin{camera.pos.x(), camera.pos.y()};
+	vec2<double> viewMax{viewMin.x() + camera.viewSize.x(), viewMin.y() + camera.viewSize.y()};
+	this->visible.clear();
+	this->cullStats.visited = this->spatialIndex.query(viewMin, viewMax, [this](Object *obj)
+	{
+		this->visible.emplace_back(this->drawOrder[obj], obj);
+	});
+	std::sort(this->visible.begin(), this->visible.end()); //Submission order breaks ties in the draw key, so keep it the objects' order
+	RenderList out = buildRenderList(this->visible.size(), [this](size_t i) -> Object const&
+	{
+		return *this->visible[i].second;
+	});
+	this->cullStats.submitted = this->visible.size();
+	this->cullStats.culled = this->spatialIndex.size() - this->visible.size();
 	return out;
 }
+
+void World::add(SP<Object> const &obj)
+{
+	if(this->objects.size() != this->numTracked) this->resyncPending = true; //Objects pushed directly since the last sync haven't been given an order yet
+	this->objects.push_back(obj);
+	this->numTracked = this->objects.size();
+	this->drawOrder[obj.get()] = this->nextDrawOrder++;
+	this->moved.push_back(obj.get());
+}
+
+void World::remove(SP<Object> const &obj)
+{
+	auto it = std::find(this->objects.begin(), this->objects.end(), obj);
+	if(it == this->objects.end()) return;
+	if(this->objects.size() != this->numTracked) this->resyncPending = true;
+	this->objects.erase(it);
+	this->numTracked = this->objects.size();
+	this->spatialIndex.remove(obj.get());
+	this->drawOrder.erase(obj.get());
+}
+
+void World::markMoved(Object *obj)
+{
+	this->moved.push_back(obj);
+}
+
+void World::markAllMoved()
+{
+	this->resyncPending = true;
+}
+
+void World::syncSpatialIndex()
+{
+	//Objects pushed onto the end directly are ordered after everything else, anything more than that needs a full resync
+	if(!this->resyncPending && this->objects.size() > this->numTracked)
+	{
+		for(size_t i = this->numTracked; i < this->objects.size(); i++)
+		{
+			this->drawOrder[this->objects[i].get()] = this->nextDrawOrder++;
+			this->moved.push_back(this->objects[i].get());
+		}
+		this->numTracked = this->objects.size();
+	}
+	else if(this->objects.size() != this->numTracked) this->resyncPending = true;
+	if(this->resyncPending)
+	{
+		this->resyncAll();
+		return;
+	}
+	
+	//Only what's changed is visited, objects that were removed since they were marked are no longer ordered and are skipped
+	for(Object *obj : this->moved) if(this->drawOrder.contains(obj)) this->syncObject(obj);
+	this->moved.clear();
+}
+
+void World::syncObject(Object *obj)
+{
+	if(!obj->graphicsComp || !obj->spatialComp)
+	{
+		this->spatialIndex.remove(obj);
+		return;
+	}
+	SpatialComponent const &spatial = *obj->spatialComp;
+	
+	//Sprites are centered on their position, rotated ones are bounded by their diagonal
+	double halfWidth = std::abs(spatial.scale.x()) / 2.0, halfHeight = std::abs(spatial.scale.y()) / 2.0;
+	if(spatial.rotation != 0) halfWidth = halfHeight = std::sqrt(halfWidth * halfWidth + halfHeight * halfHeight);
+	halfWidth += 1;
+	halfHeight += 1; //Positions are rounded to whole pixels when drawn
+	this->spatialIndex.update(obj, {spatial.pos.x() - halfWidth, spatial.pos.y() - halfHeight}, {spatial.pos.x() + halfWidth, spatial.pos.y() + halfHeight});
+}
+
+void World::resyncAll()
+{
+	//Every object is visited and reordered, objects whose bounds stay in the same grid cells still aren't rebucketed
+	this->drawOrder.clear();
+	this->nextDrawOrder = 0;
+	this->spatialIndex.beginSync();
+	for(SP<Object> const &obj : this->objects)
+	{
+		this->drawOrder[obj.get()] = this->nextDrawOrder++;
+		if(obj->graphicsComp && obj->spatialComp) this->syncObject(obj.get());
+	}
+	this->spatialIndex.endSync();
+	this->moved.clear();
+	this->numTracked = this->objects.size();
+	this->resyncPending = false;
+}
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "object.hh"
+#include "tilemap.hh"
+#include "spatialGrid.hh"
 #include "api/render/renderList.hh"
+#include "api/assets/camera.hh"
 
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 struct World
@@ -27,5 +33,47 @@ struct World
 	/// Get a representation of the visible objects in this world that can be given to the renderer to render this world
 	RenderList getSceneGraph();
 	
+	/// Get a representation of only the objects that overlap the camera's view, found through a spatial index rather than checking every object
+	/// Only objects added, removed or marked as moved since the last call are resynced, so the index has to be told about changes, see below
+	RenderList getSceneGraph(Camera const &camera);
+	
+	/// Add an object, it's drawn after the objects already in the world when they overlap
+	void add(SP<Object> const &obj);
+	
+	/// Remove an object, keeping the order of the rest
+	void remove(SP<Object> const &obj);
+	
+	/// Tell the spatial index an object's SpatialComponent or GraphicsComponent changed, ie it moved or one was added
+	/// Calling this more than once before the next culled getSceneGraph is harmless
+	void markMoved(Object *obj);
+	
+	/// Resync every object on the next culled getSceneGraph, for after objects has been edited directly
+	/// Objects pushed onto the end of objects directly are noticed without this, anything else isn't
+	void markAllMoved();
+	
+	/// Counts from the last culled getSceneGraph call
+	struct CullStats
+	{
+		size_t visited = 0; //Candidates near the view that were checked
+		size_t submitted = 0; //Candidates that overlapped the view
+		size_t culled = 0; //Objects with graphics that weren't submitted
+	};
+	
+	CullStats cullStats{};
+	
 	std::vector<SP<Object>> objects;
+	std::vector<SP<Tilemap>> tilemaps; //Static tile layers, drawn in order beneath the objects
+
+private:
+	void syncSpatialIndex();
+	void syncObject(Object *obj);
+	void resyncAll();
+	
+	SpatialGrid<Object*> spatialIndex{256.0};
+	std::unordered_map<Object*, uint64_t> drawOrder; //Ascending in the objects' order, only written when objects are added, the grid doesn't preserve order but drawing needs to
+	std::vector<Object*> moved; //Waiting to be resynced, may hold objects that have since been removed
+	std::vector<std::pair<uint64_t, Object*>> visible; //Reused between queries
+	uint64_t nextDrawOrder = 0;
+	size_t numTracked = 0; //Size of objects when it was last synced, so objects pushed directly are noticed
+	bool resyncPending = true;
 };
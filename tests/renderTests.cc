@@ -0,0 +1,218 @@
+#include "../src/api/render/commandBuffer.hh"
+#include "../src/api/render/renderGraph.hh"
+
+#include <cstdio>
+
+//GL-free checks of the command recorder and render graph, none of this creates a context so it runs anywhere ctest does
+
+namespace
+{
+	int failures = 0;
+	
+	void check(bool condition, char const *what, int line)
+	{
+		if(condition) return;
+		printf("Failed at line %d: %s\n", line, what);
+		failures++;
+	}
+	
+	#define CHECK(condition) check((condition), #condition, __LINE__)
+	
+	//Never dereferenced, the recorder only stores the pointer for Renderer::submit
+	Shader *const pipeline = reinterpret_cast<Shader*>(alignof(Shader));
+	
+	void recordFrame()
+	{
+		CommandBuffer commands;
+		commands.bindPipeline(pipeline);
+		commands.bindTexture(0, 7);
+		commands.bindImage(1, 9, IO::WRITE, CF::RGBA16F);
+		commands.setFloat(UniformID("strength"), 0.5f);
+		commands.setUInt(UniformID("count"), 3);
+		commands.draw(DrawMode::TRIS, 6, 2);
+		commands.draw(DrawMode::TRIS, 0);
+		commands.drawIndexed(DrawMode::TRIS, 12, 0, 4, 0);
+		commands.dispatch(8, 0);
+		commands.dispatch(8, 4);
+		commands.barrier(0x20);
+		commands.timestamp(0);
+		commands.timestamp(3);
+		
+		//Empty draws, dispatches and unallocated queries aren't recorded at all
+		std::vector<Command> const &recorded = commands.getCommands();
+		CHECK(recorded.size() == 9);
+		if(recorded.size() != 9) return;
+		CHECK(recorded[0].type == CommandType::BindPipeline && recorded[0].bindPipeline.shader == pipeline);
+		CHECK(recorded[1].type == CommandType::BindTexture && recorded[1].bindTexture.unit == 0 && recorded[1].bindTexture.handle == 7);
+		CHECK(recorded[2].type == CommandType::BindImage && recorded[2].bindImage.unit == 1 && recorded[2].bindImage.handle == 9);
+		CHECK(recorded[2].bindImage.access == IO::WRITE && recorded[2].bindImage.format == CF::RGBA16F);
+		
+		CHECK(recorded[3].type == CommandType::SetUniform && recorded[3].setUniform.type == UniformType::Float);
+		CHECK(recorded[3].setUniform.uniform == UniformID("strength").hash);
+		CHECK(commands.getUniform<float>(recorded[3].setUniform) == 0.5f);
+		CHECK(recorded[4].type == CommandType::SetUniform && recorded[4].setUniform.type == UniformType::UInt);
+		CHECK(recorded[4].setUniform.uniform == UniformID::fromName("count").hash);
+		CHECK(commands.getUniform<uint32_t>(recorded[4].setUniform) == 3);
+		
+		CHECK(recorded[5].type == CommandType::Draw && recorded[5].draw.mode == DrawMode::TRIS);
+		CHECK(recorded[5].draw.first == 0 && recorded[5].draw.count == 6 && recorded[5].draw.instances == 2);
+		CHECK(recorded[6].type == CommandType::Dispatch && recorded[6].dispatch.groupsX == 8 && recorded[6].dispatch.groupsY == 4 && recorded[6].dispatch.groupsZ == 1);
+		CHECK(recorded[7].type == CommandType::Barrier && recorded[7].barrier.bits == 0x20);
+		CHECK(recorded[8].type == CommandType::Timestamp && recorded[8].timestamp.query == 3);
+		
+		commands.clear();
+		CHECK(commands.empty());
+	}
+	
+	void appendKeepsUniforms()
+	{
+		//Buffers recorded apart each start their uniform data at 0
+		CommandBuffer first, second;
+		first.setFloat(UniformID("a"), 1.0f);
+		first.draw(DrawMode::POINTS, 1);
+		second.setInt(UniformID("b"), -4);
+		second.setFloat(UniformID("c"), 2.5f);
+		first.append(second);
+		
+		std::vector<Command> const &recorded = first.getCommands();
+		CHECK(recorded.size() == 4);
+		if(recorded.size() != 4) return;
+		CHECK(first.getUniform<float>(recorded[0].setUniform) == 1.0f);
+		CHECK(recorded[1].type == CommandType::Draw);
+		CHECK(recorded[2].setUniform.uniform == UniformID("b").hash && first.getUniform<int32_t>(recorded[2].setUniform) == -4);
+		CHECK(recorded[3].setUniform.uniform == UniformID("c").hash && first.getUniform<float>(recorded[3].setUniform) == 2.5f);
+		
+		//The source is left as it was
+		CHECK(second.size() == 2 && second.getUniform<int32_t>(second.getCommands()[0].setUniform) == -4);
+	}
+	
+	using RG = RenderGraph;
+	
+	void noop(RG::PassContext const&) {}
+	
+	void disabledPassForwards()
+	{
+		RG graph;
+		RG::ResourceID const scene = graph.importResource("Scene", CF::RGBA32F, 64, 64, 5);
+		RG::ResourceID const blurred = graph.createResource("Blurred");
+		RG::ResourceID const graded = graph.createResource("Graded");
+		RG::PassID const blur = graph.addPass("Blur", RG::PassKind::Compute, {scene}, {blurred}, noop);
+		RG::PassID const grade = graph.addPass("Grade", RG::PassKind::Compute, {blurred}, {graded}, noop);
+		graph.setEnabled(blur, false);
+		graph.markOutput(graded);
+		graph.compile(64, 64);
+		
+		//The pass after a disabled one reads the disabled pass's input in its place
+		CHECK(graph.getPass(blur).culled && !graph.getPass(grade).culled);
+		CHECK(graph.resolve(blurred) == scene && graph.isDefined(blurred) && graph.texture(blurred) == 5);
+		CHECK(graph.getGroups().size() == 1 && graph.getGroups()[0].size() == 1 && graph.getGroups()[0][0] == grade);
+		
+		//Disabling the last pass too leaves the import as the output
+		graph.setEnabled(grade, false);
+		graph.compile(64, 64);
+		CHECK(graph.resolve(graded) == scene && graph.texture(graded) == 5);
+		CHECK(graph.getGroups().empty() && graph.getPhysical().empty());
+	}
+	
+	void unusedBranchCulled()
+	{
+		RG graph;
+		RG::ResourceID const scene = graph.importResource("Scene", CF::RGBA32F, 64, 64, 5);
+		RG::ResourceID const used = graph.createResource("Used");
+		RG::ResourceID const unused = graph.createResource("Unused");
+		RG::ResourceID const unusedToo = graph.createResource("Unused too");
+		RG::ResourceID const drawn = graph.createResource("Drawn");
+		RG::PassID const kept = graph.addPass("Kept", RG::PassKind::Compute, {scene}, {used}, noop);
+		RG::PassID const branch = graph.addPass("Branch", RG::PassKind::Compute, {scene}, {unused}, noop);
+		RG::PassID const branchEnd = graph.addPass("Branch end", RG::PassKind::Compute, {unused}, {unusedToo}, noop);
+		RG::PassID const overlay = graph.addPass("Overlay", RG::PassKind::Raster, {scene}, {drawn}, noop);
+		graph.setSideEffects(overlay, true);
+		graph.markOutput(used);
+		graph.compile(64, 64);
+		
+		CHECK(!graph.getPass(kept).culled && !graph.getPass(overlay).culled);
+		CHECK(graph.getPass(branch).culled && graph.getPass(branchEnd).culled);
+		CHECK(!graph.isDefined(unused) && !graph.isDefined(unusedToo));
+		CHECK(graph.getResource(unused).physical < 0 && graph.getResource(unusedToo).physical < 0);
+		
+		size_t scheduled = 0;
+		for(auto const &group : graph.getGroups()) scheduled += group.size();
+		CHECK(scheduled == 2);
+	}
+	
+	void transientsShareByLifetime()
+	{
+		//A chain of three passes, the first image is dead by the time the third is written but the second is still being read
+		RG graph;
+		RG::ResourceID const scene = graph.importResource("Scene", CF::RGBA32F, 64, 64, 5);
+		RG::ResourceID const first = graph.createResource("First", CF::RGBA16F);
+		RG::ResourceID const second = graph.createResource("Second", CF::RGBA16F);
+		RG::ResourceID const third = graph.createResource("Third", CF::RGBA16F);
+		graph.addPass("One", RG::PassKind::Compute, {scene}, {first}, noop);
+		graph.addPass("Two", RG::PassKind::Compute, {first}, {second}, noop);
+		graph.addPass("Three", RG::PassKind::Compute, {second}, {third}, noop);
+		graph.markOutput(third);
+		graph.compile(64, 64);
+		
+		RG::Resource const &a = graph.getResource(first), &b = graph.getResource(second), &c = graph.getResource(third);
+		CHECK(a.physical >= 0 && b.physical >= 0 && c.physical >= 0);
+		CHECK(a.physical == c.physical);
+		CHECK(a.physical != b.physical && b.physical != c.physical);
+		CHECK(graph.getPhysical().size() == 2);
+		
+		//Every pass depends on the last, so each needs its own barrier
+		CHECK(graph.getGroups().size() == 3);
+		
+		graph.setPhysicalHandle(static_cast<size_t>(c.physical), 11);
+		CHECK(graph.texture(third) == 11 && graph.texture(first) == 11);
+	}
+	
+	void differentSizesDontShare()
+	{
+		RG graph;
+		RG::ResourceID const scene = graph.importResource("Scene", CF::RGBA32F, 64, 64, 5);
+		RG::ResourceID const full = graph.createResource("Full");
+		RG::ResourceID const half = graph.createResource("Half", CF::RGBA32F, 0.5f);
+		RG::ResourceID const last = graph.createResource("Last", CF::RGBA32F, 0.5f);
+		graph.addPass("Full", RG::PassKind::Compute, {scene}, {full}, noop);
+		graph.addPass("Half", RG::PassKind::Compute, {full}, {half}, noop);
+		graph.addPass("Last", RG::PassKind::Compute, {half}, {last}, noop);
+		graph.markOutput(last);
+		graph.compile(64, 64);
+		
+		//Full is free by the time Last is written, but not the right size for it
+		CHECK(graph.getResource(half).width == 32 && graph.getResource(half).height == 32);
+		CHECK(graph.getResource(full).physical != graph.getResource(last).physical);
+		CHECK(graph.getPhysical().size() == 3);
+	}
+	
+	void culledProducerLeavesOutputUndefined()
+	{
+		//Nothing writes the mask, so the pass reading it can't run and the output it would write holds nothing
+		RG graph;
+		RG::ResourceID const scene = graph.importResource("Scene", CF::RGBA32F, 64, 64, 5);
+		RG::ResourceID const mask = graph.createResource("Mask");
+		RG::ResourceID const result = graph.createResource("Result");
+		RG::PassID const masked = graph.addPass("Masked", RG::PassKind::Compute, {scene, mask}, {result}, noop);
+		graph.markOutput(result);
+		graph.compile(64, 64);
+		
+		CHECK(graph.getPass(masked).culled);
+		CHECK(!graph.isDefined(result) && graph.texture(result) == 0);
+		CHECK(graph.getResource(result).physical < 0 && graph.getPhysical().empty());
+		CHECK(graph.isDefined(scene) && graph.texture(scene) == 5);
+	}
+}
+
+int main()
+{
+	recordFrame();
+	appendKeepsUniforms();
+	disabledPassForwards();
+	unusedBranchCulled();
+	transientsShareByLifetime();
+	differentSizesDontShare();
+	culledProducerLeavesOutputUndefined();
+	if(failures == 0) printf("All render tests passed\n");
+	return failures == 0 ? 0 : 1;
+}